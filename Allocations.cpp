@@ -0,0 +1,81 @@
+/*
+ * @file   Allocations.cpp
+ * @brief  Counts heap allocations made through operator new, in total and
+ *          by the calling thread, so a benchmark can show how many a control
+ *          command costs once a session is up and running.
+ * @author Brendan Sweeney, ID #1161836
+ * @date   December 13, 2012
+ */
+
+#include "Allocations.h"
+
+
+static long long         allocated = 0;     // by every thread
+static __thread long long mine     = 0;     // by the calling thread
+
+
+// counts one allocation
+static inline void *counted(size_t size) {
+    __sync_fetch_and_add(&allocated, 1);
+    ++mine;
+    return malloc(size > 0 ? size : 1);
+} // end counted(size_t)
+
+
+// operator new calls made since the program started
+long long Allocations::total(void) {
+    return __sync_fetch_and_add(&allocated, 0);
+} // end total()
+
+
+// operator new calls the calling thread has made
+long long Allocations::thisThread(void) {
+    return mine;
+} // end thisThread()
+
+
+void *operator new(size_t size) {
+    void *block = counted(size);
+
+    if (block == NULL) {
+        throw bad_alloc();
+    } // end if (block == NULL)
+    return block;
+} // end operator new(size_t)
+
+
+void *operator new[](size_t size) {
+    return operator new(size);
+} // end operator new[](size_t)
+
+
+void *operator new(size_t size, const nothrow_t&) noexcept {
+    return counted(size);
+} // end operator new(size_t, const nothrow_t&)
+
+
+void *operator new[](size_t size, const nothrow_t&) noexcept {
+    return counted(size);
+} // end operator new[](size_t, const nothrow_t&)
+
+
+void operator delete(void *block) noexcept {
+    free(block);
+} // end operator delete(void*)
+
+
+void operator delete[](void *block) noexcept {
+    free(block);
+} // end operator delete[](void*)
+
+
+// the sized forms C++14 calls when the size is known; they free the same
+// way, so every form of delete is paired with this file's operator new
+void operator delete(void *block, size_t) noexcept {
+    free(block);
+} // end operator delete(void*, size_t)
+
+
+void operator delete[](void *block, size_t) noexcept {
+    free(block);
+} // end operator delete[](void*, size_t)
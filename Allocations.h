@@ -0,0 +1,25 @@
+/*
+ * @file   Allocations.h
+ * @brief  Counts heap allocations made through operator new, in total and
+ *          by the calling thread, so a benchmark can show how many a control
+ *          command costs once a session is up and running.
+ * @author Brendan Sweeney, ID #1161836
+ * @date   December 13, 2012
+ */
+
+#ifndef ALLOCATIONS_H
+#define	ALLOCATIONS_H
+
+#include <stdlib.h>         // malloc, free
+#include <new>              // bad_alloc, nothrow_t
+
+using namespace std;
+
+
+class Allocations {
+public:
+    static long long total(void);
+    static long long thisThread(void);
+}; // end class Allocations
+
+#endif	/* ALLOCATIONS_H */
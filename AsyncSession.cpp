@@ -0,0 +1,458 @@
+/*
+ * @file   AsyncSession.cpp
+ * @brief  An FTP session driven by coroutines on a Reactor. Each command is
+ *          a Task to co_await, and gives back what happened as a typed result
+ *          -- reply code, text, bytes and time taken -- rather than text to
+ *          print. Sockets are non-blocking and every wait is handed to the
+ *          reactor, so one thread can run hundreds of sessions at once.
+ * @author Brendan Sweeney, ID #1161836
+ * @date   December 13, 2012
+ */
+
+#include "AsyncSession.h"
+
+
+AsyncSession::AsyncSession(Reactor& reactor) :
+        reactor(reactor), ctrlSd(-1), passiveMode(UNTRIED), binary(false),
+        buffer(BUFLEN) {
+} // end constructor
+
+
+// drops the control connection without a QUIT, if it is still open
+AsyncSession::~AsyncSession() {
+    hangUp(ctrlSd);
+} // end destructor
+
+
+// connects to a server and reads its greeting; the host name is resolved
+// before the first wait, the connection made without blocking
+Task<CommandResult> AsyncSession::open(string hostname, string port) {
+    CommandResult    result = {0, "", 0};
+    vector<Endpoint> endpoints;
+    string           error;
+
+    hangUp(ctrlSd);
+    parser.clear();
+    passiveMode = UNTRIED;
+    binary      = false;
+
+    if (!Connector::resolve(hostname, atoi(port.c_str()), endpoints,
+                            error)) {
+        result.text = "unknown hostname: " + hostname + ": " + error + "\n";
+        co_return result;
+    } // end if (!Connector::resolve(...))
+
+    // the addresses are tried in the order Connector put them in
+    for (size_t i = 0; i < endpoints.size() && ctrlSd < 0; ++i) {
+        ctrlSd = co_await dial(endpoints[i]);
+        if (ctrlSd < 0) {
+            error = strerror(errno);
+        } // end if (ctrlSd < 0)
+    } // end for (i < endpoints.size() && ctrlSd < 0)
+    if (ctrlSd < 0) {
+        result.text = "connect failure: " + hostname + ": " + error + "\n";
+        co_return result;
+    } // end if (ctrlSd < 0)
+
+    TransferTuner::tuneControl(ctrlSd);
+    co_return co_await reply();
+} // end open(string, string)
+
+
+// sends a user name, and the password if the server asks for one; the
+// result is the last reply, 230 if the session is logged in
+Task<CommandResult> AsyncSession::login(string username, string password) {
+    CommandResult result = co_await command("USER", username);
+
+    if (result.code / 100 == FtpBackend::POS_INTER) {
+        result = co_await command("PASS", password);
+    } // end if (result.code / 100 == POS_INTER)
+
+    co_return result;
+} // end login(string, string)
+
+
+// sends one command and reads its reply
+Task<CommandResult> AsyncSession::command(string verb, string arg) {
+    long long     started = TransferMetrics::now();
+    CommandResult result  = {0, "", 0};
+
+    if (co_await transmit(verb, arg)) {
+        result = co_await reply();
+    } // end if (co_await transmit(...))
+    else {
+        result.text = "control connection lost\n";
+    } // end else
+
+    result.usec = (TransferMetrics::now() - started) / 1000;
+    co_return result;
+} // end command(string, string)
+
+
+// changes the working directory on the server
+Task<CommandResult> AsyncSession::cd(string directory) {
+    co_return co_await command("CWD", directory);
+} // end cd(string)
+
+
+// asks the server for its working directory
+Task<CommandResult> AsyncSession::pwd(void) {
+    co_return co_await command("PWD");
+} // end pwd()
+
+
+// downloads a remote file into a local one in TYPE I; the result tells
+// the final reply, the bytes moved and how long they took
+Task<TransferResult> AsyncSession::get(string remote, string local) {
+    TransferResult result = {0, 0, 0, 0, "", "", 0, -1};
+    int file = ::open(local.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                      0644);
+
+    if (file < 0) {
+        result.reply = local + ": " + strerror(errno) + "\n";
+        co_return result;
+    } // end if (file < 0)
+
+    int dataSd = co_await dataConnection(result);
+
+    if (dataSd < 0) {
+        close(file);
+        co_return result;
+    } // end if (dataSd < 0)
+
+    // the data waits in the socket until the preliminary reply is read, so
+    // a refusal is not mistaken for an empty file
+    CommandResult opened = co_await command("RETR", remote);
+
+    result.code = opened.code;
+    if (opened.code / 100 != FtpBackend::POS_PRE) {
+        result.reply = opened.text;
+        hangUp(dataSd);
+        close(file);
+        co_return result;
+    } // end if (opened.code / 100 != POS_PRE)
+    result.preliminary = opened.text;
+
+    long long started = TransferMetrics::now();
+    bool      failed  = false;
+    int       turns   = 0;
+
+    while(true) {
+        ssize_t got = read(dataSd, &buffer[0], buffer.size());
+
+        ++result.syscalls;
+        if (got > 0) {
+            ssize_t done = 0;
+
+            while(done < got) {
+                ssize_t wrote = write(file, &buffer[done], got - done);
+
+                ++result.syscalls;
+                if (wrote < 0 && errno == EINTR)
+                    continue;
+                if (wrote <= 0)
+                    break;
+                done += wrote;
+            } // end while(done < got)
+            if (done < got) {
+                failed = true;      // the disk is full or failing
+                break;
+            } // end if (done < got)
+            result.bytes += got;
+
+            // a fast connection goes back in line now and then, so the
+            // other sessions on the reactor are not starved
+            if (++turns % 16 == 0
+                    && !co_await reactor.ready(dataSd, EPOLLIN, TIMEOUT)) {
+                failed = true;
+                break;
+            } // end if (++turns % 16 == 0 && ...)
+        } // end if (got > 0)
+        else if (got == 0) {
+            break;
+        } // end else if (got == 0)
+        else if (errno == EINTR) {
+            continue;
+        } // end else if (errno == EINTR)
+        else if (errno != EAGAIN
+                 || !co_await reactor.ready(dataSd, EPOLLIN, TIMEOUT)) {
+            failed = true;
+            break;
+        } // end else if (errno != EAGAIN || ...)
+    } // end while(true)
+
+    result.usec = (TransferMetrics::now() - started) / 1000;
+    hangUp(dataSd);
+    close(file);
+
+    // a transfer that broke off still gets the server's word on it
+    CommandResult closing = co_await reply();
+
+    result.code  = failed && closing.code / 100 == FtpBackend::POS_COMPL
+                   ? 0 : closing.code;
+    result.reply = closing.text;
+    co_return result;
+} // end get(string, string)
+
+
+// uploads a local file under a remote name in TYPE I; the result tells
+// the final reply, the bytes moved and how long they took
+Task<TransferResult> AsyncSession::put(string local, string remote) {
+    TransferResult result = {0, 0, 0, 0, "", "", 0, -1};
+    int file = ::open(local.c_str(), O_RDONLY | O_CLOEXEC);
+
+    if (file < 0) {
+        result.reply = local + ": " + strerror(errno) + "\n";
+        co_return result;
+    } // end if (file < 0)
+
+    int dataSd = co_await dataConnection(result);
+
+    if (dataSd < 0) {
+        close(file);
+        co_return result;
+    } // end if (dataSd < 0)
+
+    CommandResult opened = co_await command("STOR", remote);
+
+    result.code = opened.code;
+    if (opened.code / 100 != FtpBackend::POS_PRE) {
+        result.reply = opened.text;
+        hangUp(dataSd);
+        close(file);
+        co_return result;
+    } // end if (opened.code / 100 != POS_PRE)
+    result.preliminary = opened.text;
+
+    long long started = TransferMetrics::now();
+    bool      failed  = false;
+    int       turns   = 0;
+    ssize_t   got;
+
+    while((got = read(file, &buffer[0], buffer.size())) != 0) {
+        ++result.syscalls;
+        if (got < 0) {
+            if (errno == EINTR)
+                continue;
+            failed = true;
+            break;
+        } // end if (got < 0)
+
+        ssize_t done = 0;
+
+        while(done < got && !failed) {
+            ssize_t sent = write(dataSd, &buffer[done], got - done);
+
+            ++result.syscalls;
+            if (sent > 0) {
+                done += sent;
+            } // end if (sent > 0)
+            else if (sent < 0 && errno == EINTR) {
+                continue;
+            } // end else if (sent < 0 && errno == EINTR)
+            else if (sent == 0 || errno != EAGAIN
+                     || !co_await reactor.ready(dataSd, EPOLLOUT, TIMEOUT)) {
+                failed = true;
+            } // end else if (sent == 0 || ...)
+        } // end while(done < got && !failed)
+        if (failed) {
+            break;
+        } // end if (failed)
+        result.bytes += got;
+
+        if (++turns % 16 == 0
+                && !co_await reactor.ready(dataSd, EPOLLOUT, TIMEOUT)) {
+            failed = true;
+            break;
+        } // end if (++turns % 16 == 0 && ...)
+    } // end while((got = read(...)) != 0)
+
+    // closing the data connection is the end of file to the server
+    result.usec = (TransferMetrics::now() - started) / 1000;
+    hangUp(dataSd);
+    close(file);
+
+    CommandResult closing = co_await reply();
+
+    result.code  = failed && closing.code / 100 == FtpBackend::POS_COMPL
+                   ? 0 : closing.code;
+    result.reply = closing.text;
+    co_return result;
+} // end put(string, string)
+
+
+// ends the session
+Task<CommandResult> AsyncSession::quit(void) {
+    CommandResult result = co_await command("QUIT");
+
+    hangUp(ctrlSd);
+    co_return result;
+} // end quit()
+
+
+// starts a non-blocking connection and waits for it to be made; returns
+// the socket, or -1 with errno set
+Task<int> AsyncSession::dial(const Endpoint& address) {
+    int sd = socket(Connector::family(address),
+                    SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+    if (sd < 0) {
+        co_return -1;
+    } // end if (sd < 0)
+
+    if (connect(sd, (sockaddr *)&address.addr, address.len) < 0) {
+        int       error = errno;
+        socklen_t len   = sizeof(error);
+
+        if (error == EINPROGRESS
+                && co_await reactor.ready(sd, EPOLLOUT, Connector::TIMEOUT)) {
+            getsockopt(sd, SOL_SOCKET, SO_ERROR, &error, &len);
+        } // end if (error == EINPROGRESS && ...)
+        else if (error == EINPROGRESS) {
+            error = ETIMEDOUT;
+        } // end else if (error == EINPROGRESS)
+
+        if (error != 0) {
+            hangUp(sd);
+            errno = error;
+            co_return -1;
+        } // end if (error != 0)
+    } // end if (connect(...) < 0)
+
+    co_return sd;
+} // end dial(const Endpoint&)
+
+
+// writes a verb, its argument if there is one, and CRLF as one command
+// straight from where they are; the caller's frame owns both views and is
+// suspended until this returns; false if the connection failed
+Task<bool> AsyncSession::transmit(string_view verb, string_view arg) {
+    struct iovec parts[4];
+    int    count = 0;
+
+    parts[count].iov_base = (void *)verb.data();
+    parts[count++].iov_len = verb.length();
+    if (!arg.empty()) {
+        parts[count].iov_base = (void *)" ";
+        parts[count++].iov_len = 1;
+        parts[count].iov_base = (void *)arg.data();
+        parts[count++].iov_len = arg.length();
+    } // end if (!arg.empty())
+    parts[count].iov_base = (void *)"\r\n";
+    parts[count++].iov_len = 2;
+
+    struct iovec *next = parts;
+
+    while(count > 0) {
+        ssize_t sent = writev(ctrlSd, next, count);
+
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent < 0 && errno == EAGAIN
+                && co_await reactor.ready(ctrlSd, EPOLLOUT, TIMEOUT))
+            continue;
+        if (sent <= 0)
+            co_return false;
+
+        // a short write leaves the rest to go from where it stopped
+        while(count > 0 && (size_t)sent >= next->iov_len) {
+            sent -= next->iov_len;
+            ++next;
+            --count;
+        } // end while(count > 0 && ...)
+        if (count > 0) {
+            next->iov_base = (char *)next->iov_base + sent;
+            next->iov_len -= sent;
+        } // end if (count > 0)
+    } // end while(count > 0)
+
+    co_return true;
+} // end transmit(string_view, string_view)
+
+
+// reads one complete reply, however many reads or lines it takes; code 0
+// if the connection closed or stayed silent for TIMEOUT ms
+Task<CommandResult> AsyncSession::reply(void) {
+    long long     started = TransferMetrics::now();
+    CommandResult result  = {0, "", 0};
+    char          chunk[1448];
+
+    while(!parser.next(latest)) {
+        ssize_t got = read(ctrlSd, chunk, sizeof(chunk));
+
+        if (got > 0) {
+            parser.feed(chunk, got);
+            continue;
+        } // end if (got > 0)
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got < 0 && errno == EAGAIN
+                && co_await reactor.ready(ctrlSd, EPOLLIN, TIMEOUT))
+            continue;
+
+        parser.clear();
+        result.text = got == 0 ? "connection closed by server\n"
+                               : "no reply from server\n";
+        result.usec = (TransferMetrics::now() - started) / 1000;
+        co_return result;
+    } // end while(!parser.next(latest))
+
+    result.code = latest.code;
+    result.text = latest.text;
+    result.usec = (TransferMetrics::now() - started) / 1000;
+    co_return result;
+} // end reply()
+
+
+// puts the server in TYPE I, asks it for a passive data port, with EPSV
+// unless it has shown it only knows PASV, and connects to it; returns the
+// data socket, or -1 with result telling why
+Task<int> AsyncSession::dataConnection(TransferResult& result) {
+    CommandResult answer;
+    Endpoint      address;
+
+    if (!binary) {
+        answer = co_await command("TYPE", "I");
+        binary = answer.code / 100 == FtpBackend::POS_COMPL;
+    } // end if (!binary)
+
+    answer = co_await command(passiveMode == LEGACY ? "PASV" : "EPSV");
+    // a server from before RFC 2428 is asked again with PASV, which can
+    // only name an IPv4 address
+    if (passiveMode == UNTRIED && answer.code != 229
+            && Connector::peer(ctrlSd, address)
+            && Connector::family(address) == AF_INET) {
+        passiveMode = LEGACY;
+        answer = co_await command("PASV");
+    } // end if (passiveMode == UNTRIED && ...)
+
+    FtpReply passive = {answer.code, answer.text};
+
+    if (!FtpBackend::parsePassive(passive, ctrlSd, address)) {
+        result.code  = answer.code;
+        result.reply = answer.text;
+        co_return -1;
+    } // end if (!FtpBackend::parsePassive(...))
+    if (passiveMode == UNTRIED) {
+        passiveMode = EXTENDED;
+    } // end if (passiveMode == UNTRIED)
+
+    int dataSd = co_await dial(address);
+
+    if (dataSd < 0) {
+        result.reply = "connect failure: " + Connector::format(address)
+                       + ": " + strerror(errno) + "\n";
+    } // end if (dataSd < 0)
+
+    co_return dataSd;
+} // end dataConnection(TransferResult&)
+
+
+// closes a socket, taking it out of the reactor first
+void AsyncSession::hangUp(int& sd) {
+    if (sd >= 0) {
+        reactor.forget(sd);
+        close(sd);
+        sd = -1;
+    } // end if (sd >= 0)
+} // end hangUp(int&)
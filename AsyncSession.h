@@ -0,0 +1,78 @@
+/*
+ * @file   AsyncSession.h
+ * @brief  An FTP session driven by coroutines on a Reactor. Each command is
+ *          a Task to co_await, and gives back what happened as a typed result
+ *          -- reply code, text, bytes and time taken -- rather than text to
+ *          print. Sockets are non-blocking and every wait is handed to the
+ *          reactor, so one thread can run hundreds of sessions at once.
+ * @author Brendan Sweeney, ID #1161836
+ * @date   December 13, 2012
+ */
+
+#ifndef ASYNCSESSION_H
+#define	ASYNCSESSION_H
+
+#include <sys/socket.h>     // socket, connect, getsockopt
+#include <sys/types.h>
+#include <sys/uio.h>        // writev
+#include <errno.h>
+#include <fcntl.h>          // open
+#include <stdlib.h>         // atoi
+#include <string.h>         // strerror
+#include <unistd.h>         // read, write, close
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Connector.h"
+#include "FtpBackend.h"
+#include "Reactor.h"
+#include "ReplyParser.h"
+#include "Task.h"
+#include "TransferEngine.h"
+#include "TransferMetrics.h"
+#include "TransferTuner.h"
+
+using namespace std;
+
+
+// outcome of one control command
+struct CommandResult {
+    int    code;            // reply code, or 0 if none arrived
+    string text;            // the reply, or why there was none
+    long   usec;            // command sent to reply read, in microseconds
+};
+
+
+class AsyncSession {
+public:
+    static const int TIMEOUT = 60000,       // idle milliseconds before abort
+                     BUFLEN  = 65536;       // data bytes per read or write
+    AsyncSession(Reactor& reactor);
+    ~AsyncSession();
+    Task<CommandResult>  open(string hostname, string port);
+    Task<CommandResult>  login(string username, string password);
+    Task<CommandResult>  command(string verb, string arg = "");
+    Task<CommandResult>  cd(string directory);
+    Task<CommandResult>  pwd(void);
+    Task<TransferResult> get(string remote, string local);
+    Task<TransferResult> put(string local, string remote);
+    Task<CommandResult>  quit(void);
+private:
+    // whether this server has answered EPSV yet
+    enum   passivity {UNTRIED, EXTENDED, LEGACY};
+    Reactor&    reactor;        // runs this session's waits
+    int         ctrlSd;         // control connection, or -1
+    ReplyParser parser;         // assembles control replies
+    FtpReply    latest;         // most recent control reply
+    passivity   passiveMode;    // EPSV, or PASV for an old server
+    bool        binary;         // the server is in TYPE I
+    vector<char> buffer;        // data staged between file and socket
+
+    Task<int>  dial(const Endpoint& address);
+    Task<bool> transmit(string_view verb, string_view arg);
+    Task<CommandResult> reply(void);
+    Task<int>  dataConnection(TransferResult& result);
+    void   hangUp(int& sd);
+}; // end class AsyncSession
+
+#endif	/* ASYNCSESSION_H */
@@ -0,0 +1,259 @@
+/*
+ * @file   Broadcast.cpp
+ * @brief  One local file read once and sent to several servers. The file is
+ *          read in large aligned chunks into a ring that every reader takes
+ *          from at its own pace; a chunk is reused only once every reader has
+ *          sent it, so the fastest reader can run at most a window of chunks
+ *          ahead of the slowest before it waits.
+ * @author Brendan Sweeney, ID #1161836
+ * @date   December 13, 2012
+ */
+
+#include "Broadcast.h"
+
+
+Broadcast::Broadcast() : file(-1), length(0), loaded(0), oldest(0),
+                         loading(false), broken(false), fetched(0) {
+    for (int i = 0; i < CHUNKS; ++i) {
+        ring[i] = NULL;
+    } // end for (i < CHUNKS)
+    pthread_mutex_init(&lock, NULL);
+} // end default constructor
+
+
+Broadcast::~Broadcast() {
+    close();
+    for (int i = 0; i < CHUNKS; ++i) {
+        free(ring[i]);
+    } // end for (i < CHUNKS)
+    pthread_mutex_destroy(&lock);
+} // end destructor
+
+
+// opens a file to send to the given number of readers, numbered from 0;
+// false if it cannot be read
+bool Broadcast::open(const string& path, int count) {
+    struct stat info;
+
+    close();
+    if ((file = ::open(path.c_str(), O_RDONLY)) < 0) {
+        return false;
+    } // end if ((file = open(...)) < 0)
+    if (fstat(file, &info) < 0) {
+        close();
+        return false;
+    } // end if (fstat(...) < 0)
+    posix_fadvise(file, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    for (int i = 0; i < CHUNKS; ++i) {
+        if (ring[i] == NULL
+                && posix_memalign((void **)&ring[i], ALIGN, CHUNK_LEN) != 0) {
+            ring[i] = NULL;
+            close();
+            return false;
+        } // end if (ring[i] == NULL && ...)
+    } // end for (i < CHUNKS)
+
+    length  = info.st_size;
+    loaded  = oldest = 0;
+    loading = broken = false;
+    fetched = 0;
+    for (int i = 0; i < count; ++i) {
+        Reader reader = {0, true, false,
+                         eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)};
+
+        readers.push_back(reader);
+    } // end for (i < count)
+
+    return true;
+} // end open(const string&, int)
+
+
+// size of the file being sent
+long long Broadcast::size(void) const {
+    return length;
+} // end size()
+
+
+// the next bytes a reader is to send, reading the chunk that holds them if
+// no other reader has; NULL if there are none yet, in which case event()
+// is written when there are, or none at all, as drained() or failed() tell
+const char *Broadcast::peek(int reader, size_t& len) {
+    Reader& self = readers[reader];
+
+    len = 0;
+    pthread_mutex_lock(&lock);
+    if (broken || !self.active || self.pos >= length) {
+        pthread_mutex_unlock(&lock);
+        return NULL;
+    } // end if (broken || ...)
+
+    long long chunk = self.pos / CHUNK_LEN;
+
+    // no reader is ever more than one chunk past what has been read
+    if (chunk >= loaded) {
+        if (loading || loaded - oldest >= CHUNKS) {
+            self.waiting = true;
+            pthread_mutex_unlock(&lock);
+            return NULL;
+        } // end if (loading || ...)
+
+        // the slot is free, so it is filled without the lock held
+        loading = true;
+        pthread_mutex_unlock(&lock);
+        bool filled = fill(chunk);
+        pthread_mutex_lock(&lock);
+        loading = false;
+        if (filled) {
+            ++loaded;
+        } // end if (filled)
+        broken = !filled;
+        wake();
+        if (broken) {
+            pthread_mutex_unlock(&lock);
+            return NULL;
+        } // end if (broken)
+    } // end if (chunk >= loaded)
+    pthread_mutex_unlock(&lock);
+
+    long long start = chunk * (long long)CHUNK_LEN;
+    size_t    held  = length - start < (long long)CHUNK_LEN
+                      ? length - start : CHUNK_LEN;
+
+    len = held - (self.pos - start);
+    return ring[chunk % CHUNKS] + (self.pos - start);
+} // end peek(int, size_t&)
+
+
+// marks len bytes from peek() as sent by a reader; a chunk every reader
+// has sent frees its slot for the readers waiting on the window
+void Broadcast::consume(int reader, size_t len) {
+    pthread_mutex_lock(&lock);
+    readers[reader].pos += len;
+    advance();
+    pthread_mutex_unlock(&lock);
+} // end consume(int, size_t)
+
+
+// true once a reader has sent the whole file
+bool Broadcast::drained(int reader) {
+    bool done;
+
+    pthread_mutex_lock(&lock);
+    done = readers[reader].pos >= length;
+    pthread_mutex_unlock(&lock);
+
+    return done;
+} // end drained(int)
+
+
+// true if the file could not be read
+bool Broadcast::failed(void) {
+    bool failure;
+
+    pthread_mutex_lock(&lock);
+    failure = broken;
+    pthread_mutex_unlock(&lock);
+
+    return failure;
+} // end failed()
+
+
+// takes a reader that has failed or finished out of the window, so it no
+// longer holds the others back
+void Broadcast::leave(int reader) {
+    pthread_mutex_lock(&lock);
+    readers[reader].active = false;
+    advance();
+    pthread_mutex_unlock(&lock);
+} // end leave(int)
+
+
+// readable when a reader that found nothing to send can try again
+int Broadcast::event(int reader) const {
+    return readers[reader].eventFd;
+} // end event(int)
+
+
+// clears event()
+void Broadcast::reap(int reader) {
+    uint64_t count;
+
+    ::read(readers[reader].eventFd, &count, sizeof(count));
+} // end reap(int)
+
+
+// file bytes read from disk; the file size if it was read exactly once
+long long Broadcast::bytesRead(void) const {
+    return fetched;
+} // end bytesRead()
+
+
+// closes the file and forgets the readers; the ring is kept for reuse
+void Broadcast::close(void) {
+    if (file >= 0) {
+        ::close(file);
+        file = -1;
+    } // end if (file >= 0)
+    for (size_t i = 0; i < readers.size(); ++i) {
+        ::close(readers[i].eventFd);
+    } // end for (i < readers.size())
+    readers.clear();
+} // end close()
+
+
+// reads one chunk of the file into its slot; called without the lock, by
+// the one reader that set loading
+bool Broadcast::fill(long long chunk) {
+    long long start = chunk * (long long)CHUNK_LEN;
+    size_t    want  = length - start < (long long)CHUNK_LEN
+                      ? length - start : CHUNK_LEN;
+    size_t    got   = 0;
+    char     *into  = ring[chunk % CHUNKS];
+
+    while(got < want) {
+        ssize_t l = pread(file, into + got, want - got, start + got);
+
+        if (l < 0 && errno == EINTR)
+            continue;
+        if (l <= 0)
+            return false;       // unreadable, or shorter than it was
+        got += l;
+    } // end while(got < want)
+
+    fetched += got;
+    return true;
+} // end fill(long long)
+
+
+// moves the window up to the first chunk an active reader still needs,
+// waking the readers that waited on it; called with the lock held
+void Broadcast::advance(void) {
+    long long first = loaded;
+
+    for (size_t i = 0; i < readers.size(); ++i) {
+        if (readers[i].active && readers[i].pos / (long long)CHUNK_LEN
+                                 < first) {
+            first = readers[i].pos / CHUNK_LEN;
+        } // end if (readers[i].active && ...)
+    } // end for (i < readers.size())
+
+    if (first > oldest) {
+        oldest = first;
+        wake();
+    } // end if (first > oldest)
+} // end advance()
+
+
+// writes event() for every reader waiting to go on; called with the lock
+// held
+void Broadcast::wake(void) {
+    uint64_t one = 1;
+
+    for (size_t i = 0; i < readers.size(); ++i) {
+        if (readers[i].waiting) {
+            readers[i].waiting = false;
+            write(readers[i].eventFd, &one, sizeof(one));
+        } // end if (readers[i].waiting)
+    } // end for (i < readers.size())
+} // end wake()
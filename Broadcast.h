@@ -0,0 +1,71 @@
+/*
+ * @file   Broadcast.h
+ * @brief  One local file read once and sent to several servers. The file is
+ *          read in large aligned chunks into a ring that every reader takes
+ *          from at its own pace; a chunk is reused only once every reader has
+ *          sent it, so the fastest reader can run at most a window of chunks
+ *          ahead of the slowest before it waits.
+ * @author Brendan Sweeney, ID #1161836
+ * @date   December 13, 2012
+ */
+
+#ifndef BROADCAST_H
+#define	BROADCAST_H
+
+#include <sys/eventfd.h>    // eventfd
+#include <sys/stat.h>       // fstat
+#include <sys/types.h>
+#include <errno.h>
+#include <fcntl.h>          // open, posix_fadvise
+#include <pthread.h>
+#include <stdint.h>         // uint64_t
+#include <stdlib.h>         // posix_memalign, free
+#include <unistd.h>         // pread, read, write, close
+#include <string>
+#include <vector>
+
+using namespace std;
+
+
+class Broadcast {
+public:
+    static const int    CHUNKS    = 16,         // chunks in the ring
+                        ALIGN     = 4096;       // chunk alignment in memory
+    static const size_t CHUNK_LEN = 1048576;    // file bytes per chunk
+    Broadcast();
+    ~Broadcast();
+    bool   open(const string& path, int readers);
+    long long size(void) const;
+    const char *peek(int reader, size_t& len);
+    void   consume(int reader, size_t len);
+    bool   drained(int reader);
+    bool   failed(void);
+    void   leave(int reader);
+    int    event(int reader) const;
+    void   reap(int reader);
+    long long bytesRead(void) const;
+    void   close(void);
+private:
+    struct Reader {
+        long long pos;          // next file byte this reader sends
+        bool   active;          // still sending; holds back the window
+        bool   waiting;         // wants event written when it can go on
+        int    eventFd;         // readable when the reader can go on
+    };
+    char    *ring[CHUNKS];      // chunk n of the file is in ring[n % CHUNKS]
+    int      file;              // the file being sent, or -1
+    long long length;           // its size when opened
+    long long loaded;           // chunks read so far
+    long long oldest;           // first chunk an active reader still needs
+    bool     loading;           // a reader is reading the next chunk
+    bool     broken;            // reading the file failed
+    long long fetched;          // file bytes read, each of them once
+    vector<Reader>  readers;    // one per server sent to
+    pthread_mutex_t lock;       // guards all of the above but ring contents
+
+    bool   fill(long long chunk);
+    void   advance(void);
+    void   wake(void);
+}; // end class Broadcast
+
+#endif	/* BROADCAST_H */
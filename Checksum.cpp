@@ -0,0 +1,656 @@
+/*
+ * @file   Checksum.cpp
+ * @brief  Streaming checksums of transferred data, fed as the bytes pass
+ *          through the transfer loop so a file never has to be read twice:
+ *          CRC32 as XCRC reports it, folded with PCLMULQDQ; CRC32C on the
+ *          SSE4.2 crc32 instruction; MD5; and SHA-256 on the SHA extensions.
+ *          Each has a portable version for processors without them.
+ * @author Brendan Sweeney, ID #1161836
+ * @date   December 13, 2012
+ */
+
+#include "Checksum.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>      // _mm_crc32_u64, _mm_sha256rnds2_epu32
+#define	CHECKSUM_X86 1
+#endif
+
+
+namespace {
+
+// slicing-by-8 tables for a reflected CRC polynomial
+struct CrcTable {
+    uint32_t slice[8][256];
+
+    CrcTable(uint32_t poly) {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+
+            for (int k = 0; k < 8; ++k) {
+                c = c & 1 ? (c >> 1) ^ poly : c >> 1;
+            } // end for (k < 8)
+            slice[0][i] = c;
+        } // end for (i < 256)
+        for (uint32_t i = 0; i < 256; ++i) {
+            for (int t = 1; t < 8; ++t) {
+                slice[t][i] = (slice[t - 1][i] >> 8)
+                              ^ slice[0][slice[t - 1][i] & 0xff];
+            } // end for (t < 8)
+        } // end for (i < 256)
+    } // end constructor
+
+    uint32_t update(uint32_t crc, const unsigned char *p, size_t len) const {
+        while(len >= 8) {
+            uint32_t lo, hi;
+
+            memcpy(&lo, p, 4);
+            memcpy(&hi, p + 4, 4);
+            lo ^= crc;
+            crc = slice[7][lo & 0xff] ^ slice[6][(lo >> 8) & 0xff]
+                  ^ slice[5][(lo >> 16) & 0xff] ^ slice[4][lo >> 24]
+                  ^ slice[3][hi & 0xff] ^ slice[2][(hi >> 8) & 0xff]
+                  ^ slice[1][(hi >> 16) & 0xff] ^ slice[0][hi >> 24];
+            p   += 8;
+            len -= 8;
+        } // end while(len >= 8)
+        while(len-- > 0) {
+            crc = (crc >> 8) ^ slice[0][(crc ^ *p++) & 0xff];
+        } // end while(len-- > 0)
+        return crc;
+    } // end update(uint32_t, const unsigned char*, size_t)
+};
+
+const CrcTable ieee(0xedb88320);        // CRC32, as zip and XCRC use it
+const CrcTable castagnoli(0x82f63b78);  // CRC32C
+
+const uint32_t SHA256_K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+const uint32_t MD5_K[64] = {
+    0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a,
+    0xa8304613, 0xfd469501, 0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be,
+    0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821, 0xf61e2562, 0xc040b340,
+    0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+    0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8,
+    0x676f02d9, 0x8d2a4c8a, 0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c,
+    0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70, 0x289b7ec6, 0xeaa127fa,
+    0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+    0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92,
+    0xffeff47d, 0x85845dd1, 0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1,
+    0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+};
+
+const int MD5_S[64] = {
+    7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+    5,  9, 14, 20, 5,  9, 14, 20, 5,  9, 14, 20, 5,  9, 14, 20,
+    4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+    6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21
+};
+
+inline uint32_t rotl(uint32_t x, int n) {
+    return (x << n) | (x >> (32 - n));
+} // end rotl(uint32_t, int)
+
+inline uint32_t rotr(uint32_t x, int n) {
+    return (x >> n) | (x << (32 - n));
+} // end rotr(uint32_t, int)
+
+// what the processor offers, asked once
+#ifdef CHECKSUM_X86
+const bool HAS_SSE42  = __builtin_cpu_supports("sse4.2");
+const bool HAS_PCLMUL = __builtin_cpu_supports("pclmul")
+                        && __builtin_cpu_supports("sse4.1");
+const bool HAS_SHA    = __builtin_cpu_supports("sha")
+                        && __builtin_cpu_supports("sse4.1");
+#else
+const bool HAS_SSE42  = false;
+const bool HAS_PCLMUL = false;
+const bool HAS_SHA    = false;
+#endif
+
+} // end namespace
+
+
+Checksum::Checksum() {
+    reset(NONE);
+} // end default constructor
+
+
+// starts a new checksum of the given kind
+void Checksum::reset(kind which) {
+    static const uint32_t SHA256_H[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    static const uint32_t MD5_H[4] = {
+        0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476
+    };
+
+    algorithm = which;
+    crc       = 0xffffffff;
+    held      = 0;
+    total     = 0;
+    done      = false;
+    result.clear();
+    if (which == SHA256) {
+        memcpy(state, SHA256_H, sizeof(SHA256_H));
+    } // end if (which == SHA256)
+    else if (which == MD5) {
+        memcpy(state, MD5_H, sizeof(MD5_H));
+    } // end else if (which == MD5)
+} // end reset(kind)
+
+
+// adds the next bytes of the stream
+void Checksum::update(const char *data, size_t len) {
+    const unsigned char *p = (const unsigned char *)data;
+
+    switch (algorithm) {
+        case CRC32:
+            crc = crc32(crc, p, len);
+            return;
+        case CRC32C:
+            crc = crc32c(crc, p, len);
+            return;
+        case MD5:
+        case SHA256:
+            break;
+        default:
+            return;
+    } // end switch (algorithm)
+
+    total += len;
+    if (held > 0) {
+        size_t take = 64 - held < len ? 64 - held : len;
+
+        memcpy(block + held, p, take);
+        held += take;
+        p    += take;
+        len  -= take;
+        if (held < 64) {
+            return;
+        } // end if (held < 64)
+        blocks(block, 1);
+        held = 0;
+    } // end if (held > 0)
+
+    // whole blocks straight from the caller's buffer
+    blocks(p, len / 64);
+    p   += len / 64 * 64;
+    len %= 64;
+    memcpy(block, p, len);
+    held = len;
+} // end update(const char*, size_t)
+
+
+// the kind being computed
+Checksum::kind Checksum::type(void) const {
+    return algorithm;
+} // end type()
+
+
+// the finished checksum in lower case hexadecimal; no more may be added
+string Checksum::hex(void) {
+    static const char DIGITS[] = "0123456789abcdef";
+
+    if (done) {
+        return result;
+    } // end if (done)
+    done = true;
+
+    if (algorithm == CRC32 || algorithm == CRC32C) {
+        uint32_t value = crc ^ 0xffffffff;
+
+        for (int shift = 28; shift >= 0; shift -= 4) {
+            result += DIGITS[(value >> shift) & 0xf];
+        } // end for (shift >= 0)
+    } // end if (algorithm == CRC32 || ...)
+    else if (algorithm == MD5 || algorithm == SHA256) {
+        int words = algorithm == MD5 ? 4 : 8;
+
+        pad(algorithm == SHA256);
+        for (int i = 0; i < words; ++i) {
+            for (int b = 0; b < 4; ++b) {
+                // MD5 words are little endian, SHA-256 words big endian
+                int      shift = algorithm == MD5 ? 8 * b : 24 - 8 * b;
+                uint32_t byte  = (state[i] >> shift) & 0xff;
+
+                result += DIGITS[byte >> 4];
+                result += DIGITS[byte & 0xf];
+            } // end for (b < 4)
+        } // end for (i < words)
+    } // end else if (algorithm == MD5 || ...)
+
+    return result;
+} // end hex()
+
+
+// the name servers use for a kind, as in HASH and OPTS HASH
+string Checksum::name(kind which) {
+    switch (which) {
+        case CRC32:
+            return "CRC32";
+        case CRC32C:
+            return "CRC32C";
+        case MD5:
+            return "MD5";
+        case SHA256:
+            return "SHA-256";
+        case ANY:
+            return "auto";
+        default:
+            return "off";
+    } // end switch (which)
+} // end name(kind)
+
+
+// reads a kind from a name such as sha256, SHA-256 or crc32c; anything
+// else is NONE
+Checksum::kind Checksum::parse(const string& text) {
+    string word;
+
+    for (size_t i = 0; i < text.length(); ++i) {
+        if (text.at(i) != '-') {
+            word += toupper(text.at(i));
+        } // end if (text.at(i) != '-')
+    } // end for (i < text.length())
+
+    if (word == "CRC32" || word == "CRC")
+        return CRC32;
+    if (word == "CRC32C")
+        return CRC32C;
+    if (word == "MD5")
+        return MD5;
+    if (word == "SHA256")
+        return SHA256;
+    if (word == "AUTO" || word == "ON")
+        return ANY;
+    return NONE;
+} // end parse(const string&)
+
+
+// hexadecimal digits in a checksum of this kind
+size_t Checksum::digits(kind which) {
+    switch (which) {
+        case CRC32:
+        case CRC32C:
+            return 8;
+        case MD5:
+            return 32;
+        case SHA256:
+            return 64;
+        default:
+            return 0;
+    } // end switch (which)
+} // end digits(kind)
+
+
+// runs the block function over count 64-byte blocks
+void Checksum::blocks(const unsigned char *data, size_t count) {
+    if (count == 0) {
+        return;
+    } // end if (count == 0)
+    if (algorithm == MD5) {
+        md5(state, data, count);
+    } // end if (algorithm == MD5)
+    else if (HAS_SHA) {
+        sha256Ni(state, data, count);
+    } // end else if (HAS_SHA)
+    else {
+        sha256(state, data, count);
+    } // end else
+} // end blocks(const unsigned char*, size_t)
+
+
+// appends the 0x80 byte, zeros and the bit length that end MD5 and SHA-256
+void Checksum::pad(bool bigEndian) {
+    uint64_t bits = total * 8;
+
+    block[held++] = 0x80;
+    if (held > 56) {
+        memset(block + held, 0, 64 - held);
+        blocks(block, 1);
+        held = 0;
+    } // end if (held > 56)
+    memset(block + held, 0, 56 - held);
+    for (int i = 0; i < 8; ++i) {
+        block[56 + i] = bigEndian ? (unsigned char)(bits >> (56 - 8 * i))
+                                  : (unsigned char)(bits >> (8 * i));
+    } // end for (i < 8)
+    blocks(block, 1);
+    held = 0;
+} // end pad(bool)
+
+
+// one MD5 step; f is the round's boolean function of b, c and d
+#define	MD5_STEP(f, a, b, c, d, m, i)                                      \
+    a = b + rotl(a + (f) + MD5_K[i] + (m), MD5_S[i])
+
+// the MD5 compression function, RFC 1321; the rounds are written out so
+// the compiler sees no branches
+void Checksum::md5(uint32_t state[4], const unsigned char *data,
+                   size_t count) {
+    while(count-- > 0) {
+        uint32_t m[16];
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+
+        for (int i = 0; i < 16; ++i) {
+            m[i] = data[4 * i] | data[4 * i + 1] << 8
+                   | data[4 * i + 2] << 16 | (uint32_t)data[4 * i + 3] << 24;
+        } // end for (i < 16)
+
+        for (int i = 0; i < 16; i += 4) {
+            MD5_STEP((b & c) | (~b & d), a, b, c, d, m[i], i);
+            MD5_STEP((a & b) | (~a & c), d, a, b, c, m[i + 1], i + 1);
+            MD5_STEP((d & a) | (~d & b), c, d, a, b, m[i + 2], i + 2);
+            MD5_STEP((c & d) | (~c & a), b, c, d, a, m[i + 3], i + 3);
+        } // end for (i < 16)
+        for (int i = 16; i < 32; i += 4) {
+            MD5_STEP((d & b) | (~d & c), a, b, c, d, m[(5 * i + 1) % 16], i);
+            MD5_STEP((c & a) | (~c & b), d, a, b, c, m[(5 * i + 6) % 16],
+                     i + 1);
+            MD5_STEP((b & d) | (~b & a), c, d, a, b, m[(5 * i + 11) % 16],
+                     i + 2);
+            MD5_STEP((a & c) | (~a & d), b, c, d, a, m[(5 * i + 16) % 16],
+                     i + 3);
+        } // end for (i < 32)
+        for (int i = 32; i < 48; i += 4) {
+            MD5_STEP(b ^ c ^ d, a, b, c, d, m[(3 * i + 5) % 16], i);
+            MD5_STEP(a ^ b ^ c, d, a, b, c, m[(3 * i + 8) % 16], i + 1);
+            MD5_STEP(d ^ a ^ b, c, d, a, b, m[(3 * i + 11) % 16], i + 2);
+            MD5_STEP(c ^ d ^ a, b, c, d, a, m[(3 * i + 14) % 16], i + 3);
+        } // end for (i < 48)
+        for (int i = 48; i < 64; i += 4) {
+            MD5_STEP(c ^ (b | ~d), a, b, c, d, m[7 * i % 16], i);
+            MD5_STEP(b ^ (a | ~c), d, a, b, c, m[7 * (i + 1) % 16], i + 1);
+            MD5_STEP(a ^ (d | ~b), c, d, a, b, m[7 * (i + 2) % 16], i + 2);
+            MD5_STEP(d ^ (c | ~a), b, c, d, a, m[7 * (i + 3) % 16], i + 3);
+        } // end for (i < 64)
+
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        data     += 64;
+    } // end while(count-- > 0)
+} // end md5(uint32_t[], const unsigned char*, size_t)
+#undef	MD5_STEP
+
+
+// the SHA-256 compression function, FIPS 180-4
+void Checksum::sha256(uint32_t state[8], const unsigned char *data,
+                      size_t count) {
+    while(count-- > 0) {
+        uint32_t w[64];
+        uint32_t v[8];
+
+        for (int i = 0; i < 16; ++i) {
+            w[i] = (uint32_t)data[4 * i] << 24 | data[4 * i + 1] << 16
+                   | data[4 * i + 2] << 8 | data[4 * i + 3];
+        } // end for (i < 16)
+        for (int i = 16; i < 64; ++i) {
+            uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18)
+                          ^ (w[i - 15] >> 3);
+            uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19)
+                          ^ (w[i - 2] >> 10);
+
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        } // end for (i < 64)
+
+        memcpy(v, state, sizeof(v));
+        for (int i = 0; i < 64; ++i) {
+            uint32_t s1 = rotr(v[4], 6) ^ rotr(v[4], 11) ^ rotr(v[4], 25);
+            uint32_t ch = (v[4] & v[5]) ^ (~v[4] & v[6]);
+            uint32_t t1 = v[7] + s1 + ch + SHA256_K[i] + w[i];
+            uint32_t s0 = rotr(v[0], 2) ^ rotr(v[0], 13) ^ rotr(v[0], 22);
+            uint32_t mj = (v[0] & v[1]) ^ (v[0] & v[2]) ^ (v[1] & v[2]);
+
+            v[7] = v[6];
+            v[6] = v[5];
+            v[5] = v[4];
+            v[4] = v[3] + t1;
+            v[3] = v[2];
+            v[2] = v[1];
+            v[1] = v[0];
+            v[0] = t1 + s0 + mj;
+        } // end for (i < 64)
+
+        for (int i = 0; i < 8; ++i) {
+            state[i] += v[i];
+        } // end for (i < 8)
+        data += 64;
+    } // end while(count-- > 0)
+} // end sha256(uint32_t[], const unsigned char*, size_t)
+
+
+#ifdef CHECKSUM_X86
+// four rounds on the SHA extensions: schedule words w, constants from k
+#define	SHA_ROUNDS(w, k)                                                    \
+    msg    = _mm_add_epi32(w, _mm_loadu_si128((const __m128i *)(k)));     \
+    cdgh   = _mm_sha256rnds2_epu32(cdgh, abef, msg);                       \
+    msg    = _mm_shuffle_epi32(msg, 0x0e);                                 \
+    abef   = _mm_sha256rnds2_epu32(abef, cdgh, msg)
+
+// the next four schedule words, from the sixteen before them
+#define	SHA_SCHEDULE(w0, w1, w2, w3)                                        \
+    w0 = _mm_sha256msg1_epu32(w0, w1);                                     \
+    w0 = _mm_add_epi32(w0, _mm_alignr_epi8(w3, w2, 4));                    \
+    w0 = _mm_sha256msg2_epu32(w0, w3)
+
+// the SHA-256 compression function on the SHA extensions
+__attribute__((target("sha,sse4.1")))
+void Checksum::sha256Ni(uint32_t state[8], const unsigned char *data,
+                        size_t count) {
+    const __m128i swap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL,
+                                        0x0405060700010203ULL);
+    __m128i abef, cdgh, msg, w0, w1, w2, w3;
+
+    // the instructions want the state as ABEF and CDGH
+    __m128i dcba = _mm_loadu_si128((const __m128i *)&state[0]);
+    __m128i hgfe = _mm_loadu_si128((const __m128i *)&state[4]);
+
+    dcba = _mm_shuffle_epi32(dcba, 0xb1);   // CDAB
+    hgfe = _mm_shuffle_epi32(hgfe, 0x1b);   // EFGH
+    abef = _mm_alignr_epi8(dcba, hgfe, 8);  // ABEF
+    cdgh = _mm_blend_epi16(hgfe, dcba, 0xf0);   // CDGH
+
+    while(count-- > 0) {
+        __m128i savedAbef = abef, savedCdgh = cdgh;
+
+        w0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)data), swap);
+        w1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 16)),
+                              swap);
+        w2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 32)),
+                              swap);
+        w3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 48)),
+                              swap);
+
+        SHA_ROUNDS(w0, SHA256_K);
+        SHA_ROUNDS(w1, SHA256_K + 4);
+        SHA_ROUNDS(w2, SHA256_K + 8);
+        SHA_ROUNDS(w3, SHA256_K + 12);
+        for (int i = 16; i < 64; i += 16) {
+            SHA_SCHEDULE(w0, w1, w2, w3);
+            SHA_ROUNDS(w0, SHA256_K + i);
+            SHA_SCHEDULE(w1, w2, w3, w0);
+            SHA_ROUNDS(w1, SHA256_K + i + 4);
+            SHA_SCHEDULE(w2, w3, w0, w1);
+            SHA_ROUNDS(w2, SHA256_K + i + 8);
+            SHA_SCHEDULE(w3, w0, w1, w2);
+            SHA_ROUNDS(w3, SHA256_K + i + 12);
+        } // end for (i < 64)
+
+        abef  = _mm_add_epi32(abef, savedAbef);
+        cdgh  = _mm_add_epi32(cdgh, savedCdgh);
+        data += 64;
+    } // end while(count-- > 0)
+
+    // back to ABCD and EFGH
+    abef = _mm_shuffle_epi32(abef, 0x1b);   // FEBA
+    cdgh = _mm_shuffle_epi32(cdgh, 0xb1);   // DCHG
+    _mm_storeu_si128((__m128i *)&state[0],
+                     _mm_blend_epi16(abef, cdgh, 0xf0));     // DCBA
+    _mm_storeu_si128((__m128i *)&state[4],
+                     _mm_alignr_epi8(cdgh, abef, 8));        // HGFE
+} // end sha256Ni(uint32_t[], const unsigned char*, size_t)
+#undef	SHA_SCHEDULE
+#undef	SHA_ROUNDS
+#else
+void Checksum::sha256Ni(uint32_t state[8], const unsigned char *data,
+                        size_t count) {
+    sha256(state, data, count);
+} // end sha256Ni(uint32_t[], const unsigned char*, size_t)
+#endif
+
+
+// CRC32 with the zip polynomial; long runs are folded with carry-less
+// multiplies where the processor has them, the rest eight bytes at a time
+uint32_t Checksum::crc32(uint32_t crc, const unsigned char *data,
+                         size_t len) {
+    if (HAS_PCLMUL && len >= 64) {
+        size_t folded = len & ~(size_t)15;
+
+        crc   = crc32Clmul(crc, data, folded);
+        data += folded;
+        len  -= folded;
+    } // end if (HAS_PCLMUL && ...)
+
+    return ieee.update(crc, data, len);
+} // end crc32(uint32_t, const unsigned char*, size_t)
+
+
+#ifdef CHECKSUM_X86
+// CRC32 by folding 64 bytes at a time with PCLMULQDQ, then a Barrett
+// reduction, after Intel's "Fast CRC Computation Using PCLMULQDQ"; len is
+// at least 64 and a multiple of 16
+__attribute__((target("pclmul,sse4.1")))
+uint32_t Checksum::crc32Clmul(uint32_t crc, const unsigned char *data,
+                              size_t len) {
+    const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596LL, 0x0154442bd4LL);
+    const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009eLL, 0x01751997d0LL);
+    const __m128i k5   = _mm_set_epi64x(0, 0x0163cd6124LL);
+    const __m128i poly = _mm_set_epi64x(0x01f7011641LL, 0x01db710641LL);
+    const __m128i low  = _mm_setr_epi32(~0, 0, ~0, 0);
+    __m128i x0, x1, x2, x3, x4, y1, y2, y3, y4;
+
+    x1 = _mm_loadu_si128((const __m128i *)data);
+    x2 = _mm_loadu_si128((const __m128i *)(data + 16));
+    x3 = _mm_loadu_si128((const __m128i *)(data + 32));
+    x4 = _mm_loadu_si128((const __m128i *)(data + 48));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(crc));
+    data += 64;
+    len  -= 64;
+
+    // four lanes of 128 bits each, folded forward 512 bits per round
+    while(len >= 64) {
+        y1 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+        y2 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+        y3 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+        y4 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, y1),
+                           _mm_loadu_si128((const __m128i *)data));
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, y2),
+                           _mm_loadu_si128((const __m128i *)(data + 16)));
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, y3),
+                           _mm_loadu_si128((const __m128i *)(data + 32)));
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, y4),
+                           _mm_loadu_si128((const __m128i *)(data + 48)));
+        data += 64;
+        len  -= 64;
+    } // end while(len >= 64)
+
+    // the four lanes into one
+    x0 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x0);
+    x0 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x0);
+    x0 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x0);
+
+    // then whatever 16-byte blocks are left
+    while(len >= 16) {
+        x0 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x0),
+                           _mm_loadu_si128((const __m128i *)data));
+        data += 16;
+        len  -= 16;
+    } // end while(len >= 16)
+
+    // 128 bits down to 64, then the Barrett reduction down to 32
+    x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+    x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, low);
+    x1 = _mm_clmulepi64_si128(x1, k5, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+    x2 = _mm_and_si128(x1, low);
+    x2 = _mm_clmulepi64_si128(x2, poly, 0x10);
+    x2 = _mm_and_si128(x2, low);
+    x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    return (uint32_t)_mm_extract_epi32(x1, 1);
+} // end crc32Clmul(uint32_t, const unsigned char*, size_t)
+#else
+uint32_t Checksum::crc32Clmul(uint32_t crc, const unsigned char *data,
+                              size_t len) {
+    return ieee.update(crc, data, len);
+} // end crc32Clmul(uint32_t, const unsigned char*, size_t)
+#endif
+
+
+// CRC32C, on the crc32 instruction when there is one
+uint32_t Checksum::crc32c(uint32_t crc, const unsigned char *data,
+                          size_t len) {
+    return HAS_SSE42 ? crc32cHw(crc, data, len)
+                     : castagnoli.update(crc, data, len);
+} // end crc32c(uint32_t, const unsigned char*, size_t)
+
+
+#ifdef CHECKSUM_X86
+// CRC32C with SSE4.2, eight bytes per instruction
+__attribute__((target("sse4.2")))
+uint32_t Checksum::crc32cHw(uint32_t crc, const unsigned char *data,
+                            size_t len) {
+    uint64_t c = crc;
+
+    while(len >= 8) {
+        uint64_t word;
+
+        memcpy(&word, data, 8);
+        c     = _mm_crc32_u64(c, word);
+        data += 8;
+        len  -= 8;
+    } // end while(len >= 8)
+    while(len-- > 0) {
+        c = _mm_crc32_u8((uint32_t)c, *data++);
+    } // end while(len-- > 0)
+
+    return (uint32_t)c;
+} // end crc32cHw(uint32_t, const unsigned char*, size_t)
+#else
+uint32_t Checksum::crc32cHw(uint32_t crc, const unsigned char *data,
+                            size_t len) {
+    return castagnoli.update(crc, data, len);
+} // end crc32cHw(uint32_t, const unsigned char*, size_t)
+#endif
@@ -0,0 +1,64 @@
+/*
+ * @file   Checksum.h
+ * @brief  Streaming checksums of transferred data, fed as the bytes pass
+ *          through the transfer loop so a file never has to be read twice:
+ *          CRC32 as XCRC reports it, folded with PCLMULQDQ; CRC32C on the
+ *          SSE4.2 crc32 instruction; MD5; and SHA-256 on the SHA extensions.
+ *          Each has a portable version for processors without them.
+ * @author Brendan Sweeney, ID #1161836
+ * @date   December 13, 2012
+ */
+
+#ifndef CHECKSUM_H
+#define	CHECKSUM_H
+
+#include <ctype.h>          // toupper
+#include <stddef.h>         // size_t
+#include <stdint.h>         // uint32_t, uint64_t
+#include <string.h>         // memcpy
+#include <string>
+
+using namespace std;
+
+
+class Checksum {
+public:
+    // ANY asks for the strongest one a server can compare against
+    enum kind {NONE, CRC32, CRC32C, MD5, SHA256, ANY};
+    Checksum();
+    void   reset(kind algorithm);
+    void   update(const char *data, size_t len);
+    kind   type(void) const;
+    string hex(void);
+    static string name(kind algorithm);
+    static kind   parse(const string& text);
+    static size_t digits(kind algorithm);
+private:
+    kind      algorithm;        // what update() computes
+    uint32_t  crc;              // running CRC32 or CRC32C
+    uint32_t  state[8];         // MD5 (first four) or SHA-256 state
+    unsigned char block[64];    // partial block of MD5 or SHA-256 input
+    size_t    held;             // bytes in block
+    uint64_t  total;            // bytes fed in so far
+    bool      done;             // hex() has padded the last block
+    string    result;           // digest once done
+
+    void   blocks(const unsigned char *data, size_t count);
+    void   pad(bool bigEndian);
+    static void md5(uint32_t state[4], const unsigned char *data,
+                    size_t count);
+    static void sha256(uint32_t state[8], const unsigned char *data,
+                       size_t count);
+    static void sha256Ni(uint32_t state[8], const unsigned char *data,
+                         size_t count);
+    static uint32_t crc32(uint32_t crc, const unsigned char *data,
+                          size_t len);
+    static uint32_t crc32Clmul(uint32_t crc, const unsigned char *data,
+                               size_t len);
+    static uint32_t crc32c(uint32_t crc, const unsigned char *data,
+                           size_t len);
+    static uint32_t crc32cHw(uint32_t crc, const unsigned char *data,
+                             size_t len);
+}; // end class Checksum
+
+#endif	/* CHECKSUM_H */
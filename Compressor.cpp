@@ -0,0 +1,430 @@
+/*
+ * @file   Compressor.cpp
+ * @brief  Deflate and inflate for MODE Z data connections, run on a thread
+ *          of their own so compression overlaps the network. Compressed
+ *          data passes between that thread and the transfer loop in a ring
+ *          of chunks: a download hands over what the socket delivers and
+ *          the thread inflates it into the file or listing; an upload takes
+ *          what the thread has deflated from the file.
+ * @author Brendan Sweeney, ID #1161836
+ * @date   December 13, 2012
+ */
+
+#include "Compressor.h"
+
+
+Compressor::Compressor() : head(0), tail(0), filled(0), inflating(false),
+                           running(false), waiting(false), ended(false),
+                           stopping(false), failed(false), complete(false),
+                           file(-1), at(-1), text(NULL), digest(NULL),
+                           lines(NULL), moved(0), calls(0) {
+    eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    pthread_mutex_init(&lock, NULL);
+    pthread_cond_init(&wake, NULL);
+} // end default constructor
+
+
+Compressor::~Compressor() {
+    finish();
+    close(eventFd);
+    pthread_cond_destroy(&wake);
+    pthread_mutex_destroy(&lock);
+} // end destructor
+
+
+// starts inflating a download into a file at offset at, or at its current
+// position if at is negative, or into text if it is not NULL; CRLF is
+// turned into LF as well if newlines is set
+bool Compressor::startInflate(int out, off_t offset, string *listing,
+                              Checksum *sum, Newlines *newlines) {
+    file      = out;
+    at        = offset;
+    text      = listing;
+    digest    = sum;
+    lines     = newlines;
+    inflating = true;
+    memset(&zs, 0, sizeof(zs));
+
+    return inflateInit(&zs) == Z_OK && start();
+} // end startInflate(int, off_t, string*, Checksum*, Newlines*)
+
+
+// the rest of the current chunk for the socket to fill; NULL while the
+// thread has every chunk, in which case event() is written when one frees
+char *Compressor::space(size_t& room) {
+    bool full;
+
+    pthread_mutex_lock(&lock);
+    full    = filled == CHUNKS;
+    waiting = full;
+    pthread_mutex_unlock(&lock);
+
+    if (full) {
+        return NULL;
+    } // end if (full)
+
+    room = CHUNK_LEN - ring[tail].len;
+    return &ring[tail].data[ring[tail].len];
+} // end space(size_t&)
+
+
+// takes len bytes written into space(), handing the chunk to the thread
+// once it is full; false once inflating has failed
+bool Compressor::commit(size_t len) {
+    bool ok;
+
+    ring[tail].len += len;
+    if (ring[tail].len == CHUNK_LEN) {
+        push();
+    } // end if (ring[tail].len == CHUNK_LEN)
+
+    pthread_mutex_lock(&lock);
+    ok = !failed;
+    pthread_mutex_unlock(&lock);
+
+    return ok;
+} // end commit(size_t)
+
+
+// starts deflating a file from its current position for an upload; LF is
+// turned into CRLF first if newlines is set
+bool Compressor::startDeflate(int in, Checksum *sum, Newlines *newlines) {
+    file      = in;
+    at        = -1;
+    text      = NULL;
+    digest    = sum;
+    lines     = newlines;
+    inflating = false;
+    memset(&zs, 0, sizeof(zs));
+
+    return deflateInit(&zs, LEVEL) == Z_OK && start();
+} // end startDeflate(int, Checksum*, Newlines*)
+
+
+// the deflated bytes to send next; NULL while the thread has none ready,
+// in which case event() is written when it does, unless drained()
+const char *Compressor::peek(size_t& len) {
+    bool ready;
+
+    pthread_mutex_lock(&lock);
+    ready   = filled > 0;
+    waiting = !ready && !ended;
+    pthread_mutex_unlock(&lock);
+
+    if (!ready) {
+        len = 0;
+        return NULL;
+    } // end if (!ready)
+
+    len = ring[head].len - ring[head].pos;
+    return &ring[head].data[ring[head].pos];
+} // end peek(size_t&)
+
+
+// marks len bytes from peek() as sent, handing an empty chunk back
+void Compressor::consume(size_t len) {
+    Chunk& chunk = ring[head];
+
+    chunk.pos += len;
+    if (chunk.pos < chunk.len) {
+        return;
+    } // end if (chunk.pos < chunk.len)
+
+    chunk.len = chunk.pos = 0;
+    pthread_mutex_lock(&lock);
+    head = (head + 1) % CHUNKS;
+    --filled;
+    pthread_cond_signal(&wake);
+    pthread_mutex_unlock(&lock);
+} // end consume(size_t)
+
+
+// true once an upload has been deflated and every byte taken by peek()
+bool Compressor::drained(void) {
+    bool done;
+
+    pthread_mutex_lock(&lock);
+    done = ended && filled == 0;
+    pthread_mutex_unlock(&lock);
+
+    return done;
+} // end drained()
+
+
+// readable when the thread has freed or filled a chunk that was waited on
+int Compressor::event(void) const {
+    return eventFd;
+} // end event()
+
+
+// clears event()
+void Compressor::reap(void) {
+    uint64_t count;
+
+    read(eventFd, &count, sizeof(count));
+} // end reap()
+
+
+// ends the transfer: a download hands over its last chunk and waits for it
+// to be inflated, an upload stops deflating; true if nothing failed and a
+// download got the whole stream
+bool Compressor::finish(void) {
+    if (!running) {
+        return !failed && (!inflating || complete);
+    } // end if (!running)
+
+    pthread_mutex_lock(&lock);
+    if (inflating && filled < CHUNKS && ring[tail].len > 0) {
+        tail = (tail + 1) % CHUNKS;
+        ++filled;
+    } // end if (inflating && ...)
+    ended    = true;
+    stopping = !inflating;
+    pthread_cond_signal(&wake);
+    pthread_mutex_unlock(&lock);
+
+    pthread_join(worker, NULL);
+    running = false;
+    if (inflating) {
+        inflateEnd(&zs);
+    } // end if (inflating)
+    else {
+        deflateEnd(&zs);
+    } // end else (!inflating)
+
+    return !failed && (!inflating || complete);
+} // end finish()
+
+
+// file bytes written or read so far
+long long Compressor::bytes(void) const {
+    return moved;
+} // end bytes()
+
+
+// system calls the thread made; only exact after finish()
+long Compressor::syscalls(void) const {
+    return calls;
+} // end syscalls()
+
+
+// empties the ring and starts the thread for a new transfer
+bool Compressor::start(void) {
+    head = tail = filled = 0;
+    for (int i = 0; i < CHUNKS; ++i) {
+        ring[i].data.resize(CHUNK_LEN);
+        ring[i].len = ring[i].pos = 0;
+    } // end for (i < CHUNKS)
+    // a spare byte ahead of inflated data lets lines put back a CR
+    plain.resize(FILE_LEN + 1);
+    if (lines != NULL && !inflating) {
+        wire.resize(2 * FILE_LEN);
+    } // end if (lines != NULL && ...)
+    waiting  = ended = stopping = failed = complete = false;
+    moved    = 0;
+    calls    = 0;
+    reap();
+
+    if (pthread_create(&worker, NULL, inflating ? inflater : deflater,
+                       this) != 0) {
+        inflating ? inflateEnd(&zs) : deflateEnd(&zs);
+        return false;
+    } // end if (pthread_create(...) != 0)
+
+    running = true;
+    return true;
+} // end start()
+
+
+// hands the chunk being filled to the thread
+void Compressor::push(void) {
+    pthread_mutex_lock(&lock);
+    tail = (tail + 1) % CHUNKS;
+    ++filled;
+    pthread_cond_signal(&wake);
+    pthread_mutex_unlock(&lock);
+} // end push()
+
+
+// wakes the transfer loop if it is waiting on the thread; called with lock
+// held
+void Compressor::signal(void) {
+    uint64_t one = 1;
+
+    if (waiting) {
+        waiting = false;
+        write(eventFd, &one, sizeof(one));
+    } // end if (waiting)
+} // end signal()
+
+
+// writes inflated bytes to the file or listing; runs on the thread
+bool Compressor::store(const char *data, size_t len) {
+    if (digest != NULL) {
+        digest->update(data, len);
+    } // end if (digest != NULL)
+    moved += len;
+
+    if (text != NULL) {
+        text->append(data, len);
+        return true;
+    } // end if (text != NULL)
+
+    while(len > 0) {
+        ++calls;
+        ssize_t w = at < 0 ? write(file, data, len)
+                           : pwrite(file, data, len, at);
+        if (w < 0 && errno == EINTR)
+            continue;
+        if (w <= 0)
+            return false;
+        if (at >= 0)
+            at += w;
+        data += w;
+        len  -= w;
+    } // end while(len > 0)
+
+    return true;
+} // end store(const char*, size_t)
+
+
+// inflates each chunk handed over until the last one; after a failure the
+// rest are only emptied so the transfer loop never waits on them
+void *Compressor::inflater(void *arg) {
+    Compressor *self = (Compressor *)arg;
+    char       *into = &self->plain[1];
+
+    while(true) {
+        pthread_mutex_lock(&self->lock);
+        while(self->filled == 0 && !self->ended) {
+            pthread_cond_wait(&self->wake, &self->lock);
+        } // end while(self->filled == 0 && ...)
+        if (self->filled == 0) {
+            pthread_mutex_unlock(&self->lock);
+            break;
+        } // end if (self->filled == 0)
+        pthread_mutex_unlock(&self->lock);
+
+        Chunk& chunk = self->ring[self->head];
+        bool   more  = chunk.len > 0;
+
+        self->zs.next_in  = (Bytef *)&chunk.data[0];
+        self->zs.avail_in = chunk.len;
+        // bytes after the end of the stream are ignored
+        while(more && !self->failed && !self->complete) {
+            self->zs.next_out  = (Bytef *)into;
+            self->zs.avail_out = FILE_LEN;
+
+            int    rc   = inflate(&self->zs, Z_NO_FLUSH);
+            size_t out  = FILE_LEN - self->zs.avail_out;
+            char  *data = into;
+            bool   bad  = rc != Z_OK && rc != Z_STREAM_END
+                          && rc != Z_BUF_ERROR;
+
+            if (self->lines != NULL) {
+                data = self->lines->toLocal(into, out);
+            } // end if (self->lines != NULL)
+            if (bad || (out > 0 && !self->store(data, out))) {
+                pthread_mutex_lock(&self->lock);
+                self->failed = true;
+                pthread_mutex_unlock(&self->lock);
+            } // end if (bad || ...)
+            self->complete = rc == Z_STREAM_END;
+            more = rc != Z_BUF_ERROR
+                   && (self->zs.avail_in > 0 || self->zs.avail_out == 0);
+        } // end while(more && ...)
+        chunk.len = chunk.pos = 0;
+
+        pthread_mutex_lock(&self->lock);
+        self->head = (self->head + 1) % CHUNKS;
+        --self->filled;
+        self->signal();
+        pthread_mutex_unlock(&self->lock);
+    } // end while(true)
+
+    // a CR held back at the end of the stream belongs to the file
+    if (self->lines != NULL && self->lines->held() && !self->failed
+            && !self->store("\r", 1)) {
+        self->failed = true;
+    } // end if (self->lines != NULL && ...)
+
+    return NULL;
+} // end inflater(void*)
+
+
+// reads and deflates the file into chunks until the end of the stream,
+// waiting whenever every chunk is still to be sent
+void *Compressor::deflater(void *arg) {
+    Compressor *self  = (Compressor *)arg;
+    Chunk      *chunk = NULL;
+    bool        eof   = false;
+    bool        stop  = false;
+    int         rc    = Z_OK;
+
+    self->zs.avail_in = 0;
+    while(rc != Z_STREAM_END && !stop) {
+        if (self->zs.avail_in == 0 && !eof) {
+            ++self->calls;
+            ssize_t l = read(self->file, &self->plain[0], FILE_LEN);
+            if (l < 0 && errno == EINTR)
+                continue;
+            if (l < 0) {
+                pthread_mutex_lock(&self->lock);
+                self->failed = true;
+                pthread_mutex_unlock(&self->lock);
+                break;
+            } // end if (l < 0)
+            if (self->digest != NULL) {
+                self->digest->update(&self->plain[0], l);
+            } // end if (self->digest != NULL)
+            self->moved      += l;
+            eof               = l == 0;
+            self->zs.next_in  = (Bytef *)&self->plain[0];
+            self->zs.avail_in = l;
+            if (self->lines != NULL) {
+                self->zs.next_in  = (Bytef *)&self->wire[0];
+                self->zs.avail_in = Newlines::toNetwork(&self->plain[0], l,
+                                                        &self->wire[0]);
+            } // end if (self->lines != NULL)
+        } // end if (self->zs.avail_in == 0 && !eof)
+
+        // wait for the sender to free a chunk
+        if (chunk == NULL) {
+            pthread_mutex_lock(&self->lock);
+            while(self->filled == CHUNKS && !self->stopping) {
+                pthread_cond_wait(&self->wake, &self->lock);
+            } // end while(self->filled == CHUNKS && ...)
+            stop = self->stopping;
+            pthread_mutex_unlock(&self->lock);
+            chunk = &self->ring[self->tail];
+            continue;
+        } // end if (chunk == NULL)
+
+        self->zs.next_out  = (Bytef *)&chunk->data[chunk->len];
+        self->zs.avail_out = CHUNK_LEN - chunk->len;
+        rc         = deflate(&self->zs, eof ? Z_FINISH : Z_NO_FLUSH);
+        chunk->len = CHUNK_LEN - self->zs.avail_out;
+        if (rc == Z_STREAM_ERROR) {
+            pthread_mutex_lock(&self->lock);
+            self->failed = true;
+            pthread_mutex_unlock(&self->lock);
+            break;
+        } // end if (rc == Z_STREAM_ERROR)
+
+        if (chunk->len == CHUNK_LEN || rc == Z_STREAM_END) {
+            pthread_mutex_lock(&self->lock);
+            self->tail = (self->tail + 1) % CHUNKS;
+            ++self->filled;
+            self->signal();
+            pthread_mutex_unlock(&self->lock);
+            chunk = NULL;
+        } // end if (chunk->len == CHUNK_LEN || ...)
+    } // end while(rc != Z_STREAM_END && !stop)
+
+    pthread_mutex_lock(&self->lock);
+    self->ended = true;
+    self->signal();
+    pthread_mutex_unlock(&self->lock);
+
+    return NULL;
+} // end deflater(void*)
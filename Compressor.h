@@ -0,0 +1,93 @@
+/*
+ * @file   Compressor.h
+ * @brief  Deflate and inflate for MODE Z data connections, run on a thread
+ *          of their own so compression overlaps the network. Compressed
+ *          data passes between that thread and the transfer loop in a ring
+ *          of chunks: a download hands over what the socket delivers and
+ *          the thread inflates it into the file or listing; an upload takes
+ *          what the thread has deflated from the file.
+ * @author Brendan Sweeney, ID #1161836
+ * @date   December 13, 2012
+ */
+
+#ifndef COMPRESSOR_H
+#define	COMPRESSOR_H
+
+#include <sys/eventfd.h>    // eventfd
+#include <sys/types.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>         // uint64_t
+#include <string.h>         // memset
+#include <unistd.h>         // read, write, pwrite, close
+#include <zlib.h>           // deflate, inflate
+#include <atomic>
+#include <string>
+#include <vector>
+#include "Checksum.h"
+#include "Newlines.h"
+
+using namespace std;
+
+
+class Compressor {
+public:
+    static const int    CHUNKS    = 16,         // chunks in the ring
+                        LEVEL     = 1;          // fast enough for a WAN
+    static const size_t CHUNK_LEN = 262144,     // compressed bytes per chunk
+                        FILE_LEN  = 1048576;    // file bytes per read or write
+    Compressor();
+    ~Compressor();
+    bool   startInflate(int file, off_t at, string *text, Checksum *digest,
+                        Newlines *lines);
+    char  *space(size_t& room);
+    bool   commit(size_t len);
+    bool   startDeflate(int file, Checksum *digest, Newlines *lines);
+    const char *peek(size_t& len);
+    void   consume(size_t len);
+    bool   drained(void);
+    int    event(void) const;
+    void   reap(void);
+    bool   finish(void);
+    long long bytes(void) const;
+    long   syscalls(void) const;
+private:
+    struct Chunk {
+        vector<char> data;      // CHUNK_LEN bytes of compressed data
+        size_t len;             // bytes filled
+        size_t pos;             // bytes taken out by the consumer
+    };
+    Chunk    ring[CHUNKS];      // filled at tail, taken from head
+    int      head, tail;        // next chunk to take and to fill
+    int      filled;            // chunks between them
+    bool     inflating;         // a download; otherwise an upload
+    bool     running;           // the thread was started and not joined
+    bool     waiting;           // the transfer loop wants event() written
+    bool     ended;             // no more chunks will be filled
+    bool     stopping;          // tells the thread to return
+    bool     failed;            // zlib or the file failed
+    bool     complete;          // inflate reached the end of the stream
+    int      file;              // file read or written, or -1
+    off_t    at;                // offset to write at, or -1 to append
+    string  *text;              // listing written instead of a file
+    Checksum *digest;           // fed the file bytes, if set
+    Newlines *lines;            // translates line endings for TYPE A, if set
+    atomic<long long> moved;    // file bytes read or written so far
+    long     calls;             // system calls made by the thread
+    int      eventFd;           // readable when the thread has caught up
+    vector<char> plain;         // file bytes on their way in or out
+    vector<char> wire;          // an upload's file bytes with CRLF endings
+    z_stream zs;                // deflate or inflate state
+    pthread_t       worker;     // runs inflater() or deflater()
+    pthread_mutex_t lock;       // guards the ring and the flags
+    pthread_cond_t  wake;       // signals the thread
+
+    bool start(void);
+    void push(void);
+    void signal(void);
+    bool store(const char *data, size_t len);
+    static void *inflater(void *arg);
+    static void *deflater(void *arg);
+}; // end class Compressor
+
+#endif	/* COMPRESSOR_H */
@@ -0,0 +1,266 @@
+/*
+ * @file   Connector.cpp
+ * @brief  Resolves host names to every IPv4 and IPv6 address they have, and
+ *          connects to a dual-stack host the way RFC 8305 asks: attempts
+ *          alternate between the address families and start a short delay
+ *          apart without waiting for earlier ones to fail, and the first
+ *          connection made wins. A broken path in one family then costs a
+ *          fraction of a second instead of a full connect timeout.
+ * @author Brendan Sweeney, ID #1161836
+ * @date   December 13, 2012
+ */
+
+#include "Connector.h"
+
+
+// every stream address of a host, in the resolver's order of preference,
+// each with the port set; error says why there are none
+bool Connector::resolve(const string& host, int port,
+                        vector<Endpoint>& endpoints, string& error) {
+    struct addrinfo  hints;
+    struct addrinfo *found;
+    int              rc;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    endpoints.clear();
+    if ((rc = getaddrinfo(host.c_str(), NULL, &hints, &found)) != 0) {
+        error = gai_strerror(rc);
+        return false;
+    } // end if ((rc = getaddrinfo(...)) != 0)
+
+    for (struct addrinfo *it = found; it != NULL; it = it->ai_next) {
+        Endpoint endpoint;
+
+        if ((it->ai_family != AF_INET && it->ai_family != AF_INET6)
+                || it->ai_addrlen > sizeof(endpoint.addr)) {
+            continue;
+        } // end if ((it->ai_family != AF_INET && ...) || ...)
+        memset(&endpoint, 0, sizeof(endpoint));
+        memcpy(&endpoint.addr, it->ai_addr, it->ai_addrlen);
+        endpoint.len = it->ai_addrlen;
+        setPort(endpoint, port);
+        endpoints.push_back(endpoint);
+    } // end for (it != NULL)
+    freeaddrinfo(found);
+
+    if (endpoints.empty()) {
+        error = "no IPv4 or IPv6 address";
+        return false;
+    } // end if (endpoints.empty())
+
+    return true;
+} // end resolve(const string&, int, vector<Endpoint>&, string&)
+
+
+// connects to whichever address answers first: a new attempt starts every
+// ATTEMPT_DELAY ms, or as soon as one fails, while earlier ones carry on;
+// returns a blocking socket, or -1 with error set
+int Connector::connect(const vector<Endpoint>& endpoints, string& error) {
+    vector<Endpoint>      order(endpoints);
+    vector<struct pollfd> pending;
+    size_t                next     = 0;
+    long long             deadline = now() + TIMEOUT;
+    long long             attempt  = now();
+    int                   winner   = -1;
+
+    interleave(order);
+    error = "no address to connect to";
+
+    while(winner < 0 && (next < order.size() || !pending.empty())
+            && now() < deadline) {
+        // start the next attempt when its turn comes
+        if (next < order.size() && now() >= attempt) {
+            const Endpoint& endpoint = order[next++];
+            int sd = socket(family(endpoint), SOCK_STREAM, 0);
+
+            attempt = now() + ATTEMPT_DELAY;
+            if (sd < 0) {
+                error = strerror(errno);
+                continue;
+            } // end if (sd < 0)
+            fcntl(sd, F_SETFL, fcntl(sd, F_GETFL) | O_NONBLOCK);
+
+            if (::connect(sd, (sockaddr *)&endpoint.addr, endpoint.len)
+                    == 0) {
+                winner = sd;
+                break;
+            } // end if (::connect(...) == 0)
+            if (errno != EINPROGRESS) {
+                error = strerror(errno);
+                close(sd);
+                attempt = now();
+                continue;
+            } // end if (errno != EINPROGRESS)
+
+            struct pollfd waiting = {sd, POLLOUT, 0};
+            pending.push_back(waiting);
+        } // end if (next < order.size() && ...)
+
+        long long until = next < order.size() && attempt < deadline
+                          ? attempt : deadline;
+        int       wait  = until > now() ? (int)(until - now()) : 0;
+
+        if (poll(pending.empty() ? NULL : &pending[0], pending.size(),
+                 wait) <= 0) {
+            continue;
+        } // end if (poll(...) <= 0)
+
+        for (size_t i = 0; i < pending.size(); ) {
+            int       failure = 0;
+            socklen_t len     = sizeof(failure);
+
+            if (pending[i].revents == 0) {
+                ++i;
+                continue;
+            } // end if (pending[i].revents == 0)
+            getsockopt(pending[i].fd, SOL_SOCKET, SO_ERROR, &failure, &len);
+            if (failure == 0 && winner < 0) {
+                winner = pending[i].fd;
+            } // end if (failure == 0 && winner < 0)
+            else {
+                error = strerror(failure);
+                close(pending[i].fd);
+                // a refusal needs no delay before the next address
+                attempt = now();
+            } // end else
+            pending.erase(pending.begin() + i);
+        } // end for (i < pending.size())
+    } // end while(winner < 0 && ...)
+
+    // the attempts that lost are abandoned
+    for (size_t i = 0; i < pending.size(); ++i) {
+        close(pending[i].fd);
+    } // end for (i < pending.size())
+
+    if (winner >= 0) {
+        fcntl(winner, F_SETFL, fcntl(winner, F_GETFL) & ~O_NONBLOCK);
+    } // end if (winner >= 0)
+    else if (now() >= deadline) {
+        error = "connection timed out";
+    } // end else if (now() >= deadline)
+
+    return winner;
+} // end connect(const vector<Endpoint>&, string&)
+
+
+// the address a connected socket is connected to
+bool Connector::peer(int sd, Endpoint& endpoint) {
+    memset(&endpoint, 0, sizeof(endpoint));
+    endpoint.len = sizeof(endpoint.addr);
+    if (getpeername(sd, (sockaddr *)&endpoint.addr, &endpoint.len) < 0) {
+        endpoint.len = 0;
+        return false;
+    } // end if (getpeername(...) < 0)
+
+    return true;
+} // end peer(int, Endpoint&)
+
+
+// sets the port of an address in either family
+void Connector::setPort(Endpoint& endpoint, int port) {
+    if (family(endpoint) == AF_INET6) {
+        ((struct sockaddr_in6 *)&endpoint.addr)->sin6_port = htons(port);
+    } // end if (family(endpoint) == AF_INET6)
+    else {
+        ((struct sockaddr_in *)&endpoint.addr)->sin_port = htons(port);
+    } // end else
+} // end setPort(Endpoint&, int)
+
+
+// AF_INET or AF_INET6
+int Connector::family(const Endpoint& endpoint) {
+    return endpoint.addr.ss_family;
+} // end family(const Endpoint&)
+
+
+// the address in numeric form, with brackets around IPv6, and its port
+string Connector::format(const Endpoint& endpoint) {
+    char text[INET6_ADDRSTRLEN + 8];
+    int  port;
+
+    if (family(endpoint) == AF_INET6) {
+        const struct sockaddr_in6 *in6 =
+                (const struct sockaddr_in6 *)&endpoint.addr;
+
+        text[0] = '[';
+        inet_ntop(AF_INET6, &in6->sin6_addr, text + 1, INET6_ADDRSTRLEN);
+        strcat(text, "]");
+        port = ntohs(in6->sin6_port);
+    } // end if (family(endpoint) == AF_INET6)
+    else {
+        const struct sockaddr_in *in =
+                (const struct sockaddr_in *)&endpoint.addr;
+
+        inet_ntop(AF_INET, &in->sin_addr, text, INET6_ADDRSTRLEN);
+        port = ntohs(in->sin_port);
+    } // end else
+
+    ostringstream formatted;
+
+    formatted << text << ":" << port;
+    return formatted.str();
+} // end format(const Endpoint&)
+
+
+// takes a server given as host, host:port or [v6]:port apart; port is left
+// as it was if none is given
+void Connector::split(const string& server, string& host, string& port) {
+    size_t colon = server.rfind(':');
+
+    if (server.length() > 1 && server.at(0) == '[') {
+        size_t close = server.find(']');
+
+        host = server.substr(1, close == string::npos ? string::npos
+                                                      : close - 1);
+        if (close != string::npos && close + 1 < server.length()
+                && server.at(close + 1) == ':') {
+            port = server.substr(close + 2);
+        } // end if (close != npos && ...)
+    } // end if (server.length() > 1 && ...)
+    else if (colon != string::npos && server.find(':') == colon) {
+        host = server.substr(0, colon);
+        port = server.substr(colon + 1);
+    } // end else if (colon != npos && ...)
+    else {
+        host = server;      // a bare IPv6 address has more than one colon
+    } // end else
+} // end split(const string&, string&, string&)
+
+
+// reorders addresses to alternate between families, starting with the
+// family the resolver preferred, as RFC 8305 section 4 describes
+void Connector::interleave(vector<Endpoint>& endpoints) {
+    vector<Endpoint> first, second, mixed;
+
+    for (size_t i = 0; i < endpoints.size(); ++i) {
+        if (family(endpoints[i]) == family(endpoints[0])) {
+            first.push_back(endpoints[i]);
+        } // end if (family(endpoints[i]) == ...)
+        else {
+            second.push_back(endpoints[i]);
+        } // end else
+    } // end for (i < endpoints.size())
+
+    for (size_t i = 0; i < first.size() || i < second.size(); ++i) {
+        if (i < first.size()) {
+            mixed.push_back(first[i]);
+        } // end if (i < first.size())
+        if (i < second.size()) {
+            mixed.push_back(second[i]);
+        } // end if (i < second.size())
+    } // end for (i < first.size() || ...)
+
+    endpoints.swap(mixed);
+} // end interleave(vector<Endpoint>&)
+
+
+// a monotonic clock in milliseconds
+long long Connector::now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+} // end now()
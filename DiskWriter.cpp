@@ -0,0 +1,516 @@
+/*
+ * @file   DiskWriter.cpp
+ * @brief  Takes file writes off the receiving thread. Downloaded data is
+ *          gathered in a ring of page-aligned buffers, and each full buffer
+ *          is written at its own offset by io_uring, or by a writer thread
+ *          where io_uring is not available, while the socket keeps being
+ *          read. Files of known size are preallocated, and huge ones are
+ *          written with O_DIRECT.
+ * @author Brendan Sweeney, ID #1161836
+ * @date   December 13, 2012
+ */
+
+#include "DiskWriter.h"
+
+
+DiskWriter::DiskWriter() : filling(0), inFlight(0), ready(false),
+                           running(false), failed(false), error(0), file(-1),
+                           append(false), direct(false), flags(0), next(0),
+                           eventFd(-1), calls(0), ringFd(-1), sqRing(NULL),
+                           cqRing(NULL), sqRingLen(0), cqRingLen(0),
+                           sqEntries(0), sqes(NULL), threaded(false),
+                           stopping(false) {
+    for (int i = 0; i < SLOTS; ++i) {
+        slots[i].data = NULL;
+        slots[i].len  = slots[i].done = 0;
+        slots[i].at   = 0;
+        slots[i].busy = false;
+    } // end for (i < SLOTS)
+    pthread_mutex_init(&lock, NULL);
+    pthread_cond_init(&wake, NULL);
+    pthread_cond_init(&wrote, NULL);
+} // end default constructor
+
+
+// waits out any writes, then stops the back end and frees the ring
+DiskWriter::~DiskWriter() {
+    if (running) {
+        finish();
+    } // end if (running)
+    if (threaded) {
+        pthread_mutex_lock(&lock);
+        stopping = true;
+        pthread_cond_signal(&wake);
+        pthread_mutex_unlock(&lock);
+        pthread_join(writer, NULL);
+    } // end if (threaded)
+    closeRing();
+    if (eventFd >= 0) {
+        close(eventFd);
+    } // end if (eventFd >= 0)
+    for (int i = 0; i < SLOTS; ++i) {
+        free(slots[i].data);
+    } // end for (i < SLOTS)
+
+    pthread_cond_destroy(&wrote);
+    pthread_cond_destroy(&wake);
+    pthread_mutex_destroy(&lock);
+} // end destructor
+
+
+// begins writing a regular file at offset at, or at its current position
+// when at is negative; false if the file cannot be written this way
+bool DiskWriter::start(int out, off_t at) {
+    struct stat info;
+
+    if ((!ready && !setup()) || fstat(out, &info) < 0
+            || !S_ISREG(info.st_mode)) {
+        return false;
+    } // end if ((!ready && ...) || ...)
+
+    append = at < 0;
+    if (append && (at = lseek(out, 0, SEEK_CUR)) < 0) {
+        return false;
+    } // end if (append && ...)
+
+    file    = out;
+    flags   = fcntl(file, F_GETFL);
+    next    = at;
+    direct  = false;
+    failed  = false;
+    error   = 0;
+    filling = 0;
+    running = true;
+
+    return true;
+} // end start(int, off_t)
+
+
+// preallocates the file up to offset end, once its size is known; a huge
+// file that starts on a block boundary bypasses the page cache from here
+void DiskWriter::reserve(long long end) {
+    if (!running || end <= next) {
+        return;
+    } // end if (!running || ...)
+
+    ++calls;
+    fallocate(file, FALLOC_FL_KEEP_SIZE, next, end - next);
+
+    // every buffer written from here on starts on slot boundary
+    off_t from = slots[filling].len > 0 ? slots[filling].at : next;
+
+    if (end - from >= DIRECT_MIN && from % (off_t)ALIGN == 0) {
+        ++calls;
+        direct = fcntl(file, F_SETFL, flags | O_DIRECT) == 0;
+    } // end if (end - from >= DIRECT_MIN && ...)
+} // end reserve(long long)
+
+
+// free room in the buffer being filled, or NULL while every buffer is
+// waiting on the disk
+char *DiskWriter::space(size_t& room) {
+    Slot& s = slots[filling];
+
+    if (s.busy) {
+        return NULL;
+    } // end if (s.busy)
+    if (s.len == 0) {
+        s.at = next;
+    } // end if (s.len == 0)
+
+    room = SLOT_LEN - s.len;
+    return s.data + s.len;
+} // end space(size_t&)
+
+
+// takes len bytes put into space(); a full buffer goes to the disk and the
+// next one in the ring is filled; false once a write has failed
+bool DiskWriter::commit(size_t len) {
+    Slot& s = slots[filling];
+
+    s.len += len;
+    next  += len;
+    if (s.len == SLOT_LEN) {
+        ++inFlight;
+        submit(filling);
+        filling = (filling + 1) % SLOTS;
+    } // end if (s.len == SLOT_LEN)
+
+    errno = error;
+    return !failed;
+} // end commit(size_t)
+
+
+// becomes readable when writes have completed; call reap() then
+int DiskWriter::event(void) const {
+    return eventFd;
+} // end event()
+
+
+// frees the buffers of completed writes; false once a write has failed
+bool DiskWriter::reap(void) {
+    uint64_t count;
+
+    ++calls;
+    read(eventFd, &count, sizeof(count));
+
+    if (ringFd >= 0) {
+        unsigned head = *cqHead;
+
+        while(head != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+            struct io_uring_cqe *cqe = &cqes[head & *cqMask];
+            int   slot = (int)cqe->user_data;
+            int   res  = cqe->res;
+
+            __atomic_store_n(cqHead, ++head, __ATOMIC_RELEASE);
+            complete(slot, res);
+        } // end while(head != ...)
+    } // end if (ringFd >= 0)
+    else {
+        vector<pair<int, ssize_t> > done;
+
+        pthread_mutex_lock(&lock);
+        done.swap(written);
+        pthread_mutex_unlock(&lock);
+
+        for (size_t i = 0; i < done.size(); ++i) {
+            complete(done[i].first, done[i].second);
+        } // end for (i < done.size())
+    } // end else (ringFd < 0)
+
+    errno = error;
+    return !failed;
+} // end reap()
+
+
+// writes what is left in the ring, waits for every write and puts the file
+// back as start() found it; false if any write failed
+bool DiskWriter::finish(void) {
+    if (!running) {
+        errno = error;
+        return !failed;
+    } // end if (!running)
+
+    // the tail is rarely a whole block, so it goes through the page cache
+    if (slots[filling].len > 0 && !slots[filling].busy) {
+        if (direct) {
+            ++calls;
+            fcntl(file, F_SETFL, flags);
+            direct = false;
+        } // end if (direct)
+        ++inFlight;
+        submit(filling);
+        filling = (filling + 1) % SLOTS;
+    } // end if (slots[filling].len > 0 && ...)
+
+    while(inFlight > 0 && wait()) {
+    } // end while(inFlight > 0 && wait())
+
+    if (direct) {
+        ++calls;
+        fcntl(file, F_SETFL, flags);
+        direct = false;
+    } // end if (direct)
+    if (append) {
+        ++calls;
+        lseek(file, next, SEEK_SET);
+    } // end if (append)
+    running = false;
+
+    errno = error;
+    return !failed;
+} // end finish()
+
+
+// true if writes go through io_uring rather than the writer thread
+bool DiskWriter::uring(void) const {
+    return ringFd >= 0;
+} // end uring()
+
+
+// system calls made by the calling thread since construction
+long DiskWriter::syscalls(void) const {
+    return calls;
+} // end syscalls()
+
+
+// allocates the ring and picks a back end, on first use only
+bool DiskWriter::setup(void) {
+    for (int i = 0; i < SLOTS; ++i) {
+        void *data;
+
+        if (posix_memalign(&data, ALIGN, SLOT_LEN) != 0) {
+            return false;
+        } // end if (posix_memalign(...) != 0)
+        slots[i].data = (char *)data;
+    } // end for (i < SLOTS)
+
+    if ((eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+        return false;
+    } // end if ((eventFd = ...) < 0)
+
+    if (!setupRing()) {
+        if (pthread_create(&writer, NULL, drain, this) != 0) {
+            return false;
+        } // end if (pthread_create(...) != 0)
+        threaded = true;
+    } // end if (!setupRing())
+
+    ready = true;
+    return true;
+} // end setup()
+
+
+// maps an io_uring with room for the whole ring and has it signal eventFd;
+// false if the kernel has none or will not let us use it
+bool DiskWriter::setupRing(void) {
+    struct io_uring_params params;
+
+    memset(&params, 0, sizeof(params));
+    if ((ringFd = syscall(__NR_io_uring_setup, SLOTS, &params)) < 0) {
+        ringFd = -1;
+        return false;
+    } // end if ((ringFd = ...) < 0)
+
+    sqRingLen = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingLen = params.cq_off.cqes
+                + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        sqRingLen = cqRingLen = sqRingLen > cqRingLen ? sqRingLen : cqRingLen;
+    } // end if (params.features & ...)
+
+    sqRing = (char *)mmap(NULL, sqRingLen, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, ringFd,
+                          IORING_OFF_SQ_RING);
+    if (sqRing == MAP_FAILED) {
+        sqRing = NULL;
+        closeRing();
+        return false;
+    } // end if (sqRing == MAP_FAILED)
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        cqRing = sqRing;
+    } // end if (params.features & ...)
+    else {
+        cqRing = (char *)mmap(NULL, cqRingLen, PROT_READ | PROT_WRITE,
+                              MAP_SHARED | MAP_POPULATE, ringFd,
+                              IORING_OFF_CQ_RING);
+        if (cqRing == MAP_FAILED) {
+            cqRing = NULL;
+            closeRing();
+            return false;
+        } // end if (cqRing == MAP_FAILED)
+    } // end else (separate rings)
+
+    sqEntries = params.sq_entries;
+    sqes = (struct io_uring_sqe *)mmap(NULL, sqEntries
+                                             * sizeof(struct io_uring_sqe),
+                                       PROT_READ | PROT_WRITE,
+                                       MAP_SHARED | MAP_POPULATE, ringFd,
+                                       IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        sqes = NULL;
+        closeRing();
+        return false;
+    } // end if (sqes == MAP_FAILED)
+
+    sqHead  = (unsigned *)(sqRing + params.sq_off.head);
+    sqTail  = (unsigned *)(sqRing + params.sq_off.tail);
+    sqMask  = (unsigned *)(sqRing + params.sq_off.ring_mask);
+    sqArray = (unsigned *)(sqRing + params.sq_off.array);
+    cqHead  = (unsigned *)(cqRing + params.cq_off.head);
+    cqTail  = (unsigned *)(cqRing + params.cq_off.tail);
+    cqMask  = (unsigned *)(cqRing + params.cq_off.ring_mask);
+    cqes    = (struct io_uring_cqe *)(cqRing + params.cq_off.cqes);
+
+    if (syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_EVENTFD,
+                &eventFd, 1) < 0) {
+        closeRing();
+        return false;
+    } // end if (syscall(...) < 0)
+
+    return true;
+} // end setupRing()
+
+
+// unmaps and closes the io_uring, if there is one
+void DiskWriter::closeRing(void) {
+    if (sqes != NULL) {
+        munmap(sqes, sqEntries * sizeof(struct io_uring_sqe));
+        sqes = NULL;
+    } // end if (sqes != NULL)
+    if (cqRing != NULL && cqRing != sqRing) {
+        munmap(cqRing, cqRingLen);
+    } // end if (cqRing != NULL && ...)
+    cqRing = NULL;
+    if (sqRing != NULL) {
+        munmap(sqRing, sqRingLen);
+        sqRing = NULL;
+    } // end if (sqRing != NULL)
+    if (ringFd >= 0) {
+        close(ringFd);
+        ringFd = -1;
+    } // end if (ringFd >= 0)
+} // end closeRing()
+
+
+// hands the unwritten part of a slot to the back end
+bool DiskWriter::submit(int slot) {
+    Slot& s = slots[slot];
+
+    s.busy = true;
+    if (ringFd < 0) {
+        pthread_mutex_lock(&lock);
+        queue.push_back(slot);
+        pthread_cond_signal(&wake);
+        pthread_mutex_unlock(&lock);
+        return true;
+    } // end if (ringFd < 0)
+
+    // at most SLOTS writes are out at once, so the queue always has room
+    unsigned             tail  = *sqTail;
+    unsigned             index = tail & *sqMask;
+    struct io_uring_sqe *sqe   = &sqes[index];
+    int                  res;
+
+    // WRITEV rather than WRITE keeps kernels from 5.1 on working
+    s.vec.iov_base = s.data + s.done;
+    s.vec.iov_len  = s.len - s.done;
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode    = IORING_OP_WRITEV;
+    sqe->fd        = file;
+    sqe->addr      = (uint64_t)&s.vec;
+    sqe->len       = 1;
+    sqe->off       = s.at + s.done;
+    sqe->user_data = slot;
+    sqArray[index] = index;
+    __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+
+    // a kernel short of memory says EAGAIN; that is tried a few times, but
+    // not for ever
+    int tries = 0;
+
+    do {
+        ++calls;
+        res = syscall(__NR_io_uring_enter, ringFd, 1, 0, 0, NULL, 0);
+    } while(res < 0 && (errno == EINTR
+                        || (errno == EAGAIN && ++tries < RETRIES)));
+
+    if (res < 0) {
+        // the entry was never taken, so the slot is given back as failed
+        // here; complete() would only submit it again
+        __atomic_store_n(sqTail, tail, __ATOMIC_RELEASE);
+        failed = true;
+        error  = errno;
+        s.busy = false;
+        s.len  = s.done = 0;
+        --inFlight;
+        return false;
+    } // end if (res < 0)
+
+    return true;
+} // end submit(int)
+
+
+// blocks until at least one write completes, then reaps; false once a
+// write has failed
+bool DiskWriter::wait(void) {
+    if (ringFd >= 0) {
+        if (*cqHead == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+            int res;
+
+            do {
+                ++calls;
+                res = syscall(__NR_io_uring_enter, ringFd, 0, 1,
+                              IORING_ENTER_GETEVENTS, NULL, 0);
+            } while(res < 0 && errno == EINTR);
+        } // end if (*cqHead == ...)
+    } // end if (ringFd >= 0)
+    else {
+        pthread_mutex_lock(&lock);
+        while(written.empty()) {
+            pthread_cond_wait(&wrote, &lock);
+        } // end while(written.empty())
+        pthread_mutex_unlock(&lock);
+    } // end else (ringFd < 0)
+
+    return reap();
+} // end wait()
+
+
+// settles one write: a short one goes out again for the rest, and O_DIRECT
+// is given up if the file system refuses it
+void DiskWriter::complete(int slot, ssize_t res) {
+    Slot& s = slots[slot];
+
+    if (res == -EINVAL && direct) {
+        ++calls;
+        fcntl(file, F_SETFL, flags);
+        direct = false;
+        submit(slot);
+        return;
+    } // end if (res == -EINVAL && direct)
+    if (res == -EAGAIN || res == -EINTR) {
+        submit(slot);
+        return;
+    } // end if (res == -EAGAIN || ...)
+
+    if (res <= 0) {
+        failed = true;
+        error  = res < 0 ? -res : ENOSPC;
+    } // end if (res <= 0)
+    else if ((s.done += res) < s.len) {
+        submit(slot);
+        return;
+    } // end else if ((s.done += res) < s.len)
+
+    s.busy = false;
+    s.len  = s.done = 0;
+    --inFlight;
+} // end complete(int, ssize_t)
+
+
+// writer thread: writes queued slots in order and reports each one
+void *DiskWriter::drain(void *arg) {
+    DiskWriter *self = (DiskWriter *)arg;
+
+    pthread_mutex_lock(&self->lock);
+    while(!self->stopping || !self->queue.empty()) {
+        if (self->queue.empty()) {
+            pthread_cond_wait(&self->wake, &self->lock);
+            continue;
+        } // end if (self->queue.empty())
+
+        int   slot = self->queue.front();
+        Slot& s    = self->slots[slot];
+        int   out  = self->file;
+
+        self->queue.pop_front();
+        pthread_mutex_unlock(&self->lock);
+
+        ssize_t total = 0;
+
+        while(s.done + total < s.len) {
+            ssize_t w = pwrite(out, s.data + s.done + total,
+                               s.len - s.done - total, s.at + s.done + total);
+            if (w < 0 && errno == EINTR)
+                continue;
+            if (w <= 0) {
+                if (total == 0)
+                    total = w < 0 ? -errno : 0;
+                break;
+            } // end if (w <= 0)
+            total += w;
+        } // end while(s.done + total < s.len)
+
+        uint64_t one = 1;
+
+        pthread_mutex_lock(&self->lock);
+        self->written.push_back(make_pair(slot, total));
+        pthread_cond_signal(&self->wrote);
+        write(self->eventFd, &one, sizeof(one));
+    } // end while(!self->stopping || ...)
+    pthread_mutex_unlock(&self->lock);
+
+    return NULL;
+} // end drain(void*)
@@ -0,0 +1,105 @@
+/*
+ * @file   DiskWriter.h
+ * @brief  Takes file writes off the receiving thread. Downloaded data is
+ *          gathered in a ring of page-aligned buffers, and each full buffer
+ *          is written at its own offset by io_uring, or by a writer thread
+ *          where io_uring is not available, while the socket keeps being
+ *          read. Files of known size are preallocated, and huge ones are
+ *          written with O_DIRECT.
+ * @author Brendan Sweeney, ID #1161836
+ * @date   December 13, 2012
+ */
+
+#ifndef DISKWRITER_H
+#define	DISKWRITER_H
+
+#include <linux/io_uring.h> // io_uring_params, io_uring_sqe, io_uring_cqe
+#include <sys/eventfd.h>    // eventfd
+#include <sys/mman.h>       // mmap, munmap
+#include <sys/stat.h>       // fstat
+#include <sys/syscall.h>    // __NR_io_uring_setup, __NR_io_uring_enter
+#include <sys/types.h>
+#include <sys/uio.h>        // iovec
+#include <errno.h>
+#include <fcntl.h>          // fcntl, fallocate, O_DIRECT
+#include <pthread.h>
+#include <stdint.h>         // uint64_t
+#include <stdlib.h>         // posix_memalign, free
+#include <string.h>         // memset
+#include <unistd.h>         // pwrite, lseek, read, write, close, syscall
+#include <deque>
+#include <vector>
+
+using namespace std;
+
+
+class DiskWriter {
+public:
+    static const int    SLOTS      = 8,             // buffers in the ring
+                        RETRIES    = 16;            // io_uring_enter EAGAINs
+    static const size_t SLOT_LEN   = 1048576,       // bytes per buffer
+                        ALIGN      = 4096;          // O_DIRECT alignment
+    static const long long DIRECT_MIN = 1LL << 30;  // O_DIRECT from here
+    DiskWriter();
+    ~DiskWriter();
+    bool   start(int file, off_t at);
+    void   reserve(long long end);
+    char  *space(size_t& room);
+    bool   commit(size_t len);
+    int    event(void) const;
+    bool   reap(void);
+    bool   finish(void);
+    bool   uring(void) const;
+    long   syscalls(void) const;
+private:
+    struct Slot {
+        char  *data;            // page-aligned buffer of SLOT_LEN bytes
+        size_t len;             // bytes filled
+        size_t done;            // bytes written so far
+        off_t  at;              // file offset of data[0]
+        bool   busy;            // handed to the kernel or the writer thread
+        struct iovec vec;       // what io_uring is writing from it
+    };
+    Slot     slots[SLOTS];      // the ring; filled and written in order
+    int      filling;           // slot taking socket data now
+    int      inFlight;          // slots not yet written back
+    bool     ready;             // buffers and a back end are set up
+    bool     running;           // start() was called and finish() was not
+    bool     failed;            // a write failed; errno is in error
+    int      error;             // errno of the failed write
+    int      file;              // file being written
+    bool     append;            // file position follows the data
+    bool     direct;            // O_DIRECT is on for file
+    int      flags;             // file status flags before start()
+    off_t    next;              // file offset of the next byte taken
+    int      eventFd;           // readable when writes have completed
+    long     calls;             // system calls made by the caller's thread
+    // io_uring, when the kernel has it
+    int       ringFd;           // from io_uring_setup, or -1
+    char     *sqRing, *cqRing;  // mapped submission and completion rings
+    size_t    sqRingLen, cqRingLen;
+    unsigned  sqEntries;        // submission entries mapped
+    struct io_uring_sqe *sqes;  // mapped submission entries
+    unsigned *sqHead, *sqTail, *sqMask, *sqArray;
+    unsigned *cqHead, *cqTail, *cqMask;
+    struct io_uring_cqe *cqes;
+    // writer thread, when it does not
+    pthread_t       writer;     // runs drain()
+    pthread_mutex_t lock;       // guards queue, written and stopping
+    pthread_cond_t  wake;       // signals the writer thread
+    pthread_cond_t  wrote;      // signals a finished write
+    deque<int>      queue;      // slots waiting for the writer thread
+    vector<pair<int, ssize_t> > written;    // slot and pwrite() outcome
+    bool            threaded;   // the writer thread was started
+    bool            stopping;   // tells drain() to return
+
+    bool setup(void);
+    bool setupRing(void);
+    void closeRing(void);
+    bool submit(int slot);
+    bool wait(void);
+    void complete(int slot, ssize_t res);
+    static void *drain(void *arg);
+}; // end class DiskWriter
+
+#endif	/* DISKWRITER_H */
@@ -0,0 +1,199 @@
+/*
+ * @file   FanOut.cpp
+ * @brief  Uploads one local file to several servers at once, with a control
+ *          session and a thread per server. The file is read once, into a
+ *          Broadcast that every data connection sends from, and each server
+ *          is reported on by itself, so one failing or slow mirror does not
+ *          hide how the others did.
+ * @author Brendan Sweeney, ID #1161836
+ * @date   December 13, 2012
+ */
+
+#include "FanOut.h"
+
+
+FanOut::FanOut(string username, string password, SessionCache *cache,
+               RateLimiter *limiter) :
+        username(username), password(password), cache(cache),
+        limiter(limiter), verify(Checksum::NONE) {
+    pthread_mutex_init(&lock, NULL);
+} // end constructor
+
+
+// logs every session out of its server, or parks it in the session cache
+FanOut::~FanOut() {
+    for (size_t i = 0; i < targets.size(); ++i) {
+        if (targets[i]->ready) {
+            targets[i]->backend.ftpClose();
+        } // end if (targets[i]->ready)
+        delete targets[i];
+    } // end for (i < targets.size())
+
+    pthread_mutex_destroy(&lock);
+} // end destructor
+
+
+// checks each upload against a checksum from its server
+void FanOut::setVerify(Checksum::kind algorithm) {
+    verify = algorithm;
+} // end setVerify(Checksum::kind)
+
+
+// opens a session to each server, given as host, host:port or [v6]:port;
+// returns how many logged in; the rest are reported as failed by put()
+int FanOut::open(const vector<string>& servers) {
+    int ready = 0;
+
+    // sessions are set up one at a time, before any thread is running
+    for (size_t i = 0; i < servers.size()
+                       && (int)targets.size() < MAX_TARGETS; ++i) {
+        Target *target = new Target();
+
+        target->owner = this;
+        target->port  = "21";
+        target->ready = false;
+        Connector::split(servers[i], target->host, target->port);
+
+        target->backend.setSessionCache(cache);
+        target->backend.setRateLimiter(limiter);
+        target->backend.setVerify(verify);
+        target->ready = login(*target);
+        if (target->ready) {
+            ++ready;
+        } // end if (target->ready)
+        else {
+            cout << servers[i] << ": could not log in" << endl;
+        } // end else (!target->ready)
+        targets.push_back(target);
+    } // end for (i < servers.size() && ...)
+    if (servers.size() > targets.size()) {
+        cerr << "Only the first " << MAX_TARGETS << " servers are used."
+             << endl;
+    } // end if (servers.size() > targets.size())
+
+    return ready;
+} // end open(const vector<string>&)
+
+
+// sends a local file to every server that logged in, reading it from disk
+// once, then prints each server's throughput and a summary; returns how
+// many servers did not get the file
+int FanOut::put(string local, string name) {
+    long  time;
+    Timer tick;
+    int   sent = 0;
+
+    if (targets.empty()) {
+        cerr << "No servers given." << endl;
+        return 0;
+    } // end if (targets.empty())
+    if (!source.open(local, targets.size())) {
+        perror(local.c_str());
+        return targets.size();
+    } // end if (!source.open(...))
+
+    remote = name;
+    tick.start();
+    for (size_t i = 0; i < targets.size(); ++i) {
+        targets[i]->reader = i;
+        if (targets[i]->ready) {
+            pthread_create(&targets[i]->thread, NULL, send, targets[i]);
+        } // end if (targets[i]->ready)
+        else {
+            source.leave(i);    // so it does not hold the window
+        } // end else (!targets[i]->ready)
+    } // end for (i < targets.size())
+
+    for (size_t i = 0; i < targets.size(); ++i) {
+        if (targets[i]->ready) {
+            pthread_join(targets[i]->thread, NULL);
+            if (targets[i]->result.code / 100 == FtpBackend::POS_COMPL
+                    && targets[i]->result.verified >= 0) {
+                ++sent;
+            } // end if (targets[i]->result.code / 100 == POS_COMPL...)
+        } // end if (targets[i]->ready)
+    } // end for (i < targets.size())
+    time = tick.lap();
+
+    cout << local << " sent to " << sent << " of " << targets.size()
+         << " servers in " << (double)time / 1000000.0 << " seconds; "
+         << source.bytesRead() << " of " << source.size()
+         << " bytes read from disk" << endl;
+    source.close();
+
+    return targets.size() - sent;
+} // end put(string, string)
+
+
+// runs the open, user and pass sequence on a new session, or takes over
+// one parked by an earlier close
+bool FanOut::login(Target& target) {
+    FtpBackend& backend = target.backend;
+
+    if (backend.ftpResume(target.host, target.port, username)) {
+        return true;
+    } // end if (backend.ftpResume(...))
+
+    try {
+        string reply(backend.ftpOpen(target.host, target.port));
+
+        if (atoi(&reply.at(0)) / 100 != FtpBackend::POS_COMPL) {
+            cout << reply;
+            return false;
+        } // end if (atoi(...) != POS_COMPL)
+
+        // user and password go out as one pipelined batch
+        if (!backend.ftpLogin(username, password, "")) {
+            backend.ftpQuit();
+            return false;
+        } // end if (!backend.ftpLogin(...))
+    } catch (exception& e) {
+        cerr << e.what() << endl;
+        return false;
+    } // end try atoi()
+
+    return true;
+} // end login(Target&)
+
+
+// thread body: uploads the file over one session and reports on it
+void *FanOut::send(void *arg) {
+    Target *self  = (Target *)arg;
+    FanOut *owner = self->owner;
+
+    self->reply  = self->backend.ftpPut(owner->source, self->reader,
+                                        owner->remote);
+    self->result = self->backend.lastTransfer();
+
+    const TransferResult& result = self->result;
+    bool ok = result.code / 100 == FtpBackend::POS_COMPL
+              && result.verified >= 0;
+
+    pthread_mutex_lock(&owner->lock);
+    cout << self->host << ":" << self->port << ": ";
+    if (ok) {
+        cout << result.bytes << " bytes in "
+             << (double)result.usec / 1000000.0 << " seconds ("
+             << 1000.0 * (double)result.bytes / result.usec
+             << " Kbytes/s)" << endl;
+    } // end if (ok)
+    else if (result.preliminary.empty()) {
+        // the upload never started, and the last line of the replies says
+        // why, such as a data port that refused the connection
+        size_t end  = self->reply.find_last_not_of("\r\n");
+        size_t line = end == string::npos ? 0
+                                          : self->reply.rfind('\n', end);
+
+        cout << (line == string::npos ? self->reply
+                                      : self->reply.substr(line + 1));
+    } // end else if (result.preliminary.empty())
+    else {
+        // a verification failure is told after the final reply
+        cout << (result.reply.empty()
+                 || result.code / 100 == FtpBackend::POS_COMPL
+                 ? self->reply : result.reply);
+    } // end else (!ok)
+    pthread_mutex_unlock(&owner->lock);
+
+    return NULL;
+} // end send(void*)
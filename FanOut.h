@@ -0,0 +1,61 @@
+/*
+ * @file   FanOut.h
+ * @brief  Uploads one local file to several servers at once, with a control
+ *          session and a thread per server. The file is read once, into a
+ *          Broadcast that every data connection sends from, and each server
+ *          is reported on by itself, so one failing or slow mirror does not
+ *          hide how the others did.
+ * @author Brendan Sweeney, ID #1161836
+ * @date   December 13, 2012
+ */
+
+#ifndef FANOUT_H
+#define	FANOUT_H
+
+#include <pthread.h>
+#include <stdio.h>          // perror
+#include <stdlib.h>         // atoi
+#include <iostream>
+#include <string>
+#include <vector>
+#include "Broadcast.h"
+#include "FtpBackend.h"
+#include "Timer.h"
+
+using namespace std;
+
+
+class FanOut {
+public:
+    static const int MAX_TARGETS = 32;
+    FanOut(string username, string password, SessionCache *cache = NULL,
+           RateLimiter *limiter = NULL);
+    ~FanOut();
+    void setVerify(Checksum::kind algorithm);
+    int  open(const vector<string>& servers);
+    int  put(string local, string remote);
+private:
+    struct Target {
+        FanOut        *owner;       // fan-out the target belongs to
+        string         host, port;  // where the server is
+        FtpBackend     backend;     // this server's control session
+        bool           ready;       // logged in
+        int            reader;      // place in source
+        string         reply;       // what the upload said
+        TransferResult result;      // how the upload went
+        pthread_t      thread;      // runs send() for this target
+    };
+    string username, password;
+    SessionCache    *cache;         // lends and takes back sessions, if set
+    RateLimiter     *limiter;       // shares a rate among sessions, if set
+    Checksum::kind   verify;        // checksum uploads are checked with
+    vector<Target *> targets;       // one per server, logged in or not
+    Broadcast        source;        // the file, read once for all of them
+    string           remote;        // name to store it under
+    pthread_mutex_t  lock;          // guards cout
+
+    bool login(Target& target);
+    static void *send(void *arg);
+}; // end class FanOut
+
+#endif	/* FANOUT_H */
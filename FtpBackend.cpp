@@ -11,336 +11,1700 @@
 #include "FtpBackend.h"
 
 
-FtpBackend::FtpBackend() : host(NULL) {
+FtpBackend::FtpBackend() : zeroCopy(true), diskWriter(true), pipelining(true),
+                           batchMode(PROBING), passiveMode(UNTRIED),
+                           cache(NULL),
+                           verify(Checksum::NONE), featured(false),
+                           compress(true), deflating(false), refusedZ(false),
+                           ascii(false), typeCode(0),
+                           engine(tuner, parser, metrics) {
 } // end default constructor
 
 
-// converts strings to host address and numeric port
-string FtpBackend::ftpOpen(string hostname, string port) {
-    char serverIp[hostname.length() + 1];
+// switches downloads between splice() and read()/write(); returns new state
+bool FtpBackend::toggleZeroCopy(void) {
+    zeroCopy = !zeroCopy;
+    return zeroCopy;
+} // end toggleZeroCopy()
+
+
+// switches downloads between the asynchronous disk writer and writing each
+// buffer as it arrives; returns new state
+bool FtpBackend::toggleDiskWriter(void) {
+    diskWriter = !diskWriter;
+    engine.setDiskWriter(diskWriter);
+    return diskWriter;
+} // end toggleDiskWriter()
+
+
+// turns command pipelining on or off; returns new state
+bool FtpBackend::togglePipelining(void) {
+    pipelining = !pipelining;
+    return pipelining;
+} // end togglePipelining()
+
+
+// lets ftpClose() park this session in a cache, and resolves names there
+void FtpBackend::setSessionCache(SessionCache *sessions) {
+    cache = sessions;
+} // end setSessionCache(SessionCache*)
+
+
+// fixes the transfer buffer size; 0 lets the tuner pick it again
+void FtpBackend::setBufferSize(size_t bytes) {
+    tuner.pin(bytes);
+} // end setBufferSize(size_t)
 
-    // store arguments in local variables
-    try {
-        hostname.copy(serverIp, hostname.length(), 0);
-        serverIp[hostname.length()] = '\0';
-    } catch (exception& e) {
-        cerr << e.what() << endl;
-    } // end try hostname.copy()
-    
-    return ftpOpen(serverIp, atoi(port.c_str()), clientSd);
-} // end ftpOpen(string, string)
 
+// paces transfers with a limiter shared with other sessions; NULL for none
+void FtpBackend::setRateLimiter(RateLimiter *limiter) {
+    engine.setRateLimiter(limiter);
+} // end setRateLimiter(RateLimiter*)
 
-// establishes TCP connection to a host on a given port and socket descriptor
-string FtpBackend::ftpOpen(char *hostname, int port, int& sd) {
-    host    = gethostbyname(hostname);
-    portNum = port;
 
+// checks later gets and puts against a checksum from the server: one
+// algorithm, ANY for the strongest the server offers, or NONE
+void FtpBackend::setVerify(Checksum::kind algorithm) {
+    verify = algorithm;
+} // end setVerify(Checksum::kind)
+
+
+// compresses later transfers with MODE Z on servers that offer it
+void FtpBackend::setCompression(bool on) {
+    compress = on;
+} // end setCompression(bool)
+
+
+// moves later gets and puts in TYPE A, translating line endings, or in
+// TYPE I, byte for byte, which is the default
+void FtpBackend::setAscii(bool on) {
+    ascii = on;
+} // end setAscii(bool)
+
+
+// resolves a host to all of its addresses and connects to whichever one
+// answers first
+string FtpBackend::ftpOpen(string hostname, string port) {
+    vector<Endpoint> endpoints;
+    string           error;
+    
+    portNum = atoi(port.c_str());
     // ensure valid port
     if (portNum < 1024 || portNum > 65535) {
         portNum = DEF_PORT_NUM;
-    } // end if (portNum < 1024...)
+    } // end if (portNum < 1024 || ...)
+    
+    server   = hostname;
+    service  = port;
+    account  = "";
+    featured = false;
+    hashing  = "";
+    deflating = refusedZ = false;
+    passiveMode = UNTRIED;
+    typeCode = 0;
+    cwd      = "";
+    listings.clear();
+    
+    // the cache remembers the answer for the sessions that follow; a
+    // failure is returned rather than fatal, as one of several servers in
+    // a fan-out may be down while the rest are not
+    if (!(cache ? cache->resolve(hostname, portNum, endpoints, error)
+                : Connector::resolve(hostname, portNum, endpoints, error))) {
+        clientSd = -1;
+        return "unknown hostname: " + hostname + ": " + error + "\n";
+    } // end if (!(cache ? ... : ...))
+    
+    // only continue if socket connection could be established
+    if ((clientSd = Connector::connect(endpoints, error)) < 0) {
+        return "connect failure: " + hostname + ": " + error + "\n";
+    } // end if ((clientSd = Connector::connect(...)) < 0)
+    
+    TransferTuner::tuneControl(clientSd);
+    parser.clear();
+    batchMode = PROBING;    // a new server has yet to prove it can pipeline
+    return reply();
+} // end ftpOpen(string, string)
 
-    // only continue if host name could be resolved
-    if (!host)
-    {
-        cerr << "unknown hostname: " << hostname << endl;
-        exit(EXIT_FAILURE);
-    } // end if (!host)
-
-    // build address data structure
-    memset((char *)&sendSockAddr, '\0', sizeof(sendSockAddr));
-    sendSockAddr.sin_family = AF_INET;
-    sendSockAddr.sin_addr.s_addr =
-        inet_addr(inet_ntoa(*(struct in_addr *) *host->h_addr_list));
-    sendSockAddr.sin_port = htons(portNum);
-
-    // active open, ensure success before continuing
-    if ((sd = socket(AF_INET, SOCK_STREAM, 0)) < 0)
-    {
-        cerr << "socket failure" << endl;
-        exit(EXIT_FAILURE);
-    } // end if ((clientSd = socket(...)))
+
+// takes over a session parked by an earlier close, if one is still alive
+// for this host, port and user; true if no open or login is needed
+bool FtpBackend::ftpResume(string hostname, string port, string username) {
+    int sd;
+    
+    if (!cache || !cache->checkout(hostname, port, username, sd)) {
+        return false;
+    } // end if (!cache || ...)
+    
+    clientSd  = sd;
+    server    = hostname;
+    service   = port;
+    account   = username;
+    featured  = false;
+    hashing   = "";
+    deflating = refusedZ = false;   // parked in stream mode by ftpClose()
+    passiveMode = UNTRIED;
+    typeCode  = 0;                  // but in whatever type it was left
+    cwd       = "";
+    listings.clear();
+    parser.clear();
+    batchMode = PROBING;
+    return true;
+} // end ftpResume(string, string, string)
+
+
+// opens a data connection to the address a passive reply gave; the kernel
+// buffers are sized for the expected transfer first; sd is -1 and the
+// reply says why if there is no connection
+string FtpBackend::ftpOpen(const Endpoint& address, int& sd) {
+    sd = -1;
+    if (address.len == 0) {
+        return "data connection: the server gave no address\n";
+    } // end if (address.len == 0)
+    if ((sd = socket(Connector::family(address), SOCK_STREAM, 0)) < 0) {
+        return string("socket failure: ") + strerror(errno) + "\n";
+    } // end if ((sd = socket(...)) < 0)
+
+    // window scaling is fixed by the handshake, so size buffers first
+    tuner.prepare(sd);
 
     // only continue if socket connection could be established
-    if (connect(sd,
-                (sockaddr *)&sendSockAddr,
-                sizeof(sendSockAddr)) < 0)
+    long long started = TransferMetrics::now();
+
+    if (connect(sd, (sockaddr *)&address.addr, address.len) < 0)
     {
-        cerr << "connect failure" << endl;
+        string error(strerror(errno));
+        
         close(sd);
-        exit(EXIT_FAILURE);
+        sd = -1;
+        return "connect failure: " + Connector::format(address) + ": "
+               + error + "\n";
     } // end if (connect(...) < 0)
 
-    return reply(clientSd);
-} // end ftpOpen(char*, int)
+    // the data connection has no greeting; its replies come on clientSd
+    metrics.connected(TransferMetrics::now() - started);
+    return "";
+} // end ftpOpen(const Endpoint&, int&)
 
 
 // sends a user name to the server for authentication
 string FtpBackend::ftpUser(string username) {
-    char sendCmd[username.length() + 7];
-    
-    strcpy(sendCmd, "USER ");
-    strcat(sendCmd, username.c_str());
-    strcat(sendCmd, "\r\n");
-    write(clientSd, sendCmd, sizeof(sendCmd));
+    string temp = command("USER", username);
     
-    return reply(clientSd);
+    // some servers need no password for some users
+    if (latest.code / 100 == POS_COMPL) {
+        account = username;
+    } // end if (latest.code / 100 == POS_COMPL)
+    pending = username;
+    return temp;
 } // end ftpUser(string)
 
 
 // sends a password to the server for authentication
 string FtpBackend::ftpPass(string password) {
-    char sendCmd[password.length() + 7];
-    
-    strcpy(sendCmd, "PASS ");
-    strcat(sendCmd, password.c_str());
-    strcat(sendCmd, "\r\n");
-    write(clientSd, sendCmd, sizeof(sendCmd));
+    vector<string>   commands;
+    vector<FtpReply> replies;
     
     // return host system information
-    string temp = reply(clientSd);
-    temp.append(reply(clientSd));
-    write(clientSd, "SYST\r\n", 6);
-    temp.append(reply(clientSd));
+    commands.push_back("PASS " + password);
+    commands.push_back("SYST");
+    string temp = pipeline(commands, replies);
     
+    // leave the PASS reply as the one callers check for success
+    latest = replies.front();
+    if (latest.code / 100 == POS_COMPL) {
+        account = pending;
+    } // end if (latest.code / 100 == POS_COMPL)
     return temp;
 } // end ftpPass(string)
 
 
-// changes working directory on the server
+// logs in and enters a directory in one pipelined batch; returns true if
+// the server accepted the credentials and, if given, the directory
+bool FtpBackend::ftpLogin(string username, string password,
+                          string directory) {
+    vector<string>   commands;
+    vector<FtpReply> replies;
+    
+    commands.push_back("USER " + username);
+    commands.push_back("PASS " + password);
+    if (!directory.empty()) {
+        commands.push_back("CWD " + directory);
+    } // end if (!directory.empty())
+    pipeline(commands, replies);
+    cwd = "";
+    
+    // a server may log in on USER alone and then reject the unneeded PASS
+    bool authed = replies[0].code / 100 == POS_COMPL
+                  || (replies[0].code / 100 == POS_INTER
+                      && replies[1].code / 100 == POS_COMPL);
+    
+    if (authed) {
+        account = username;
+    } // end if (authed)
+    
+    return authed && (directory.empty()
+                      || replies[2].code / 100 == POS_COMPL);
+} // end ftpLogin(string, string, string)
+
+
+// changes working directory on the server; the directory entered is listed
+// afresh the next time its listing is wanted
 string FtpBackend::ftpCd(string subdir) {
-    char sendCmd[subdir.length() + 6];
+    vector<string>   commands;
+    vector<FtpReply> replies;
     
-    strcpy(sendCmd, "CWD ");
-    strcat(sendCmd, subdir.c_str());
-    strcat(sendCmd, "\r\n");
-    write(clientSd, sendCmd, sizeof(sendCmd));
+    // PWD rides along so the listing cache knows where it is
+    commands.push_back("CWD " + subdir);
+    commands.push_back("PWD");
+    pipeline(commands, replies);
     
-    return reply(clientSd);
+    // leave the CWD reply as the one callers check for success
+    latest = replies.front();
+    if (latest.code / 100 == POS_COMPL) {
+        cwd = replies[1].code == 257 ? quoted(replies[1].text) : "";
+        listings.invalidate(cwd);
+    } // end if (latest.code / 100 == POS_COMPL)
+    
+    return latest.text;
 } // end ftpCd()
 
 
+// prints the server's working directory; the text is the session's reply
+// buffer, good until the next command
+const string& FtpBackend::ftpPwd(void) {
+    return command("PWD");
+} // end ftpPwd()
+
+
+// lists the names in the current directory, one entry per element
+string FtpBackend::ftpNlst(vector<string>& names) {
+    Endpoint address;
+    int    dataSd;
+    string listing;
+    
+    string message(modeZ(true));
+    
+    metrics.begin("NLST", "", -1);
+    message.append(pasv(address));
+    // open data connection
+    message.append(ftpOpen(address, dataSd));
+    if (dataSd < 0) {
+        last = TransferResult();
+        return message;
+    } // end if (dataSd < 0)
+    
+    sendCommand("NLST");
+    last = engine.receive(clientSd, dataSd, listing);
+    settled(last);
+    close(dataSd);
+    
+    // one name per line, each ending in CRLF
+    istringstream lines(listing);
+    string        name;
+    
+    while(getline(lines, name)) {
+        if (!name.empty() && name.at(name.length() - 1) == '\r') {
+            name.erase(name.length() - 1);
+        } // end if (!name.empty() && ...)
+        if (!name.empty()) {
+            names.push_back(name);
+        } // end if (!name.empty())
+    } // end while(getline(lines, name))
+    
+    message.append(last.preliminary);
+    message.append(last.reply);
+    return message;
+} // end ftpNlst(vector<string>&)
+
+
 // lists current directory contents from the server
 string FtpBackend::ftpLs(void) {
-    char   address[15];
-    int    port;
+    Endpoint address;
     int    dataSd;
-    int    pid;
-    string message(pasv(address, port));
-    // open data connection
-    message.append(ftpOpen(address, port, dataSd));
+    string listing;
     
-    // only continue if child successfully forked
-    if ((pid = fork()) < 0)
-    {
-        cerr << "ftpLs(): fork failed" << endl;
-    } // end if ((pid = fork()) < 0)
-    else if (pid > 0)
-    {
-        // This is the parent; wait for the child
-        cout << message;
-        write(clientSd, "LIST\r\n", 6);
-        wait(NULL); // wait for child
-    } // end else if (pid > 0)
-    else
-    {
-        cout << reply(clientSd);
-        do {    // avoid incomplete listing
-            message = reply(dataSd);
-            cout << message;
-        } while(message.at(message.length() - 1) != '\n');
-        exit(0);
-    } // end else (pid == 0)
+    string message(modeZ(true));
     
+    metrics.begin("LIST", "", -1);
+    message.append(pasv(address));
+    // open data connection
+    message.append(ftpOpen(address, dataSd));
+    if (dataSd < 0) {
+        last = TransferResult();
+        return message;
+    } // end if (dataSd < 0)
+    
+    sendCommand("LIST");
+    last = engine.receive(clientSd, dataSd, listing);
+    settled(last);
     close(dataSd);
-    return reply(clientSd);
+    
+    message.append(last.preliminary);
+    message.append(listing);
+    message.append(last.reply);
+    return message;
 } // end ftpLs()
 
 
-// download a file from the server and store it locally
-string FtpBackend::ftpGet(string filename, string newname) {
-    char   address[15];
-    int    port;
+// the parsed listing of a directory, relative to the working directory or
+// empty for the working directory itself; a cached listing is used unless
+// refresh is set, otherwise it is read with MLSD, or LIST on a server
+// without it; entries is NULL if the directory could not be listed, and
+// stays valid until the directory is listed again or invalidated
+string FtpBackend::ftpMlsd(string directory,
+                           const ListingCache::Listing *&entries,
+                           bool refresh) {
+    string key(absolute(directory));
+    
+    // without a working directory, cache under the name given
+    if (key.empty()) {
+        key = directory;
+    } // end if (key.empty())
+    
+    entries = listings.find(key);
+    if (entries != NULL && !refresh) {
+        return "";
+    } // end if (entries != NULL && !refresh)
+    
+    Endpoint address;
     int    dataSd;
-    int    pid;
-    string message(pasv(address, port));
+    string text;
+    bool   mlsd = offers("MLST") || offers("MLSD");
+    const char *verb = mlsd ? "MLSD" : "LIST";
+    string message(modeZ(true));
+    
+    metrics.begin(verb, key, -1);
+    message.append(pasv(address));
     // open data connection
-    message.append(ftpOpen(address, port, dataSd));
+    message.append(ftpOpen(address, dataSd));
+    if (dataSd < 0) {
+        last    = TransferResult();
+        entries = NULL;
+        return message;
+    } // end if (dataSd < 0)
     
-    // only continue if child successfully forked
-    if ((pid = fork()) < 0)
-    {
-        cerr << "ftpLs(): fork failed" << endl;
-    } // end if ((pid = fork()) < 0)
-    else if (pid > 0)
-    {
-        // This is the parent; wait for the child
-        char sendCmd[filename.length() + 8];
-
-        cout << message;
-        strcpy(sendCmd, "RETR ");
-        strcat(sendCmd, filename.c_str());
-        strcat(sendCmd, "\r\n");
-        write(clientSd, sendCmd, sizeof(sendCmd));
-        wait(NULL); // wait for child
-    } // end else if (pid > 0)
-    else
-    {
-        long   time;
-        Timer  tick;
-        int    count = 0;
-        mode_t mode  = S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH;
-        int    file  = open(newname.c_str(), O_WRONLY | O_CREAT, mode);
-        char   buffer[255];
+    sendCommand(verb, key);
+    last = engine.receive(clientSd, dataSd, text);
+    settled(last);
+    close(dataSd);
+    
+    message.append(last.preliminary);
+    message.append(last.reply);
+    entries = NULL;
+    if (last.code / 100 == POS_COMPL) {
+        ListingCache::Listing parsed;
         
-        tick.start();
-        cout << (reply(clientSd));
+        if (mlsd) {
+            ListingCache::parseMlsd(text, parsed);
+        } // end if (mlsd)
+        else {
+            ListingCache::parseList(text, parsed);
+        } // end else (!mlsd)
+        entries = &listings.store(key, parsed);
+    } // end if (last.code / 100 == POS_COMPL)
+    else {
+        listings.invalidate(key);
+    } // end else (last.code / 100 != POS_COMPL)
+    
+    return message;
+} // end ftpMlsd(string, const ListingCache::Listing*&, bool)
+
+
+// looks up one remote file or directory: in the cached listing of its
+// directory if there is one, else with MLST, else by listing the directory;
+// false if it does not exist or cannot be found out
+bool FtpBackend::ftpStat(string path, RemoteEntry& entry) {
+    string full(absolute(path));
+    string directory(full.empty() ? "" : ListingCache::parent(full));
+    string name(ListingCache::base(full.empty() ? path : full));
+    
+    // a cached directory answers for its entries, present or not
+    if (!full.empty() && listings.find(directory) != NULL) {
+        const RemoteEntry *found = listings.find(directory, name);
         
-        while(true) {
-            int l = read(dataSd, buffer, sizeof(buffer));
-            if (l == 0)
-                break;
-            count += l;
-            write(file, buffer, l);
-        } // end while(true)
+        if (found != NULL) {
+            entry = *found;
+        } // end if (found != NULL)
+        return found != NULL;
+    } // end if (!full.empty() && ...)
+    
+    if (offers("MLST")) {
+        istringstream lines(command("MLST", full.empty() ? path : full));
+        string        line;
         
+        while(latest.code / 100 == POS_COMPL && getline(lines, line)) {
+            // the facts are on the one line that starts with a space
+            if (line.compare(0, 1, " ") == 0
+                    && ListingCache::parseFacts(line.substr(1), entry)) {
+                entry.name = ListingCache::base(entry.name);
+                return true;
+            } // end if (line.compare(0, 1, " ") == 0 && ...)
+        } // end while(latest.code / 100 == POS_COMPL && ...)
+        return false;
+    } // end if (offers("MLST"))
+    
+    // nothing can be cached without knowing where the directory is
+    if (full.empty()) {
+        return false;
+    } // end if (full.empty())
+    
+    const ListingCache::Listing *entries;
+    const RemoteEntry           *found;
+    
+    ftpMlsd(directory, entries);
+    found = listings.find(directory, name);
+    if (found != NULL) {
+        entry = *found;
+    } // end if (found != NULL)
+    
+    return found != NULL;
+} // end ftpStat(string, RemoteEntry&)
+
+
+// asks the server for the checksum of a file without moving it, in the
+// algorithm verification is set to, or the strongest the server computes;
+// hex is empty and algorithm NONE if it computes none
+string FtpBackend::ftpChecksum(string filename, Checksum::kind& algorithm,
+                               string& hex) {
+    Checksum::kind wanted = verify;
+    string         how;
+    
+    // a sidecar could be stale, so only the server's own word counts
+    verify    = verify == Checksum::NONE ? Checksum::ANY : verify;
+    algorithm = plan(true, how);
+    verify    = wanted;
+    hex       = "";
+    if (algorithm == Checksum::NONE) {
+        return "";
+    } // end if (algorithm == Checksum::NONE)
+    
+    return remoteSum(filename, how, algorithm, hex);
+} // end ftpChecksum(string, Checksum::kind&, string&)
+
+
+// deletes a remote file
+string FtpBackend::ftpDelete(string filename) {
+    string message(command("DELE", filename));
+    
+    changed(filename);
+    return message;
+} // end ftpDelete(string)
+
+
+// creates a remote directory
+string FtpBackend::ftpMkdir(string directory) {
+    string message(command("MKD", directory));
+    
+    changed(directory);
+    return message;
+} // end ftpMkdir(string)
+
+
+// removes an empty remote directory
+string FtpBackend::ftpRmdir(string directory) {
+    string message(command("RMD", directory));
+    
+    changed(directory);
+    invalidate(directory);
+    return message;
+} // end ftpRmdir(string)
+
+
+// the absolute path of the working directory, asked of the server with PWD
+// only when it is not already known; empty if the server will not say
+string FtpBackend::workingDirectory(void) {
+    if (cwd.empty() && command("PWD").compare(0, 3, "257") == 0) {
+        cwd = quoted(latest.text);
+    } // end if (cwd.empty() && ...)
+    
+    return cwd;
+} // end workingDirectory()
+
+
+// forgets the cached listing of a directory changed behind this session's
+// back, such as by other sessions of a batch
+void FtpBackend::invalidate(string directory) {
+    if (!listings.empty()) {
+        listings.invalidate(absolute(directory));
+    } // end if (!listings.empty())
+} // end invalidate(string)
+
+
+// download a file from the server and store it locally
+string FtpBackend::ftpGet(string filename, string newname) {
+    Endpoint address;
+    int    dataSd;
+    mode_t mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH;
+    int    file = open(newname.c_str(), O_WRONLY | O_CREAT | O_TRUNC, mode);
+    
+    if (file < 0) {
+        last = TransferResult();
+        return "local: " + newname + ": " + strerror(errno) + "\n";
+    } // end if (file < 0)
+    
+    // decide how to verify before the control connection is busy
+    string how;
+    
+    sum.reset(verify == Checksum::NONE ? Checksum::NONE : plan(false, how));
+    engine.setChecksum(sum.type() == Checksum::NONE ? NULL : &sum);
+    
+    string message(type(true));
+    
+    message.append(modeZ(true));
+    metrics.begin("RETR", filename, -1);
+    message.append(pasv(address));
+    // open data connection
+    message.append(ftpOpen(address, dataSd));
+    if (dataSd < 0) {
+        engine.setChecksum(NULL);
         close(file);
-        time = tick.lap();
-        cout << count << " bytes received in " << (double)time / 1000000.0
-             << " seconds (" << 1000.0 * (double)count / time
-             << " Kbytes/s)" << endl;
-        exit(0);
-    } // end else (pid == 0)
+        last = TransferResult();
+        return message;
+    } // end if (dataSd < 0)
     
+    sendCommand("RETR", filename);
+    last = engine.receive(clientSd, dataSd, file, zeroCopy);
+    settled(last);
+    engine.setChecksum(NULL);
+    close(file);
     close(dataSd);
-    return reply(clientSd);
+    
+    message.append(last.preliminary);
+    message.append(report(last, "received"));
+    message.append(last.reply);
+    if (sum.type() != Checksum::NONE && last.code / 100 == POS_COMPL) {
+        message.append(check(filename, how));
+    } // end if (sum.type() != NONE && ...)
+    else if (verify != Checksum::NONE && sum.type() == Checksum::NONE) {
+        message.append("Not verified: the server offers no "
+                       + (verify == Checksum::ANY
+                          ? string("") : Checksum::name(verify) + " ")
+                       + "checksum.\n");
+    } // end else if (verify != NONE && ...)
+    return message;
 } // end ftpGet()
 
 
 // upload a local file to the server
 string FtpBackend::ftpPut(string filename, string newname) {
-    char   address[15];
-    int    port;
+    Endpoint address;
     int    dataSd;
-    int    pid;
-    string message(pasv(address, port));
+    int    file = open(filename.c_str(), O_RDONLY);
+    struct stat info;
+    
+    if (file < 0) {
+        last = TransferResult();
+        return "local: " + filename + ": " + strerror(errno) + "\n";
+    } // end if (file < 0)
+    
+    // decide how to verify before the control connection is busy
+    string how;
+    
+    sum.reset(verify == Checksum::NONE ? Checksum::NONE : plan(true, how));
+    engine.setChecksum(sum.type() == Checksum::NONE ? NULL : &sum);
+    
+    string message(type(true));
+    
+    message.append(modeZ(true));
+    metrics.begin("STOR", newname,
+                  fstat(file, &info) == 0 ? (long long)info.st_size : -1);
+    message.append(pasv(address));
     // open data connection
-    message.append(ftpOpen(address, port, dataSd));
+    message.append(ftpOpen(address, dataSd));
+    if (dataSd < 0) {
+        engine.setChecksum(NULL);
+        close(file);
+        last = TransferResult();
+        return message;
+    } // end if (dataSd < 0)
     
-    // only continue if child successfully forked
-    if ((pid = fork()) < 0)
-    {
-        cerr << "ftpLs(): fork failed" << endl;
-    } // end if ((pid = fork()) < 0)
-    else if (pid > 0)
-    {
-        // This is the parent; wait for the child
-        char sendCmd[newname.length() + 8];
-
-        cout << message;
-        strcpy(sendCmd, "STOR ");
-        strcat(sendCmd, newname.c_str());
-        strcat(sendCmd, "\r\n");
-        write(clientSd, sendCmd, sizeof(sendCmd));
-        wait(NULL); // wait for child
-    } // end else if (pid > 0)
-    else
-    {
-        long  time;
-        Timer tick;
-        int   count = 0;
-        int   file = open(filename.c_str(), O_RDONLY);
-        char  buffer[255];
-        
-        tick.start();
-        cout << (reply(clientSd));
+    sendCommand("STOR", newname);
+    last = engine.send(clientSd, dataSd, file);
+    settled(last);
+    engine.setChecksum(NULL);
+    close(file);
+    close(dataSd);
+    changed(newname);
+    
+    message.append(last.preliminary);
+    message.append(report(last, "sent"));
+    message.append(last.reply);
+    if (sum.type() != Checksum::NONE && last.code / 100 == POS_COMPL) {
+        message.append(check(newname, how));
+    } // end if (sum.type() != NONE && ...)
+    else if (verify != Checksum::NONE && sum.type() == Checksum::NONE) {
+        message.append("Not verified: the server offers no "
+                       + (verify == Checksum::ANY
+                          ? string("") : Checksum::name(verify) + " ")
+                       + "checksum.\n");
+    } // end else if (verify != NONE && ...)
+    return message;
+} // end ftpPut()
+
+
+// upload a file that is being sent to other servers at the same time,
+// from the chunks source has read; reader is this session's place in it
+string FtpBackend::ftpPut(Broadcast& source, int reader, string newname) {
+    Endpoint address;
+    int    dataSd;
+    
+    // decide how to verify before the control connection is busy
+    string how;
+    
+    sum.reset(verify == Checksum::NONE ? Checksum::NONE : plan(true, how));
+    engine.setChecksum(sum.type() == Checksum::NONE ? NULL : &sum);
+    
+    // the chunks are sent as they were read, so byte for byte, uncompressed
+    string message(type(false));
+    
+    message.append(modeZ(false));
+    metrics.begin("STOR", newname, source.size());
+    message.append(pasv(address));
+    // open data connection
+    message.append(ftpOpen(address, dataSd));
+    if (dataSd < 0) {
+        engine.setChecksum(NULL);
+        source.leave(reader);
+        last = TransferResult();
+        return message;
+    } // end if (dataSd < 0)
+    
+    sendCommand("STOR", newname);
+    last = engine.send(clientSd, dataSd, source, reader);
+    settled(last);
+    engine.setChecksum(NULL);
+    close(dataSd);
+    changed(newname);
+    
+    message.append(last.preliminary);
+    message.append(report(last, "sent"));
+    message.append(last.reply);
+    if (sum.type() != Checksum::NONE && last.code / 100 == POS_COMPL) {
+        message.append(check(newname, how));
+    } // end if (sum.type() != NONE && ...)
+    return message;
+} // end ftpPut(Broadcast&, int, string)
+
+
+// resumes a download, fetching only the bytes past the end of the local copy
+string FtpBackend::ftpReget(string filename, string newname) {
+    Endpoint    address;
+    int         dataSd;
+    long long   remote;
+    struct stat info;
+    mode_t      mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH;
+    int         file = open(newname.c_str(), O_WRONLY | O_CREAT, mode);
+    
+    last = TransferResult();
+    if (file < 0 || fstat(file, &info) < 0) {
+        string error(strerror(errno));
         
-        while(true) {
-            int l = read(file, buffer, sizeof(buffer));
-            if (l == 0)
-                break;
-            count += l;
-            write(dataSd, buffer, l);
-        } // end while(true)
+        if (file >= 0) {
+            close(file);
+        } // end if (file >= 0)
+        return "local: " + newname + ": " + error + "\n";
+    } // end if (file < 0 || ...)
+    
+    string message(ftpSize(filename, remote));
+    
+    if (remote >= 0 && info.st_size >= remote) {
+        close(file);
+        // a longer local file cannot be a prefix of the remote one
+        if (info.st_size > remote) {
+            return message + "local: " + newname
+                   + ": larger than remote file, use get\n";
+        } // end if (info.st_size > remote)
+        last.code = POS_COMPL * 100;    // nothing left to move
+        return message + "local: " + newname + ": already complete\n";
+    } // end if (remote >= 0 && ...)
+    
+    vector<string>   commands;
+    vector<FtpReply> replies;
+    ostringstream    rest;
+    
+    rest << "REST " << info.st_size;
+    commands.push_back(rest.str());
+    message.append(type(false));
+    message.append(modeZ(true));
+    metrics.begin("RETR", filename,
+                  remote >= 0 ? remote - info.st_size : -1);
+    message.append(passive(commands, replies, address));
+    
+    // open data connection
+    message.append(ftpOpen(address, dataSd));
+    if (dataSd < 0) {
+        close(file);
+        return message;
+    } // end if (dataSd < 0)
+    
+    // a server that cannot restart gets the whole file again
+    if (replies[1].code / 100 != POS_INTER) {
+        info.st_size = 0;
+        ftruncate(file, 0);
+    } // end if (replies[1].code / 100 != POS_INTER)
+    
+    sendCommand("RETR", filename);
+    last = engine.receive(clientSd, dataSd, file, info.st_size, -1, zeroCopy);
+    settled(last);
+    close(file);
+    close(dataSd);
+    
+    message.append(last.preliminary);
+    message.append(report(last, "received"));
+    message.append(last.reply);
+    return message;
+} // end ftpReget(string, string)
+
+
+// resumes an upload, sending only the bytes past the end of the remote copy
+string FtpBackend::ftpReput(string filename, string newname) {
+    Endpoint    address;
+    int         dataSd;
+    long long   remote;
+    struct stat info;
+    int         file = open(filename.c_str(), O_RDONLY);
+    
+    last = TransferResult();
+    if (file < 0 || fstat(file, &info) < 0) {
+        string error(strerror(errno));
         
+        if (file >= 0) {
+            close(file);
+        } // end if (file >= 0)
+        return "local: " + filename + ": " + error + "\n";
+    } // end if (file < 0 || ...)
+    
+    // a missing remote file simply resumes from the start
+    string message(ftpSize(newname, remote));
+    
+    if (remote < 0) {
+        remote = 0;
+    } // end if (remote < 0)
+    if (remote >= info.st_size) {
         close(file);
-        time = tick.lap();
-        cout << count << " bytes sent in " << (double)time / 1000000.0
-             << " seconds (" << 1000.0 * (double)count / time 
-             << " Kbytes/s)" << endl;
-        exit(0);
-    } // end else (pid == 0)
+        last.code = POS_COMPL * 100;    // nothing left to move
+        return message + "remote: " + newname + ": already complete\n";
+    } // end if (remote >= info.st_size)
     
+    message.append(type(false));
+    message.append(modeZ(true));
+    metrics.begin("STOR", newname, info.st_size - remote);
+    message.append(pasv(address));
+    // open data connection
+    message.append(ftpOpen(address, dataSd));
+    if (dataSd < 0) {
+        close(file);
+        return message;
+    } // end if (dataSd < 0)
+    
+    string temp(remote > 0 ? restart(remote) : "");
+    message.append(temp);
+    
+    // without REST, append to the partial remote file instead
+    const char *verb = remote == 0 || temp.compare(0, 1, "3") == 0
+                       ? "STOR" : "APPE";
+    lseek(file, remote, SEEK_SET);
+    sendCommand(verb, newname);
+    last = engine.send(clientSd, dataSd, file);
+    settled(last);
+    close(file);
     close(dataSd);
-    return reply(clientSd);
-} // end ftpPut()
+    changed(newname);
+    
+    message.append(last.preliminary);
+    message.append(report(last, "sent"));
+    message.append(last.reply);
+    return message;
+} // end ftpReput(string, string)
+
+
+// asks the server for the size of a file in bytes; size is -1 if unknown
+string FtpBackend::ftpSize(string filename, long long& size) {
+    vector<string>   commands;
+    vector<FtpReply> replies;
+    
+    // sizes are only meaningful in image type
+    if (typeCode != 'I') {
+        commands.push_back("TYPE I");
+    } // end if (typeCode != 'I')
+    commands.push_back("SIZE " + filename);
+    string message(pipeline(commands, replies));
+    
+    if (commands.size() > 1 && replies[0].code / 100 == POS_COMPL) {
+        typeCode = 'I';
+    } // end if (commands.size() > 1 && ...)
+    size = -1;
+    if (replies.back().code == 213) {
+        size = atoll(replies.back().text.c_str() + 4);
+    } // end if (replies.back().code == 213)
+    
+    return message;
+} // end ftpSize(string, long long&)
+
+
+// downloads length bytes of a file, starting at offset, into the same
+// offset of an existing local file; used for one segment of a download
+string FtpBackend::ftpGetRange(string filename, string newname,
+                               long long offset, long long length) {
+    Endpoint address;
+    int    dataSd;
+    int    file = open(newname.c_str(), O_WRONLY);
+    
+    last = TransferResult();
+    if (file < 0) {
+        return "local: " + newname + ": " + strerror(errno) + "\n";
+    } // end if (file < 0)
+    
+    vector<string>   commands;
+    vector<FtpReply> replies;
+    ostringstream    rest;
+    
+    // length counts bytes on the wire, so a segment is never compressed,
+    // and offset counts bytes of the file, so it is never translated
+    string message(type(false));
+    
+    message.append(modeZ(false));
+    
+    rest << "REST " << offset;
+    commands.push_back(rest.str());
+    metrics.begin("RETR", filename, length);
+    message.append(passive(commands, replies, address));
+    
+    // open data connection
+    message.append(ftpOpen(address, dataSd));
+    if (dataSd < 0) {
+        close(file);
+        return message;
+    } // end if (dataSd < 0)
+    
+    // only continue if the server will start at the offset
+    if (replies[1].code / 100 == POS_INTER) {
+        sendCommand("RETR", filename);
+        last = engine.receive(clientSd, dataSd, file, offset, length,
+                              zeroCopy);
+        settled(last);
+        message.append(last.preliminary);
+        message.append(report(last, "received"));
+        message.append(last.reply);
+    } // end if (replies[1].code / 100 == POS_INTER)
+    
+    close(file);
+    close(dataSd);
+    return message;
+} // end ftpGetRange(string, string, long long, long long)
+
+
+// copies a file from this session's server straight to the target's: this
+// server listens, the target connects to it, and the data never passes
+// through the client, which only watches both control connections for how
+// the copy ended
+string FtpBackend::ftpRelay(string filename, FtpBackend& target,
+                            string newname) {
+    Endpoint  address;
+    long long size;
+    
+    last = TransferResult();
+    string message(ftpSize(filename, size));
+    
+    if (latest.code != 213) {
+        return message;
+    } // end if (latest.code != 213)
+    
+    // neither side can translate or inflate what the other sends, so both
+    // move the file byte for byte
+    message.append(modeZ(false));
+    message.append(target.type(false));
+    message.append(target.modeZ(false));
+    metrics.begin("RELAY", filename, size);
+    message.append(pasv(address));
+    
+    if (address.len == 0) {
+        return message;
+    } // end if (address.len == 0)
+    message.append(target.port(address));
+    if (target.latest.code / 100 != POS_COMPL) {
+        return message;
+    } // end if (target.latest.code / 100 != POS_COMPL)
+    
+    long long started = TransferMetrics::now();
+    
+    // the target connects out as soon as it has STOR, and this server
+    // accepts once it has RETR
+    target.sendCommand("STOR", newname);
+    message.append(target.reply());
+    if (target.latest.code / 100 != POS_PRE) {
+        return message;
+    } // end if (target.latest.code / 100 != POS_PRE)
+    
+    metrics.sent();
+    sendCommand("RETR", filename);
+    message.append(reply());
+    if (latest.code / 100 != POS_PRE) {
+        message.append(target.abort());
+        metrics.finish(latest.code);
+        return message;
+    } // end if (latest.code / 100 != POS_PRE)
+    
+    string preliminary(latest.text);
+    
+    last.preliminary = preliminary;
+    last.plain       = -1;
+    if (!relayed(target)) {
+        // neither server has said anything for too long
+        message.append(target.abort());
+        message.append(abort());
+        last.usec = (TransferMetrics::now() - started) / 1000;
+        metrics.finish(0);
+        message.append(report(last, "relayed"));
+        return message;
+    } // end if (!relayed(target))
+    
+    // a refused RETR says more than the STOR it cut short
+    const FtpReply& outcome = latest.code / 100 != POS_COMPL ? latest
+                                                            : target.latest;
+    
+    // the file only counts as moved once both servers say it was
+    if (latest.code / 100 == POS_COMPL
+            && target.latest.code / 100 == POS_COMPL) {
+        last.bytes = size;
+    } // end if (latest.code / 100 == POS_COMPL && ...)
+    last.usec  = (TransferMetrics::now() - started) / 1000;
+    last.code  = outcome.code;
+    last.reply = latest.text + target.latest.text;
+    metrics.finish(last.code);
+    target.changed(newname);
+    
+    message.append(report(last, "relayed"));
+    message.append(last.reply);
+    return message;
+} // end ftpRelay(string, FtpBackend&, string)
+
 
+// timings of transfers and control round trips on this session
+TransferMetrics& FtpBackend::stats(void) {
+    return metrics;
+} // end stats()
 
-// closes an active connection to the server
+
+// the outcome of the latest ls, get or put
+const TransferResult& FtpBackend::lastTransfer(void) const {
+    return last;
+} // end lastTransfer()
+
+
+// closes an active connection to the server; with a session cache, a
+// logged-in session is kept open instead so a later open can reuse it
 string FtpBackend::ftpClose(void) {
-    write(clientSd, "QUIT\r\n", 6);
-    string message = reply(clientSd);
+    if (!cache || account.empty()) {
+        return ftpQuit();
+    } // end if (!cache || account.empty())
+    
+    // whoever takes the session over expects stream mode
+    if (deflating) {
+        modeZ(false);
+    } // end if (deflating)
+    cache->checkin(server, service, account, clientSd);
+    account = "";
+    parser.clear();
+    return "Session to " + server + " kept open for reuse.\n";
+} // end ftpClose()
+
+
+// gives up a control connection that can no longer be trusted; the socket
+// is shut down rather than closed, so the descriptor stays this session's
+// and every later command fails at once, until ftpQuit() closes it
+void FtpBackend::hangUp(void) {
+    shutdown(clientSd, SHUT_RDWR);
+    account = "";
+    parser.clear();
+    latest.code = 0;
+    latest.text = "control connection lost\n";
+} // end hangUp()
+
+
+// hangs up after a transfer that ended with no final reply: the engine gave
+// up on a silent or closed control connection, and a reply that comes late
+// would be taken as the answer to whatever command is sent next
+void FtpBackend::settled(const TransferResult& result) {
+    if (result.code == 0) {
+        hangUp();
+    } // end if (result.code == 0)
+} // end settled(const TransferResult&)
+
+
+// logs out and closes the connection, whether or not a cache is set
+string FtpBackend::ftpQuit(void) {
+    sendCommand("QUIT");
+    string message = reply();
     close(clientSd);
+    account = "";
+    parser.clear();
     return message;
-} // end ftpClose()
+} // end ftpQuit()
+
+
+// sends one command on the control connection and returns the reply; the
+// text is the session's reply buffer, good until the next command
+const string& FtpBackend::command(string_view verb, string_view arg) {
+    sendCommand(verb, arg);
+    return reply();
+} // end command(string_view, string_view)
+
+
+// writes a verb, its argument if there is one, and CRLF as one command
+// straight from where they are, with no line built to hold them; false if
+// the connection failed
+bool FtpBackend::sendCommand(string_view verb, string_view arg) {
+    struct iovec parts[4];
+    int    count = 0;
+    
+    parts[count].iov_base = (void *)verb.data();
+    parts[count++].iov_len = verb.length();
+    if (!arg.empty()) {
+        parts[count].iov_base = (void *)" ";
+        parts[count++].iov_len = 1;
+        parts[count].iov_base = (void *)arg.data();
+        parts[count++].iov_len = arg.length();
+    } // end if (!arg.empty())
+    parts[count].iov_base = (void *)"\r\n";
+    parts[count++].iov_len = 2;
+    
+    return sendAll(parts, count);
+} // end sendCommand(string_view, string_view)
+
+
+// writes out every byte of count buffers, taking up a short write where it
+// stopped; MSG_NOSIGNAL makes a dropped connection an error rather than a
+// SIGPIPE; false if the connection failed
+bool FtpBackend::sendAll(struct iovec *parts, int count) {
+    struct msghdr message;
+    
+    memset(&message, 0, sizeof(message));
+    while(count > 0) {
+        message.msg_iov    = parts;
+        message.msg_iovlen = count;
+        
+        ssize_t sent = sendmsg(clientSd, &message, MSG_NOSIGNAL);
+        
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent <= 0)
+            return false;
+        
+        while(count > 0 && (size_t)sent >= parts->iov_len) {
+            sent -= parts->iov_len;
+            ++parts;
+            --count;
+        } // end while(count > 0 && ...)
+        if (count > 0) {
+            parts->iov_base = (char *)parts->iov_base + sent;
+            parts->iov_len -= sent;
+        } // end if (count > 0)
+    } // end while(count > 0)
+    
+    return true;
+} // end sendAll(struct iovec*, int)
+
+
+// sends independent commands back to back and matches the replies to them
+// in order, one reply per command; a batch left unanswered loses the
+// session, since its commands may still be answered late, and a server
+// that never answered its first batch is not sent another
+string FtpBackend::pipeline(const vector<string>& commands,
+                            vector<FtpReply>& replies) {
+    string message;
+    
+    replies.clear();
+    
+    if (pipelining && batchMode != LOCKSTEP && commands.size() > 1) {
+        string batch;
+        
+        for (size_t i = 0; i < commands.size(); ++i) {
+            batch.append(commands[i]).append("\r\n");
+        } // end for (i < commands.size())
+        
+        long long    started = TransferMetrics::now();
+        struct iovec whole;
+        bool         lost    = false;
+        
+        whole.iov_base = (void *)batch.data();
+        whole.iov_len  = batch.length();
+        lost = !sendAll(&whole, 1);
+        
+        while(!lost && replies.size() < commands.size()) {
+            int wait = batchMode == PROBING ? PROBE_TIMEOUT
+                                            : (int)ReplyParser::TIMEOUT;
+            
+            // a reply that is late may still come, and sending the rest
+            // again would pair every later reply with the wrong command,
+            // so silence loses the session
+            lost = !parser.read(clientSd, latest, wait);
+            message.append(latest.text);
+            if (!lost) {
+                replies.push_back(latest);
+            } // end if (!lost)
+        } // end while(!lost && ...)
+        // the whole batch costs one round trip
+        metrics.command(TransferMetrics::now() - started);
+        
+        if (lost) {
+            FtpReply none = {0, "control connection lost\n"};
+            
+            if (batchMode == PROBING) {
+                batchMode = LOCKSTEP;
+            } // end if (batchMode == PROBING)
+            hangUp();
+            message.append(none.text);
+            replies.resize(commands.size(), none);
+            return message;
+        } // end if (lost)
+        if (batchMode == PROBING) {
+            batchMode = PIPELINED;
+        } // end if (batchMode == PROBING)
+        if (batchMode == PIPELINED) {
+            return message;
+        } // end if (batchMode == PIPELINED)
+    } // end if (pipelining && ...)
+    
+    // lock-step for whatever has not been answered
+    for (size_t i = replies.size(); i < commands.size(); ++i) {
+        message.append(command(commands[i]));
+        replies.push_back(latest);
+    } // end for (i < commands.size())
+    
+    return message;
+} // end pipeline(const vector<string>&, vector<FtpReply>&)
 
 
-// obtains a reply from a server and returns it as a string
-string FtpBackend::reply(int sd) {
-    struct pollfd ufds;
-    ufds.fd      = sd;      // a socket descriptor to exmaine for read
-    ufds.events  = POLLIN;  // check if this sd is ready to read
-    ufds.revents = 0;       // simply zero-initialized
-    string reply = "";
-    int    nread;
-    int    val = poll(&ufds, 1, 1000);
+// asks the server to start the next transfer at a byte offset
+string FtpBackend::restart(long long offset) {
+    char digits[24];
+    int  len = snprintf(digits, sizeof(digits), "%lld", offset);
     
-    if (val > 0) {                      // the socket is ready to read
-        char buffer[BUFLEN];
-        nread = read(sd, buffer, BUFLEN);
-        reply.append(buffer, nread);
-    } // end if (val > 0)
+    return command("REST", string_view(digits, len));
+} // end restart(long long)
+
+
+// reads one complete reply, however many reads or lines it takes, and
+// returns its text; lastReply() holds it with its code
+const string& FtpBackend::reply(void) {
+    long long started = TransferMetrics::now();
     
-    return reply;
+    // the command was just written, so the wait is its round trip
+    parser.read(clientSd, latest);
+    metrics.command(TransferMetrics::now() - started);
+    return latest.text;
 } // end reply()
 
 
-// sends a passive command to the server and parses out the address and port
-string FtpBackend::pasv(char address[], int &port) {
-    int    index  = 0;
-    int    touple = 0;
-    int    offset = 0;
-    
-    write(clientSd, "PASV\r\n", 6);
-    string temp = reply(clientSd);
-    
-    try {
-        if (atoi(&temp.at(0)) / 100 == POS_COMPL) {
-            offset = temp.find('(', 0) + 1;
-
-            while(index < 15) {
-                if (temp.at(offset + index) == ',') {
-                    if (touple == 3) {
-                        address[index] = '\0';
-                        break;
-                    }
-                    address[index] = '.';
-                    ++touple;
-                } // end if (temp.at(offset + index) == ',')
-                else {
-                    address[index] = temp.at(offset + index);
-                } // end else
-                ++index;
-            } // end while(index < 15)
-
-            port  = atoi(&temp.at(offset + index + 1)) * 256;
-            index = temp.rfind(',', temp.length() - 1) + 1;
-            port += atoi(&temp.at(index));
-        } // end if (atoi(&temp.at(0))...)
-    } catch (exception& e) {
-        cerr << e.what() << endl;
-    } // end try atoi()
+// the most recent reply read on the control connection
+const FtpReply& FtpBackend::lastReply(void) const {
+    return latest;
+} // end lastReply()
+
+
+// formats the throughput line for a transfer that the server accepted
+string FtpBackend::report(const TransferResult& result, const char *verb) {
+    ostringstream line;
     
-    return temp;
-} // end pasv(char*, int)
+    if (result.preliminary.empty()) {
+        return "";
+    } // end if (result.preliminary.empty())
+    if (result.code == 0) {
+        line << "transfer did not complete; ";
+    } // end if (result.code == 0)
+    
+    line << result.bytes << " bytes " << verb << " in "
+         << (double)result.usec / 1000000.0 << " seconds ("
+         << 1000.0 * (double)result.bytes / result.usec << " Kbytes/s)"
+         << endl;
+    if (result.plain >= 0) {
+        line << "MODE Z: " << result.plain << " bytes of file data, "
+             << (double)result.plain / (result.bytes > 0 ? result.bytes : 1)
+             << " times the bytes on the wire" << endl;
+    } // end if (result.plain >= 0)
+    return line.str();
+} // end report(const TransferResult&, const char*)
+
+
+// picks a checksum the server can compare against and how to get the
+// server's side of it: a HASH algorithm, an X command or, for a download,
+// a sidecar file such as name.sha256; NONE if there is no way to verify
+Checksum::kind FtpBackend::plan(bool upload, string& how) {
+    static const Checksum::kind ORDER[] = {Checksum::SHA256, Checksum::CRC32C,
+                                           Checksum::MD5, Checksum::CRC32};
+    static const char *X_COMMAND[] = {"XSHA256", "", "XMD5", "XCRC"};
+    static const char *SIDECAR[]   = {".sha256", "", ".md5", ""};
+    
+    offers("");     // asks FEAT, once per session
+    
+    istringstream lines(features);
+    string        line, hashes;
+    
+    while(getline(lines, line)) {
+        for (size_t i = 0; i < line.length(); ++i) {
+            line.at(i) = toupper(line.at(i));
+        } // end for (i < line.length())
+        if (line.compare(0, 6, " HASH ") == 0) {
+            hashes = ";" + line.substr(6);
+            // the starred algorithm is the one HASH uses until told otherwise
+            size_t star = hashes.find('*');
+            
+            if (star != string::npos && hashing.empty()) {
+                hashing = hashes.substr(hashes.rfind(';', star) + 1,
+                                        star - hashes.rfind(';', star) - 1);
+            } // end if (star != string::npos && ...)
+            hashes.erase(remove(hashes.begin(), hashes.end(), '*'),
+                         hashes.end());
+            hashes.erase(remove(hashes.begin(), hashes.end(), '\r'),
+                         hashes.end());
+            hashes += ";";
+        } // end if (line.compare(0, 6, " HASH ") == 0)
+    } // end while(getline(lines, line))
+    
+    for (int i = 0; i < 4; ++i) {
+        string name(Checksum::name(ORDER[i]));
+        
+        if (verify != Checksum::ANY && verify != ORDER[i]) {
+            continue;
+        } // end if (verify != ANY && ...)
+        if (hashes.find(";" + name + ";") != string::npos) {
+            how = "HASH";
+            return ORDER[i];
+        } // end if (hashes.find(...) != npos)
+        if (*X_COMMAND[i] != '\0'
+                && features.find(string(" ") + X_COMMAND[i]) != string::npos) {
+            how = X_COMMAND[i];
+            return ORDER[i];
+        } // end if (*X_COMMAND[i] != '\0' && ...)
+    } // end for (i < 4)
+    
+    // nothing on the server computes one; a download may have a sidecar
+    for (int i = 0; i < 4 && !upload; ++i) {
+        if ((verify == Checksum::ANY || verify == ORDER[i])
+                && *SIDECAR[i] != '\0') {
+            how = SIDECAR[i];
+            return ORDER[i];
+        } // end if ((verify == ANY || ...) && ...)
+    } // end for (i < 4 && !upload)
+    
+    return Checksum::NONE;
+} // end plan(bool, string&)
+
+
+// compares the checksum of the transfer just made with the server's and
+// records the outcome in last.verified
+string FtpBackend::check(string remote, const string& how) {
+    string name(Checksum::name(sum.type()));
+    string local(sum.hex());
+    string theirs;
+    string message(remoteSum(remote, how, sum.type(), theirs));
+    
+    if (theirs.empty()) {
+        message.append(name + " " + local + " (nothing to compare with)\n");
+    } // end if (theirs.empty())
+    else if (theirs == local) {
+        last.verified = 1;
+        message.append(name + " verified: " + local + "\n");
+    } // end else if (theirs == local)
+    else {
+        last.verified = -1;
+        message.append(name + " MISMATCH: local " + local + ", remote "
+                       + theirs + "\n");
+    } // end else
+    
+    return message;
+} // end check(string, const string&)
+
+
+// gets the server's checksum of a file: with HASH, an X command, or a
+// sidecar file, as plan() chose; theirs is empty if there is none
+string FtpBackend::remoteSum(string remote, const string& how,
+                             Checksum::kind algorithm, string& theirs) {
+    string name(Checksum::name(algorithm));
+    string message;
+    
+    theirs = "";
+    if (how == "HASH") {
+        if (hashing != name) {
+            message.append(command("OPTS HASH", name));
+            if (latest.code / 100 == POS_COMPL) {
+                hashing = name;
+            } // end if (latest.code / 100 == POS_COMPL)
+        } // end if (hashing != name)
+        message.append(command("HASH", remote));
+    } // end if (how == "HASH")
+    else if (how.at(0) == 'X') {
+        message.append(command(how, remote));
+    } // end else if (how.at(0) == 'X')
+    else {
+        // a sidecar as written by sha256sum or md5sum
+        fetch(remote + how, theirs);
+        theirs = findHex(theirs, Checksum::digits(algorithm));
+    } // end else
+    
+    if (how.at(0) != '.' && latest.code / 100 == POS_COMPL) {
+        theirs = findHex(latest.text.substr(4), Checksum::digits(algorithm));
+    } // end if (how.at(0) != '.' && ...)
+    
+    return message;
+} // end remoteSum(string, const string&, Checksum::kind, string&)
+
+
+// reads a small remote file, such as a checksum sidecar, into a string;
+// returns the control replies
+string FtpBackend::fetch(string filename, string& text) {
+    Endpoint address;
+    int    dataSd;
+    
+    metrics.begin("RETR", filename, -1);
+    string message(pasv(address));
+    message.append(ftpOpen(address, dataSd));
+    if (dataSd < 0) {
+        text.clear();
+        return message;
+    } // end if (dataSd < 0)
+    
+    // the transfer checked is still the one callers see
+    sendCommand("RETR", filename);
+    TransferResult result = engine.receive(clientSd, dataSd, text);
+    settled(result);
+    close(dataSd);
+    
+    if (result.code / 100 != POS_COMPL) {
+        text.clear();
+    } // end if (result.code / 100 != POS_COMPL)
+    message.append(result.preliminary);
+    message.append(result.reply);
+    return message;
+} // end fetch(string, string&)
+
+
+// the first word of text that is a hexadecimal number of the given length,
+// in lower case; empty if there is none
+string FtpBackend::findHex(const string& text, size_t digits) {
+    istringstream words(text);
+    string        word;
+    
+    while(words >> word) {
+        bool hex = word.length() == digits;
+        
+        for (size_t i = 0; i < word.length() && hex; ++i) {
+            word.at(i) = tolower(word.at(i));
+            hex = isxdigit(word.at(i));
+        } // end for (i < word.length() && hex)
+        if (hex) {
+            return word;
+        } // end if (hex)
+    } // end while(words >> word)
+    
+    return "";
+} // end findHex(const string&, size_t)
+
+
+// puts the server in MODE Z for the next transfer if wanted, compression is
+// on and the server offers it, and back in stream mode otherwise; the
+// engine is told which, and a refusal keeps the session in stream mode
+string FtpBackend::modeZ(bool wanted) {
+    string message;
+    
+    wanted = wanted && compress && !refusedZ && offers("MODE Z");
+    if (wanted != deflating) {
+        message = command(wanted ? "MODE Z" : "MODE S");
+        if (latest.code / 100 == POS_COMPL) {
+            deflating = wanted;
+        } // end if (latest.code / 100 == POS_COMPL)
+        else if (wanted) {
+            refusedZ = true;
+        } // end else if (wanted)
+    } // end if (wanted != deflating)
+    
+    engine.setCompression(deflating);
+    return message;
+} // end modeZ(bool)
+
+
+// puts the server in TYPE A for the next transfer if it is text and ascii
+// is on, and in TYPE I otherwise; TYPE is only sent when it changes, and
+// the engine translates line endings only if the server took TYPE A
+string FtpBackend::type(bool text) {
+    string message;
+    char   wanted = text && ascii ? 'A' : 'I';
+    
+    if (wanted != typeCode) {
+        message = command("TYPE", string_view(&wanted, 1));
+        typeCode = latest.code / 100 == POS_COMPL ? wanted : 0;
+    } // end if (wanted != typeCode)
+    
+    engine.setText(typeCode == 'A');
+    return message;
+} // end type(bool)
+
+
+// whether the FEAT reply lists a feature, such as "MODE Z"; FEAT is only
+// asked once per session
+bool FtpBackend::offers(const string& feature) {
+    if (!featured) {
+        command("FEAT");
+        features = latest.code / 100 == POS_COMPL ? latest.text : "";
+        featured = true;
+    } // end if (!featured)
+    
+    istringstream lines(features);
+    string        line;
+    
+    while(!feature.empty() && getline(lines, line)) {
+        line.erase(remove(line.begin(), line.end(), '\r'), line.end());
+        for (size_t i = 0; i < line.length(); ++i) {
+            line.at(i) = toupper(line.at(i));
+        } // end for (i < line.length())
+        // a feature may be followed by its parameters
+        if (line == " " + feature || line.compare(0, feature.length() + 2,
+                                                  " " + feature + " ") == 0) {
+            return true;
+        } // end if (line == " " + feature || ...)
+    } // end while(!feature.empty() && ...)
+    
+    return false;
+} // end offers(const string&)
+
+
+// a remote path made absolute against the working directory; empty if the
+// working directory is not known
+string FtpBackend::absolute(const string& path) {
+    if (!path.empty() && path.at(0) == '/') {
+        return ListingCache::join("", path);
+    } // end if (!path.empty() && ...)
+    
+    string directory(workingDirectory());
+    
+    return directory.empty() ? "" : ListingCache::join(directory, path);
+} // end absolute(const string&)
+
+
+// forgets the cached listing of the directory a file was written to
+void FtpBackend::changed(const string& path) {
+    if (!listings.empty()) {
+        listings.invalidate(ListingCache::parent(absolute(path)));
+    } // end if (!listings.empty())
+} // end changed(const string&)
+
+
+// strips a PWD reply down to the quoted path, undoing doubled quotes; empty
+// if there is none
+string FtpBackend::quoted(const string& reply) {
+    string path;
+    size_t at = reply.find('"');
+    
+    if (at == string::npos) {
+        return "";
+    } // end if (at == string::npos)
+    
+    for (++at; at < reply.length(); ++at) {
+        if (reply.at(at) == '"') {
+            if (at + 1 < reply.length() && reply.at(at + 1) == '"') {
+                ++at;
+            } // end if (at + 1 < ...)
+            else {
+                break;
+            } // end else
+        } // end if (reply.at(at) == '"')
+        path += reply.at(at);
+    } // end for (at < reply.length())
+    
+    return path;
+} // end quoted(const string&)
+
+
+// asks the server for a passive data port and where to connect to it
+string FtpBackend::pasv(Endpoint& address) {
+    vector<FtpReply> replies;
+    
+    return passive(vector<string>(), replies, address);
+} // end pasv(Endpoint&)
+
+
+// pipelines a passive command ahead of commands, so replies[0] answers it:
+// EPSV, which works in either address family, unless the server has shown
+// it only knows PASV; address is where to connect, or has len 0 if the
+// server gave nowhere
+string FtpBackend::passive(const vector<string>& commands,
+                           vector<FtpReply>& replies, Endpoint& address) {
+    vector<string> batch(1, passiveMode == LEGACY ? "PASV" : "EPSV");
+    long long      started = TransferMetrics::now();
+    
+    batch.insert(batch.end(), commands.begin(), commands.end());
+    string message(pipeline(batch, replies));
+    
+    // a server from before RFC 2428 gets the batch again with PASV, which
+    // can only name an IPv4 address
+    if (passiveMode == UNTRIED && replies[0].code != 229
+            && Connector::peer(clientSd, address)
+            && Connector::family(address) == AF_INET) {
+        passiveMode = LEGACY;
+        batch[0]    = "PASV";
+        message.append(pipeline(batch, replies));
+    } // end if (passiveMode == UNTRIED && ...)
+    metrics.passive(TransferMetrics::now() - started);
+    
+    if (parsePassive(replies[0], clientSd, address)
+            && passiveMode == UNTRIED) {
+        passiveMode = EXTENDED;
+    } // end if (parsePassive(...) && passiveMode == UNTRIED)
+    return message;
+} // end passive(const vector<string>&, vector<FtpReply>&, Endpoint&)
+
+
+// parses the address and port out of an EPSV or PASV reply that came on
+// control socket ctrlSd; false if it has none, leaving address with len 0
+bool FtpBackend::parsePassive(const FtpReply& reply, int ctrlSd,
+                              Endpoint& address) {
+    size_t paren = reply.text.find('(');
+    
+    if (reply.code == 229 && paren != string::npos
+            && paren + 4 < reply.text.length()) {
+        // "(|||port|)": the data connection goes to the control peer
+        char delimiter = reply.text.at(paren + 1);
+        int  port      = atoi(reply.text.c_str() + paren + 4);
+        
+        if (reply.text.at(paren + 2) == delimiter
+                && reply.text.at(paren + 3) == delimiter
+                && port > 0 && port < 65536
+                && Connector::peer(ctrlSd, address)) {
+            Connector::setPort(address, port);
+            return true;
+        } // end if (reply.text.at(paren + 2) == delimiter && ...)
+    } // end if (reply.code == 229 && ...)
+    else if (reply.code == 227) {
+        // "(h1,h2,h3,h4,p1,p2)", though some servers leave out the brackets
+        size_t       digit = reply.text.find_first_of("0123456789",
+                                                      paren == string::npos
+                                                      ? 4 : paren);
+        unsigned int h[4], p[2];
+        
+        if (digit != string::npos
+                && sscanf(reply.text.c_str() + digit, "%u,%u,%u,%u,%u,%u",
+                          &h[0], &h[1], &h[2], &h[3], &p[0], &p[1]) == 6
+                && h[0] < 256 && h[1] < 256 && h[2] < 256 && h[3] < 256
+                && p[0] < 256 && p[1] < 256) {
+            struct sockaddr_in *in = (struct sockaddr_in *)&address.addr;
+            
+            memset(&address, 0, sizeof(address));
+            in->sin_family      = AF_INET;
+            in->sin_addr.s_addr = htonl(h[0] << 24 | h[1] << 16
+                                        | h[2] << 8 | h[3]);
+            in->sin_port        = htons(p[0] * 256 + p[1]);
+            address.len         = sizeof(*in);
+            return true;
+        } // end if (digit != string::npos && ...)
+    } // end else if (reply.code == 227)
+    
+    address.len = 0;
+    return false;
+} // end parsePassive(const FtpReply&, int, Endpoint&)
+
+
+// tells the server to connect out to address for the next transfer: PORT
+// for IPv4, and EPRT, which names its family, for IPv6
+string FtpBackend::port(const Endpoint& address) {
+    char text[INET6_ADDRSTRLEN];
+    char arg[INET6_ADDRSTRLEN + 32];
+    int  len;
+    
+    if (Connector::family(address) == AF_INET6) {
+        const struct sockaddr_in6 *in6 =
+                (const struct sockaddr_in6 *)&address.addr;
+        
+        inet_ntop(AF_INET6, &in6->sin6_addr, text, sizeof(text));
+        len = snprintf(arg, sizeof(arg), "|2|%s|%d|", text,
+                       ntohs(in6->sin6_port));
+        return command("EPRT", string_view(arg, len));
+    } // end if (Connector::family(address) == AF_INET6)
+    
+    const struct sockaddr_in *in = (const struct sockaddr_in *)&address.addr;
+    unsigned int host = ntohl(in->sin_addr.s_addr);
+    unsigned int num  = ntohs(in->sin_port);
+    
+    len = snprintf(arg, sizeof(arg), "%u,%u,%u,%u,%u,%u", host >> 24,
+                   host >> 16 & 0xff, host >> 8 & 0xff, host & 0xff,
+                   num >> 8, num & 0xff);
+    return command("PORT", string_view(arg, len));
+} // end port(const Endpoint&)
+
+
+// abandons a transfer the server has already opened, reading its replies
+// until the last one; a server that says nothing is given up on
+string FtpBackend::abort(void) {
+    string message;
+    
+    sendCommand("ABOR");
+    while(parser.read(clientSd, latest, PROBE_TIMEOUT)) {
+        message.append(latest.text);
+        if (latest.code / 100 != POS_PRE) {
+            break;
+        } // end if (latest.code / 100 != POS_PRE)
+    } // end while(parser.read(...))
+    
+    return message;
+} // end abort()
+
+
+// waits out a relay on both control connections until each server has
+// sent its final reply; a connection that closes first leaves a code of 0,
+// and false means both stayed silent for TIMEOUT ms, so the copy is stuck
+bool FtpBackend::relayed(FtpBackend& target) {
+    FtpBackend *sides[2] = {this, &target};
+    bool        done[2]  = {false, false};
+    char        chunk[1448];
+    
+    while(true) {
+        // replies already read count first, as a 226 that came in with its
+        // 150, and a server may send more than one 1xx before the end
+        for (int i = 0; i < 2; ++i) {
+            while(!done[i] && sides[i]->parser.next(sides[i]->latest)) {
+                done[i] = sides[i]->latest.code / 100 != POS_PRE;
+            } // end while(!done[i] && ...)
+        } // end for (i < 2)
+        if (done[0] && done[1]) {
+            return true;
+        } // end if (done[0] && done[1])
+        
+        struct pollfd ufds[2];
+        
+        for (int i = 0; i < 2; ++i) {
+            ufds[i].fd      = done[i] ? -1 : sides[i]->clientSd;
+            ufds[i].events  = POLLIN;
+            ufds[i].revents = 0;
+        } // end for (i < 2)
+        
+        int val = poll(ufds, 2, ReplyParser::TIMEOUT);
+        if (val < 0 && errno == EINTR)
+            continue;
+        if (val == 0)
+            return false;
+        
+        for (int i = 0; i < 2; ++i) {
+            FtpBackend& side = *sides[i];
+            ssize_t nread = 0;
+            
+            if (done[i] || (val > 0 && ufds[i].revents == 0)) {
+                continue;
+            } // end if (done[i] || ...)
+            if (val > 0) {
+                nread = read(side.clientSd, chunk, sizeof(chunk));
+            } // end if (val > 0)
+            if (nread < 0 && errno == EINTR) {
+                continue;
+            } // end if (nread < 0 && errno == EINTR)
+            if (nread <= 0) {
+                side.latest.code = 0;
+                side.latest.text = "control connection lost\n";
+                side.parser.clear();
+                done[i] = true;
+                continue;
+            } // end if (nread <= 0)
+            
+            side.parser.feed(chunk, nread);
+        } // end for (i < 2)
+    } // end while(true)
+} // end relayed(FtpBackend&)
@@ -18,19 +18,29 @@
 #include <sys/stat.h>
 #include <sys/types.h>      // socket, bind
 #include <sys/uio.h>        // writev
-#include <sys/wait.h>       // for wait
-#include <fcntl.h>          // fcntl
-#include <netdb.h>          // gethostbyname
+#include <errno.h>
+#include <fcntl.h>          // open
 #include <poll.h>
 #include <signal.h>         // sigaction
 #include <stdio.h>          // for NULL, perror
 #include <string.h>
 #include <unistd.h>         // read, write, close
+#include <algorithm>        // remove
 #include <cstdlib>
 #include <fstream>
 #include <iostream>
+#include <sstream>
 #include <string>
-#include "Timer.h"
+#include <string_view>
+#include <vector>
+#include "Checksum.h"
+#include "Connector.h"
+#include "ListingCache.h"
+#include "ReplyParser.h"
+#include "SessionCache.h"
+#include "TransferEngine.h"
+#include "TransferMetrics.h"
+#include "TransferTuner.h"
 
 using namespace std;
 
@@ -45,25 +55,116 @@ public:
                      NEG_PERM  = 5;
     FtpBackend();
     string ftpOpen(string hostname, string port);
+    bool   ftpResume(string hostname, string port, string username);
     string ftpUser(string username);
     string ftpPass(string password);
+    bool   ftpLogin(string username, string password, string directory);
     string ftpCd(string subdir);
+    const string& ftpPwd(void);
     string ftpLs(void);
+    string ftpNlst(vector<string>& names);
+    string ftpMlsd(string directory, const ListingCache::Listing *&entries,
+                   bool refresh = false);
+    bool   ftpStat(string path, RemoteEntry& entry);
+    string ftpChecksum(string filename, Checksum::kind& algorithm,
+                       string& hex);
+    string ftpDelete(string filename);
+    string ftpMkdir(string directory);
+    string ftpRmdir(string directory);
+    string workingDirectory(void);
+    void   invalidate(string directory);
     string ftpGet(string filename, string newname);
     string ftpPut(string filename, string newname);
+    string ftpPut(Broadcast& source, int reader, string newname);
+    string ftpReget(string filename, string newname);
+    string ftpReput(string filename, string newname);
+    string ftpSize(string filename, long long& size);
+    string ftpGetRange(string filename, string newname, long long offset,
+                       long long length);
+    string ftpRelay(string filename, FtpBackend& target, string newname);
     string ftpClose(void);
     string ftpQuit(void);
+    string pipeline(const vector<string>& commands,
+                    vector<FtpReply>& replies);
+    bool   toggleZeroCopy(void);
+    bool   toggleDiskWriter(void);
+    bool   togglePipelining(void);
+    void   setSessionCache(SessionCache *sessions);
+    void   setBufferSize(size_t bytes);
+    void   setRateLimiter(RateLimiter *limiter);
+    void   setVerify(Checksum::kind algorithm);
+    void   setCompression(bool on);
+    void   setAscii(bool on);
+    TransferMetrics&      stats(void);
+    const TransferResult& lastTransfer(void) const;
+    const FtpReply&       lastReply(void) const;
+    static bool parsePassive(const FtpReply& reply, int ctrlSd,
+                             Endpoint& address);
 private:
-    static const int DEF_PORT_NUM = 21,
-                     BUFLEN       = 1448;
+    static const int DEF_PORT_NUM  = 21,
+                     PROBE_TIMEOUT = 5000;  // ms to wait on a first batch
+    // whether this server has answered a pipelined batch yet
+    enum   batching {PROBING, PIPELINED, LOCKSTEP};
+    // whether this server has answered EPSV yet
+    enum   passivity {UNTRIED, EXTENDED, LEGACY};
     int    portNum;                     // a server port number
+    bool   zeroCopy;                    // splice() downloads when possible
+    bool   diskWriter;                  // write downloads behind the socket
+    bool   pipelining;                  // send independent commands at once
+    batching batchMode;                 // pipelining state of this server
+    passivity passiveMode;              // EPSV, or PASV for an old server
     int    clientSd;                    // for the client-side socket
-    struct hostent *host;               // for resolved server from host name
-    struct sockaddr_in sendSockAddr;    // address data structure
+    SessionCache  *cache;               // parks sessions on close, if set
+    string         server, service;     // host and port as given to open
+    string         account;             // user logged in, or empty
+    string         pending;             // user awaiting a password
+    Checksum::kind verify;              // checksum wanted, NONE, or ANY
+    Checksum       sum;                 // of the file being transferred
+    bool           featured;            // FEAT was asked this session
+    string         features;            // the FEAT reply, if any
+    string         hashing;             // algorithm HASH uses now
+    string         cwd;                 // working directory, if known
+    ListingCache   listings;            // parsed listings by directory
+    bool           compress;            // MODE Z where the server has it
+    bool           deflating;           // the server is in MODE Z
+    bool           refusedZ;            // the server refused MODE Z
+    bool           ascii;               // get and put in TYPE A
+    char           typeCode;            // 'A' or 'I' as last set, or 0
+    ReplyParser    parser;              // assembles control replies
+    FtpReply       latest;              // most recent control reply
+    TransferTuner  tuner;               // sizes data transfer buffers
+    TransferMetrics metrics;            // where transfer time goes
+    TransferEngine engine;              // moves data for ls, get and put
+    TransferResult last;                // outcome of the latest transfer
     
-    string ftpOpen(char *hostname, int port, int& sd);
-    string reply(int delay);
-    string pasv(char address[], int& port);
+    string ftpOpen(const Endpoint& address, int& sd);
+    const string& command(string_view verb,
+                          string_view arg = string_view());
+    bool   sendCommand(string_view verb, string_view arg = string_view());
+    bool   sendAll(struct iovec *parts, int count);
+    void   hangUp(void);
+    void   settled(const TransferResult& result);
+    string restart(long long offset);
+    const string& reply(void);
+    string pasv(Endpoint& address);
+    string passive(const vector<string>& commands,
+                   vector<FtpReply>& replies, Endpoint& address);
+    string port(const Endpoint& address);
+    string abort(void);
+    bool   relayed(FtpBackend& target);
+    string report(const TransferResult& result, const char *verb);
+    string modeZ(bool wanted);
+    string type(bool text);
+    bool   offers(const string& feature);
+    string absolute(const string& path);
+    void   changed(const string& path);
+    static string quoted(const string& reply);
+    Checksum::kind plan(bool upload, string& how);
+    string check(string remote, const string& how);
+    string remoteSum(string remote, const string& how,
+                     Checksum::kind algorithm, string& theirs);
+    string fetch(string filename, string& text);
+    static string findHex(const string& text, size_t digits);
 }; // end class FtpBackend
 
 #endif	/* FTPBACKEND_H */
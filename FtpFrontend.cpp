@@ -10,71 +10,176 @@
 
 
 FtpFrontend::FtpFrontend() : PROMPT("ftp> "), opened(false), authed(false),
-                             command(""),     hostname(""),  username(""),
-                             param1(""),      param2(""),    backend() {
+                             batch(false),    stopOnError(false),
+                             status(EXIT_OK), netrc(""),
+                             sessions(DEF_SESSIONS),
+                             verify(Checksum::NONE),  compress(true),
+                             ascii(false),    command(""),
+                             hostname(""),    port("21"),    username(""),
+                             password(""),    param1(""),    param2(""),
+                             backend() {
+    backend.setSessionCache(&cache);
+    backend.setRateLimiter(&limiter);
+    watch();
 } // end default constructor
 
 
 // when given a hostname, a connection should be immediately established
-FtpFrontend::FtpFrontend(char *host) : PROMPT("ftp> "), backend(),
-                                       hostname(host),  command(""),
-                                       param1(""),      param2("") {
-    string reply(backend.ftpOpen(hostname, "21"));
+FtpFrontend::FtpFrontend(char *host) : PROMPT("ftp> "),
+                                       opened(false),   authed(false),
+                                       batch(false),    stopOnError(false),
+                                       status(EXIT_OK), netrc(""),
+                                       sessions(DEF_SESSIONS),
+                                       verify(Checksum::NONE),
+                                       compress(true),  ascii(false),
+                                       command(""),     hostname(host),
+                                       port("21"),      password(""),
+                                       param1(""),      param2(""),
+                                       backend() {
+    backend.setSessionCache(&cache);
+    backend.setRateLimiter(&limiter);
+    watch();
+    open(hostname, port);
+} // end constructor
+
+
+// draws progress on a terminal and logs transfers to FTP_STATS_LOG if set
+void FtpFrontend::watch(void) {
+    progress = isatty(STDERR_FILENO);
+    backend.stats().setProgress(progress);
+    if (getenv("FTP_STATS_LOG") != NULL) {
+        backend.stats().setLog(getenv("FTP_STATS_LOG"));
+    } // end if (getenv("FTP_STATS_LOG") != NULL)
+} // end watch()
+
+
+// reads commands without prompting and logs in with the credentials in the
+// environment or a netrc file; replies are no longer flushed per command
+void FtpFrontend::setBatch(string netrc, bool stopOnError) {
+    const char *home = getenv("HOME");
+    
+    batch             = true;
+    this->stopOnError = stopOnError;
+    this->netrc       = netrc;
+    
+    if (this->netrc.empty() && getenv("NETRC") != NULL) {
+        this->netrc = getenv("NETRC");
+    } // end if (this->netrc.empty() && ...)
+    else if (this->netrc.empty() && home != NULL) {
+        this->netrc = string(home) + "/.netrc";
+    } // end else if (this->netrc.empty() && ...)
+    
+    cin.tie(NULL);
+    progress = false;       // nobody is watching a batch run
+    backend.stats().setProgress(progress);
+} // end setBatch(string, bool)
+
+
+// connects to a server and logs in, reusing a parked session if one fits;
+// true if the session is ready to use
+bool FtpFrontend::open(string host, string portNum) {
+    string reply;
+    
+    hostname = host;
+    port     = portNum;
+    username = "";
+    if (resume()) {
+        return true;
+    } // end if (resume())
+    
+    reply = backend.ftpOpen(hostname, port);
     cout << reply;
     try {
         opened = atoi(&reply.at(0)) / 100 == FtpBackend::POS_COMPL;
 
-        if (opened) {
+        if (opened && username.empty()) {
             authenticate();
-        } // end if (opened)
+        } // end if (opened && username.empty())
+        else if (opened) {
+            logIn();    // the name was asked for by resume()
+        } // end else if (opened)
     } catch (exception& e) {
         cerr << e.what() << endl;
         opened   = false;
         authed   = false;
         username = "";
     } // end try atoi()
-} // end constructor
+    
+    return opened && authed;
+} // end open(string, string)
 
 
-// perform user tasks until user is done
-void FtpFrontend::run() {
+// perform user tasks until user is done; returns the exit status
+int FtpFrontend::run() {
     bool   done = false;
+    bool   ok;      // whether the latest command succeeded
     string reply;   // for response from server
+    const ListingCache::Listing *entries;   // from mlsd
     
     while(!done) {
+        ok = true;
         // get action code based on user input; also sets data members
         switch (readInput()) {
             case OPEN:
-                reply = backend.ftpOpen(hostname, param1);
-                cout << reply;
-                try {
-                    opened = atoi(&reply.at(0)) / 100
-                            == FtpBackend::POS_COMPL;
-
-                    if (opened) {
-                        authenticate();
-                    } // end if (opened)
-                } catch (exception& e) {
-                    cerr << e.what() << endl;
-                    opened = false;
-                    authed = false;
-                } // end try atoi()
+                ok = open(hostname, param1);
+                // nothing later in a script can work without a session
+                if (!ok && batch) {
+                    status = EXIT_NO_LOGIN;
+                    done   = true;
+                } // end if (!ok && batch)
                 break;
             case CD:
                 reply = backend.ftpCd(param1);
                 cout << reply;
+                ok = backend.lastReply().code / 100 == FtpBackend::POS_COMPL;
                 break;
             case LS:
                 reply = backend.ftpLs();
                 cout << reply;
+                ok = backend.lastTransfer().code / 100
+                        == FtpBackend::POS_COMPL;
                 break;
             case GET:
                 reply = backend.ftpGet(param1, param2);
                 cout << reply;
+                ok = backend.lastTransfer().code / 100
+                        == FtpBackend::POS_COMPL
+                     && backend.lastTransfer().verified >= 0;
                 break;
             case PUT:
                 reply = backend.ftpPut(param1, param2);
                 cout << reply;
+                ok = backend.lastTransfer().code / 100
+                        == FtpBackend::POS_COMPL
+                     && backend.lastTransfer().verified >= 0;
+                break;
+            case REGET:
+                reply = backend.ftpReget(param1, param2);
+                cout << reply;
+                ok = backend.lastTransfer().code / 100
+                        == FtpBackend::POS_COMPL;
+                break;
+            case REPUT:
+                reply = backend.ftpReput(param1, param2);
+                cout << reply;
+                ok = backend.lastTransfer().code / 100
+                        == FtpBackend::POS_COMPL;
+                break;
+            case MGET:
+                ok = transferBatch(false);
+                break;
+            case MPUT:
+                ok = transferBatch(true);
+                // the other sessions changed the directory
+                backend.invalidate("");
+                break;
+            case PGET:
+                ok = getSegmented();
+                break;
+            case PARALLEL:
+                cout << "Using " << sessions << " sessions for mget, mput "
+                     << "and pget."
+                     << endl;
                 break;
             case CLOSE:
                 reply = backend.ftpClose();
@@ -84,27 +189,144 @@ void FtpFrontend::run() {
                 break;
             case QUIT:
                 if (opened) {
-                    reply = backend.ftpClose();
+                    reply = backend.ftpQuit();
                     cout << reply;
+                    opened = false;
                 } // end if (opened)
                 done = true;
                 break;
+            case PIPELINE:
+                cout << "Command pipelining "
+                     << (backend.togglePipelining() ? "on." : "off.") << endl;
+                break;
+            case ZEROCOPY:
+                cout << "Zero-copy receive "
+                     << (backend.toggleZeroCopy() ? "on." : "off.") << endl;
+                break;
+            case DISKWRITER:
+                cout << "Asynchronous disk writer "
+                     << (backend.toggleDiskWriter() ? "on." : "off.") << endl;
+                break;
+            case STATS:
+                cout << backend.stats().summary();
+                break;
+            case PROGRESS:
+                progress = !progress;
+                backend.stats().setProgress(progress);
+                cout << "Progress bar " << (progress ? "on." : "off.")
+                     << endl;
+                break;
+            case STATSLOG:
+                ok = backend.stats().setLog(param1);
+                if (ok) {
+                    cout << (param1.empty() ? "Transfer log off."
+                                            : "Logging transfers to "
+                                              + param1 + ".") << endl;
+                } // end if (ok)
+                break;
+            case RATE:
+                if (!param1.empty()) {
+                    limiter.setRate(RateLimiter::parseRate(param1),
+                                    RateLimiter::parseRate(param2));
+                } // end if (!param1.empty())
+                cout << "Rate limit "
+                     << RateLimiter::formatRate(limiter.total())
+                     << " in all, "
+                     << RateLimiter::formatRate(limiter.each())
+                     << " per transfer." << endl;
+                break;
+            case VERIFY:
+                // verify alone switches between off and the best available
+                if (param1.empty()) {
+                    verify = verify == Checksum::NONE ? Checksum::ANY
+                                                      : Checksum::NONE;
+                } // end if (param1.empty())
+                else if ((verify = Checksum::parse(param1)) == Checksum::NONE
+                         && param1 != "off") {
+                    cerr << "Unknown checksum: " << param1 << endl;
+                    ok = false;
+                } // end else if ((verify = ...) == NONE && ...)
+                backend.setVerify(verify);
+                cout << "Checksum verification " << Checksum::name(verify)
+                     << "." << endl;
+                break;
+            case MLSD:
+                reply = backend.ftpMlsd(param1, entries, !param2.empty());
+                cout << reply;
+                ok = entries != NULL;
+                if (ok) {
+                    showListing(*entries);
+                    cout << entries->size() << " entries"
+                         << (reply.empty() ? ", cached." : ".") << endl;
+                } // end if (ok)
+                break;
+            case MIRROR:
+                ok = mirror();
+                break;
+            case FANOUT:
+                ok = fanOut();
+                break;
+            case TRANSFER:
+                ok = relay();
+                break;
+            case COMPRESS:
+                compress = !compress;
+                backend.setCompression(compress);
+                cout << "MODE Z compression " << (compress ? "on." : "off.")
+                     << endl;
+                break;
+            case ASCII:
+                ascii = true;
+                backend.setAscii(ascii);
+                cout << "Transfers use TYPE A, with line endings translated."
+                     << endl;
+                break;
+            case BINARY:
+                ascii = false;
+                backend.setAscii(ascii);
+                cout << "Transfers use TYPE I, byte for byte." << endl;
+                break;
             case UNKNOWN:
                 cerr << "Unrecognized command: " << command << endl;
+                ok = false;
+                break;
+            // readInput() has already said what was wrong
+            case DEFAULT:
+                ok = false;
                 break;
             // paranoid: my switches break when I don't have a default
             default:
                 break;
         } // end switch (command)
+        
+        if (!ok && status == EXIT_OK) {
+            status = EXIT_FAILED;
+        } // end if (!ok && status == EXIT_OK)
+        if (!ok && batch && stopOnError) {
+            done = true;
+        } // end if (!ok && batch && stopOnError)
     } // end while(!done)
+    
+    // a batch run stopped early still logs out
+    if (opened) {
+        cout << backend.ftpQuit();
+    } // end if (opened)
+    
+    return status;
 } // end run()
 
 
 // read user input and set member variables accordingly; return an action code
 int FtpFrontend::readInput() {
     command = "";       // first item read from command line
-    cout << PROMPT;
-    cin  >> command;
+    if (!batch) {
+        cout << PROMPT;
+    } // end if (!batch)
+    
+    // the end of the input ends the session
+    if (!(cin >> command)) {
+        return QUIT;
+    } // end if (!(cin >> command))
     
     if (command.compare("open") == 0) {
         if (opened) {
@@ -122,8 +344,9 @@ int FtpFrontend::readInput() {
             } // end else (cin.get() == '\n')
         } // end else if (cin.get() != '\n')
         else {
-            cout << "(to) ";
-            cin  >> hostname;
+            if (!ask("(to) ", hostname)) {
+                return DEFAULT;
+            } // end if (!ask(...))
             param1 = "21";
         } // end else (cin.get() == '\n')
         
@@ -140,10 +363,9 @@ int FtpFrontend::readInput() {
         if (cin.get() != '\n') {
             cin >> param1;
         } // end if (cin.get() != '\n')
-        else {
-            cout << "(remote-directory) ";
-            cin  >> param1;
-        } // end else ()
+        else if (!ask("(remote-directory) ", param1)) {
+            return DEFAULT;
+        } // end else if (!ask(...))
         
         return CD;
     } // end else if (command.compare("cd") == 0)
@@ -155,7 +377,8 @@ int FtpFrontend::readInput() {
         
         return LS;
     } // end else if (command.compare("ls") == 0)
-    else if (command.compare("get") == 0) {
+    else if (command.compare("get") == 0
+             || command.compare("reget") == 0) {
         if (!opened) {
             cerr << "Not connected." << endl;
             return DEFAULT;
@@ -171,19 +394,20 @@ int FtpFrontend::readInput() {
             } // end else (cin.get() == '\n')
         } // end if (cin.get() != '\n')
         else {
-            cout << "(remote-file) ";
-            cin  >> param1;
-            cout << "(local-file) ";
-            cin  >> param2;
+            if (!ask("(remote-file) ", param1)
+                    || !ask("(local-file) ", param2)) {
+                return DEFAULT;
+            } // end if (!ask(...) || ...)
         
             if (param2.compare("") == 0) {
                 param2 = param1;
             } // end if (param2.compare("") == 0)
         } // end else (cin.get() == '\n')
         
-        return GET;
-    } // end else if (command.compare("get") == 0)
-    else if (command.compare("put") == 0) {
+        return command.compare("get") == 0 ? GET : REGET;
+    } // end else if (command.compare("get") == 0...)
+    else if (command.compare("put") == 0
+             || command.compare("reput") == 0) {
         if (!opened) {
             cerr << "Not connected." << endl;
             return DEFAULT;
@@ -199,18 +423,71 @@ int FtpFrontend::readInput() {
             } // end else (cin.get() == '\n')
         } // end if (cin.get() != '\n')
         else {
-            cout << "(local-file) ";
-            cin  >> param1;
-            cout << "(remote-file) ";
-            cin  >> param2;
+            if (!ask("(local-file) ", param1)
+                    || !ask("(remote-file) ", param2)) {
+                return DEFAULT;
+            } // end if (!ask(...) || ...)
             
             if (param2.compare("") == 0) {
                 param2 = param1;
             } // end if (param2.compare("") == 0)
         } // end else (cin.get() == '\n')
         
-        return PUT;
-    } // end else if (command.compare("put") == 0)
+        return command.compare("put") == 0 ? PUT : REPUT;
+    } // end else if (command.compare("put") == 0...)
+    else if (command.compare("mget") == 0
+             || command.compare("mput") == 0) {
+        if (!opened) {
+            cerr << "Not connected." << endl;
+            return DEFAULT;
+        } // end if (!opened)
+        
+        if (command.compare("mget") == 0) {
+            readPatterns("(remote-files) ");
+            return patterns.empty() ? DEFAULT : MGET;
+        } // end if (command.compare("mget") == 0)
+        readPatterns("(local-files) ");
+        return patterns.empty() ? DEFAULT : MPUT;
+    } // end else if (command.compare("mget") == 0...)
+    else if (command.compare("pget") == 0) {
+        if (!opened) {
+            cerr << "Not connected." << endl;
+            return DEFAULT;
+        } // end if (!opened)
+        
+        if (cin.get() != '\n') {
+            cin >> param1;
+            if (cin.get() != '\n') {
+                cin >> param2;
+            } // end if (cin.get() != '\n')
+            else {
+                param2 = param1;
+            } // end else (cin.get() == '\n')
+        } // end if (cin.get() != '\n')
+        else {
+            if (!ask("(remote-file) ", param1)) {
+                return DEFAULT;
+            } // end if (!ask(...))
+            param2 = param1;
+        } // end else (cin.get() == '\n')
+        
+        return PGET;
+    } // end else if (command.compare("pget") == 0)
+    else if (command.compare("parallel") == 0) {
+        if (cin.get() != '\n') {
+            cin >> param1;
+            sessions = atoi(param1.c_str());
+        } // end if (cin.get() != '\n')
+        
+        if (sessions < 1) {
+            sessions = 1;
+        } // end if (sessions < 1)
+        else if (sessions > TransferScheduler::MAX_SESSIONS) {
+            sessions = TransferScheduler::MAX_SESSIONS;
+        } // end else if (sessions > MAX_SESSIONS)
+        
+        return PARALLEL;
+    } // end else if (command.compare("parallel") == 0)
     else if (command.compare("close") == 0) {
         if (!opened) {
             cerr << "Not connected." << endl;
@@ -222,6 +499,150 @@ int FtpFrontend::readInput() {
     else if (command.compare("quit") == 0) {
         return QUIT;
     } // end else if (command.compare("quit") == 0)
+    else if (command.compare("pipeline") == 0) {
+        return PIPELINE;
+    } // end else if (command.compare("pipeline") == 0)
+    else if (command.compare("zerocopy") == 0) {
+        return ZEROCOPY;
+    } // end else if (command.compare("zerocopy") == 0)
+    else if (command.compare("diskwriter") == 0) {
+        return DISKWRITER;
+    } // end else if (command.compare("diskwriter") == 0)
+    else if (command.compare("stats") == 0) {
+        return STATS;
+    } // end else if (command.compare("stats") == 0)
+    else if (command.compare("progress") == 0) {
+        return PROGRESS;
+    } // end else if (command.compare("progress") == 0)
+    else if (command.compare("statslog") == 0) {
+        param1 = "";    // no file turns the log off
+        if (cin.get() != '\n') {
+            cin >> param1;
+        } // end if (cin.get() != '\n')
+        
+        return STATSLOG;
+    } // end else if (command.compare("statslog") == 0)
+    else if (command.compare("rate") == 0) {
+        // rate [total [each]]; no arguments shows the limits
+        param1 = "";
+        param2 = "";
+        if (cin.get() != '\n') {
+            cin >> param1;
+            if (cin.get() != '\n') {
+                cin >> param2;
+            } // end if (cin.get() != '\n')
+        } // end if (cin.get() != '\n')
+        
+        return RATE;
+    } // end else if (command.compare("rate") == 0)
+    else if (command.compare("verify") == 0) {
+        // verify [off|auto|sha256|md5|crc32|crc32c]
+        param1 = "";
+        if (cin.get() != '\n') {
+            cin >> param1;
+        } // end if (cin.get() != '\n')
+        
+        return VERIFY;
+    } // end else if (command.compare("verify") == 0)
+    else if (command.compare("mlsd") == 0) {
+        // mlsd [directory [refresh]]; the cache is used unless refreshing
+        param1 = "";
+        param2 = "";
+        if (cin.get() != '\n') {
+            cin >> param1;
+            if (cin.get() != '\n') {
+                cin >> param2;
+            } // end if (cin.get() != '\n')
+        } // end if (cin.get() != '\n')
+        
+        return MLSD;
+    } // end else if (command.compare("mlsd") == 0)
+    else if (command.compare("compress") == 0) {
+        return COMPRESS;
+    } // end else if (command.compare("compress") == 0)
+    else if (command.compare("fanout") == 0) {
+        // fanout local-file remote-file server...; a server is host,
+        // host:port or [v6]:port, and is logged in to as this session is
+        if (!opened) {
+            cerr << "Not connected." << endl;
+            return DEFAULT;
+        } // end if (!opened)
+        
+        readPatterns("(local-file remote-file servers) ");
+        if (patterns.size() < 3) {
+            cerr << "usage: fanout local-file remote-file server..." << endl;
+            return DEFAULT;
+        } // end if (patterns.size() < 3)
+        param1 = patterns[0];
+        param2 = patterns[1];
+        patterns.erase(patterns.begin(), patterns.begin() + 2);
+        
+        return FANOUT;
+    } // end else if (command.compare("fanout") == 0)
+    else if (command.compare("transfer") == 0) {
+        // transfer remote-file server [new-name]; the file goes from this
+        // session's server to the other one without coming through here
+        if (!opened) {
+            cerr << "Not connected." << endl;
+            return DEFAULT;
+        } // end if (!opened)
+        
+        readPatterns("(remote-file server) ");
+        if (patterns.size() < 2 || patterns.size() > 3) {
+            cerr << "usage: transfer remote-file server [new-name]" << endl;
+            return DEFAULT;
+        } // end if (patterns.size() < 2 || ...)
+        param1 = patterns[0];
+        param2 = patterns.size() > 2 ? patterns[2] : patterns[0];
+        
+        return TRANSFER;
+    } // end else if (command.compare("transfer") == 0)
+    else if (command.compare("ascii") == 0) {
+        return ASCII;
+    } // end else if (command.compare("ascii") == 0)
+    else if (command.compare("binary") == 0) {
+        return BINARY;
+    } // end else if (command.compare("binary") == 0)
+    else if (command.compare("mirror") == 0) {
+        // mirror [-R] [-d] [-c] source [target]; -R sends the local tree
+        if (!opened) {
+            cerr << "Not connected." << endl;
+            return DEFAULT;
+        } // end if (!opened)
+        
+        readPatterns("(source) ");
+        options = "";
+        param1  = "";
+        param2  = "";
+        for (size_t i = 0; i < patterns.size(); ++i) {
+            if (patterns[i].length() > 1 && patterns[i].at(0) == '-') {
+                options.append(patterns[i].substr(1));
+            } // end if (patterns[i].length() > 1 && ...)
+            else if (param1.empty()) {
+                param1 = patterns[i];
+            } // end else if (param1.empty())
+            else {
+                param2 = patterns[i];
+            } // end else
+        } // end for (i < patterns.size())
+        
+        if (options.find_first_not_of("Rdc") != string::npos) {
+            cerr << "mirror: unknown option" << endl;
+            return DEFAULT;
+        } // end if (options.find_first_not_of(...) != npos)
+        if (param1.empty()) {
+            cerr << "mirror: missing source" << endl;
+            return DEFAULT;
+        } // end if (param1.empty())
+        if (param2.empty()) {
+            param2 = ListingCache::base(param1);
+        } // end if (param2.empty())
+        if (param2.empty() || param2 == "..") {
+            param2 = ".";
+        } // end if (param2.empty() || ...)
+        
+        return MIRROR;
+    } // end else if (command.compare("mirror") == 0)
     
     return UNKNOWN;
 } // end readInput()
@@ -229,8 +650,40 @@ int FtpFrontend::readInput() {
 
 // securely get user authentication after open()
 void FtpFrontend::authenticate(void) {
-    string reply, userString("<nullPtr>");
-    int    pid;
+    readUsername();
+    logIn();
+} // end authenticate()
+
+
+// takes over a session to this host left open by an earlier close, if the
+// user has one; true if the session is ready to use
+bool FtpFrontend::resume(void) {
+    if (!cache.holds(hostname, port)) {
+        return false;
+    } // end if (!cache.holds(...))
+    
+    readUsername();
+    if (!backend.ftpResume(hostname, port, username)) {
+        return false;
+    } // end if (!backend.ftpResume(...))
+    
+    opened   = true;
+    authed   = true;
+    password = passwords[username + "@" + hostname + ":" + port];
+    cout << "Reusing open session to " << hostname << "." << endl;
+    cout << backend.ftpPwd();
+    return true;
+} // end resume()
+
+
+// prompts for the user name to log in with, or looks it up in a batch run
+void FtpFrontend::readUsername(void) {
+    string userString("<nullPtr>");
+    
+    if (batch) {
+        credentials();
+        return;
+    } // end if (batch)
     
     if (getlogin() != NULL) {   // does not work on my computer...
         userString = getlogin();
@@ -238,6 +691,30 @@ void FtpFrontend::authenticate(void) {
     
     cout << "Name (" << hostname << ":" << userString << "): ";
     cin  >> username;
+} // end readUsername()
+
+
+// sends the user name, and a password if the server asks for one
+void FtpFrontend::logIn(void) {
+    string reply;
+    int    pid;
+    
+    // a batch run sends user and password in one round trip, with no echo
+    // to turn off
+    if (batch) {
+        authed = !username.empty()
+                 && backend.ftpLogin(username, password, "");
+        if (authed) {
+            cout << backend.lastReply().text;
+            passwords[username + "@" + hostname + ":" + port] = password;
+        } // end if (authed)
+        else {
+            cerr << "Login to " << hostname << " failed." << endl;
+        } // end else (!authed)
+        return;
+    } // end if (batch)
+    
+    password = "";
     reply = backend.ftpUser(username);
     cout << reply;
     
@@ -275,15 +752,294 @@ void FtpFrontend::authenticate(void) {
                 execlp("/bin/stty", "stty", "echo", NULL);
             } // end else ((pid = fork()) >= 0)
             
-            reply = backend.ftpPass(param1);
+            password = param1;
+            reply    = backend.ftpPass(password);
             cout << reply;
         } // end if (atoi(reply.at(0)) == FtpBackend::POS_INTER)
     
         // ensure authentication succeeded
         authed = atoi(&reply.at(0)) / 100 == FtpBackend::POS_COMPL;
+        if (authed) {
+            passwords[username + "@" + hostname + ":" + port] = password;
+        } // end if (authed)
     } catch (exception& e) {
         cerr << e.what() << endl;
         opened = false;
         authed = false;
     } // end try atoi()
-} // end authenticate()
+} // end logIn()
+
+
+// looks up the login for the host, first in FTP_USER and FTP_PASSWORD, then
+// in the machine or default entry of the netrc file; true if one was found
+bool FtpFrontend::credentials(void) {
+    const char *user = getenv("FTP_USER");
+    bool        matched = false, found = false;
+    string      token, value;
+    
+    username = "";
+    password = "";
+    if (user != NULL) {
+        username = user;
+        if (getenv("FTP_PASSWORD") != NULL) {
+            password = getenv("FTP_PASSWORD");
+        } // end if (getenv("FTP_PASSWORD") != NULL)
+        return true;
+    } // end if (user != NULL)
+    
+    ifstream file(netrc.c_str());
+    
+    while(file >> token) {
+        if (token.compare("machine") == 0 || token.compare("default") == 0) {
+            if (found) {
+                break;      // the entry for this host has ended
+            } // end if (found)
+            matched = token.compare("default") == 0
+                      || (file >> value && value.compare(hostname) == 0);
+        } // end if (token.compare("machine") == 0 || ...)
+        else if (token.compare("macdef") == 0) {
+            // a macro runs to the next blank line
+            getline(file, value);
+            while(getline(file, value) && !value.empty());
+        } // end else if (token.compare("macdef") == 0)
+        else if (file >> value && matched) {
+            if (token.compare("login") == 0) {
+                username = value;
+                found    = true;
+            } // end if (token.compare("login") == 0)
+            else if (token.compare("password") == 0) {
+                password = value;
+                found    = true;
+            } // end else if (token.compare("password") == 0)
+        } // end else if (file >> value && matched)
+    } // end while(file >> token)
+    
+    if (username.empty()) {
+        cerr << "No login for " << hostname << " in the environment or "
+             << netrc << "." << endl;
+    } // end if (username.empty())
+    return !username.empty();
+} // end credentials()
+
+
+// prompts for a missing argument; a batch run has no one to ask
+bool FtpFrontend::ask(const char *prompt, string& value) {
+    if (batch) {
+        cerr << command << ": missing argument" << endl;
+        return false;
+    } // end if (batch)
+    
+    cout << prompt;
+    cin  >> value;
+    return true;
+} // end ask(const char*, string&)
+
+
+// reads the rest of the line as whitespace-separated file name patterns
+void FtpFrontend::readPatterns(const char *prompt) {
+    string line, pattern;
+    
+    patterns.clear();
+    getline(cin, line);
+    
+    if (line.find_first_not_of(" \t") == string::npos) {
+        if (batch) {
+            cerr << command << ": missing argument" << endl;
+            return;
+        } // end if (batch)
+        cout << prompt;
+        getline(cin, line);
+    } // end if (line.find_first_not_of(...) == string::npos)
+    
+    istringstream words(line);
+    while(words >> pattern) {
+        patterns.push_back(pattern);
+    } // end while(words >> pattern)
+} // end readPatterns(const char*)
+
+
+// expands the patterns into jobs and moves them over a pool of sessions;
+// true if every file was moved
+bool FtpFrontend::transferBatch(bool upload) {
+    vector<TransferJob> jobs;
+    TransferJob         job;
+    
+    job.upload = upload;
+    job.offset = 0;
+    job.length = -1;
+    
+    if (upload) {
+        glob_t found;
+        
+        for (size_t i = 0; i < patterns.size(); ++i) {
+            if (glob(patterns[i].c_str(), 0, NULL, &found) != 0) {
+                cerr << "local: " << patterns[i] << ": no match" << endl;
+                continue;
+            } // end if (glob(...) != 0)
+            for (size_t j = 0; j < found.gl_pathc; ++j) {
+                struct stat info;
+                
+                if (stat(found.gl_pathv[j], &info) == 0
+                        && S_ISREG(info.st_mode)) {
+                    job.source = found.gl_pathv[j];
+                    job.target = job.source.substr(job.source.rfind('/') + 1);
+                    jobs.push_back(job);
+                } // end if (stat(...) == 0 && ...)
+            } // end for (j < found.gl_pathc)
+            globfree(&found);
+        } // end for (i < patterns.size())
+    } // end if (upload)
+    else {
+        vector<string> names;
+        
+        backend.ftpNlst(names);
+        for (size_t i = 0; i < names.size(); ++i) {
+            for (size_t j = 0; j < patterns.size(); ++j) {
+                if (fnmatch(patterns[j].c_str(), names[i].c_str(), 0) == 0) {
+                    job.source = names[i];
+                    job.target = job.source.substr(job.source.rfind('/') + 1);
+                    jobs.push_back(job);
+                    break;
+                } // end if (fnmatch(...) == 0)
+            } // end for (j < patterns.size())
+        } // end for (i < names.size())
+    } // end else (!upload)
+    
+    if (jobs.empty()) {
+        cerr << "No files matched." << endl;
+        return false;
+    } // end if (jobs.empty())
+    
+    TransferScheduler scheduler(hostname, port, username, password,
+                                backend.workingDirectory(), &cache,
+                                &limiter);
+    int wanted = (size_t)sessions < jobs.size() ? sessions : jobs.size();
+    
+    scheduler.setVerify(verify);
+    scheduler.setCompression(compress);
+    scheduler.setAscii(ascii);
+    if (scheduler.open(wanted) < 1) {
+        cerr << "Could not open any transfer sessions." << endl;
+        return false;
+    } // end if (scheduler.open(...) < 1)
+    
+    return scheduler.run(jobs) == 0;
+} // end transferBatch(bool)
+
+
+// downloads one file in segments over a pool of sessions; true if it all
+// arrived
+bool FtpFrontend::getSegmented(void) {
+    TransferScheduler scheduler(hostname, port, username, password,
+                                backend.workingDirectory(), &cache,
+                                &limiter);
+    
+    if (scheduler.open(sessions) < 1) {
+        cerr << "Could not open any transfer sessions." << endl;
+        return false;
+    } // end if (scheduler.open(...) < 1)
+    
+    return scheduler.getSegmented(param1, param2);
+} // end getSegmented()
+
+
+// brings the target tree in step with the source tree, moving only new and
+// changed files over a pool of sessions; true if nothing failed
+bool FtpFrontend::mirror(void) {
+    bool   upload = options.find('R') != string::npos;
+    Mirror tree(backend, upload ? param2 : param1, upload ? param1 : param2,
+                upload, options.find('d') != string::npos,
+                options.find('c') != string::npos);
+    vector<TransferJob> jobs;
+    
+    cout << tree.scan(jobs);
+    if (!jobs.empty()) {
+        TransferScheduler scheduler(hostname, port, username, password,
+                                    backend.workingDirectory(), &cache,
+                                    &limiter);
+        int wanted = (size_t)sessions < jobs.size() ? sessions : jobs.size();
+        
+        scheduler.setVerify(verify);
+        scheduler.setCompression(compress);
+        if (scheduler.open(wanted) < 1) {
+            cerr << "Could not open any transfer sessions." << endl;
+        } // end if (scheduler.open(...) < 1)
+        else {
+            scheduler.run(jobs);
+        } // end else
+    } // end if (!jobs.empty())
+    cout << tree.finish(jobs);
+    
+    return tree.failures() == 0;
+} // end mirror()
+
+
+// uploads one local file to several servers at once, reading it once;
+// true if every server got it
+bool FtpFrontend::fanOut(void) {
+    FanOut spread(username, password, &cache, &limiter);
+    
+    spread.setVerify(verify);
+    if (spread.open(patterns) < 1) {
+        cerr << "Could not log in to any of the servers." << endl;
+    } // end if (spread.open(...) < 1)
+    
+    return spread.put(param1, param2) == 0;
+} // end fanOut()
+
+
+// copies a remote file to another server, logged in to as this session is,
+// with the data going between the two servers; true if it arrived
+bool FtpFrontend::relay(void) {
+    FtpBackend target;
+    string     host, service("21");
+    string     reply;
+    
+    Connector::split(patterns[1], host, service);
+    target.setSessionCache(&cache);
+    target.setRateLimiter(&limiter);
+    if (!target.ftpResume(host, service, username)) {
+        reply = target.ftpOpen(host, service);
+        cout << reply;
+        if (reply.empty() || reply.at(0) != '2') {
+            return false;
+        } // end if (reply.empty() || ...)
+        
+        if (!target.ftpLogin(username, password, "")) {
+            target.ftpQuit();
+            return false;
+        } // end if (!target.ftpLogin(...))
+    } // end if (!target.ftpResume(...))
+    
+    cout << backend.ftpRelay(param1, target, param2);
+    cout << target.ftpClose();
+    
+    return backend.lastTransfer().code / 100 == FtpBackend::POS_COMPL;
+} // end relay()
+
+
+// prints a parsed listing, one entry per line: type, size, modification
+// time in UTC and name
+void FtpFrontend::showListing(const ListingCache::Listing& entries) {
+    static const char TYPES[] = "-dl?";     // by RemoteEntry::kind
+    
+    for (size_t i = 0; i < entries.size(); ++i) {
+        const RemoteEntry& entry = entries[i];
+        char      stamp[20] = "-";
+        struct tm when;
+        
+        if (entry.modified >= 0
+                && gmtime_r(&entry.modified, &when) != NULL) {
+            strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M", &when);
+        } // end if (entry.modified >= 0 && ...)
+        cout << TYPES[entry.type] << " " << setw(14);
+        if (entry.size >= 0) {
+            cout << entry.size;
+        } // end if (entry.size >= 0)
+        else {
+            cout << "-";
+        } // end else (entry.size < 0)
+        cout << "  " << setw(16) << left << stamp << right << "  "
+             << entry.name << endl;
+    } // end for (i < entries.size())
+} // end showListing(const ListingCache::Listing&)
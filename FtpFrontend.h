@@ -9,30 +9,82 @@
 #ifndef FTPFRONTEND_H
 #define	FTPFRONTEND_H
 
+#include <sys/wait.h>       // for wait
+#include <fnmatch.h>        // fnmatch
+#include <glob.h>           // glob
 #include <stdio.h>
+#include <stdlib.h>         // getenv
 #include <unistd.h>
 #include <cstring>
+#include <fstream>
+#include <iomanip>          // setw
 #include <iostream>
+#include <map>
+#include <sstream>
 #include <string>
+#include <vector>
+#include "FanOut.h"
 #include "FtpBackend.h"
+#include "Mirror.h"
+#include "RateLimiter.h"
+#include "SessionCache.h"
+#include "TransferScheduler.h"
 
 using namespace std;
 
 
 class FtpFrontend {
 public:
+    // exit status of a batch run
+    static const int EXIT_OK       = 0,     // every command succeeded
+                     EXIT_FAILED   = 1,     // at least one command failed
+                     EXIT_NO_LOGIN = 2;     // could not connect or log in
     FtpFrontend();
     FtpFrontend(char *host);
-    void run(void);
+    void setBatch(string netrc, bool stopOnError);
+    bool open(string host, string portNum);
+    int  run(void);
 private:
+    static const int DEF_SESSIONS = 4;
     const  string PROMPT;
-    enum   action {OPEN, CD, LS, GET, PUT, CLOSE, QUIT, UNKNOWN, DEFAULT};
+    enum   action {OPEN, CD, LS, GET, PUT, REGET, REPUT, MGET, MPUT, PGET,
+                   PARALLEL, CLOSE, QUIT, PIPELINE, ZEROCOPY, DISKWRITER,
+                   STATS, PROGRESS, STATSLOG, RATE, VERIFY, COMPRESS,
+                   MLSD, MIRROR, ASCII, BINARY, FANOUT, TRANSFER, UNKNOWN,
+                   DEFAULT};
     bool   opened, authed;
-    string command, hostname, username, param1, param2;
+    bool   progress;        // draw a progress bar during transfers
+    bool   batch;           // no prompts; credentials from env or netrc
+    bool   stopOnError;     // end a batch run at its first failure
+    int    status;          // exit status of a batch run
+    string netrc;           // file of machine, login and password entries
+    int    sessions;        // control sessions used by mget, mput and pget
+    Checksum::kind verify;  // checksum gets and puts are checked with
+    bool   compress;        // MODE Z on servers that offer it
+    bool   ascii;           // get and put in TYPE A, not TYPE I
+    string command, hostname, port, username, password, param1, param2;
+    vector<string> patterns;    // file name patterns for mget and mput
+    string options;         // option letters given to mirror
+    map<string, string> passwords;  // by "user@host:port", for pooled logins
+    SessionCache cache;     // sessions kept open across close and open
+    RateLimiter limiter;    // bandwidth shared by every transfer
     FtpBackend backend;     // handle all server communication
     
     int readInput(void);
+    void readPatterns(const char *prompt);
+    void watch(void);
+    bool resume(void);
     void authenticate(void);
+    void readUsername(void);
+    void logIn(void);
+    bool credentials(void);
+    bool ask(const char *prompt, string& value);
+    bool transferBatch(bool upload);
+    bool getSegmented(void);
+    bool mirror(void);
+    bool fanOut(void);
+    bool relay(void);
+    void showListing(const ListingCache::Listing& entries);
 }; // end class FtpFrontend
 
 #endif	/* FTPFRONTEND_H */
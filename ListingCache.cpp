@@ -0,0 +1,290 @@
+/*
+ * @file   ListingCache.cpp
+ * @brief  Remote directory listings parsed into name, size, modification
+ *          time and type, and kept per directory so that questions about the
+ *          remote tree are answered without listing it again. MLSD and MLST
+ *          replies are parsed as RFC 3659 lays them out; Unix LIST output is
+ *          understood for servers that have neither.
+ * @author Brendan Sweeney, ID #1161836
+ * @date   December 13, 2012
+ */
+
+#include "ListingCache.h"
+
+
+// the cached listing of a directory, or NULL if it has none
+const ListingCache::Listing *ListingCache::find(
+        const string& directory) const {
+    map<string, Listing>::const_iterator it = listings.find(directory);
+
+    return it == listings.end() ? NULL : &it->second;
+} // end find(const string&)
+
+
+// an entry of a cached directory; NULL if the directory is not cached or
+// has no such entry
+const RemoteEntry *ListingCache::find(const string& directory,
+                                      const string& name) const {
+    const Listing *entries = find(directory);
+    RemoteEntry    key;
+
+    if (entries == NULL) {
+        return NULL;
+    } // end if (entries == NULL)
+
+    key.name = name;
+    Listing::const_iterator it = lower_bound(entries->begin(),
+                                             entries->end(), key, byName);
+
+    return it == entries->end() || it->name != name ? NULL : &*it;
+} // end find(const string&, const string&)
+
+
+// takes over a freshly parsed listing, leaving entries empty
+const ListingCache::Listing& ListingCache::store(const string& directory,
+                                                 Listing& entries) {
+    Listing& kept = listings[directory];
+
+    kept.swap(entries);
+    entries.clear();
+    sort(kept.begin(), kept.end(), byName);
+    return kept;
+} // end store(const string&, Listing&)
+
+
+// forgets a directory whose contents have changed
+void ListingCache::invalidate(const string& directory) {
+    listings.erase(directory);
+} // end invalidate(const string&)
+
+
+// forgets every directory, as on a new connection
+void ListingCache::clear(void) {
+    listings.clear();
+} // end clear()
+
+
+// true if nothing is cached
+bool ListingCache::empty(void) const {
+    return listings.empty();
+} // end empty()
+
+
+// parses MLSD output, one entry per line; the directory itself and its
+// parent are left out
+void ListingCache::parseMlsd(const string& text, Listing& entries) {
+    istringstream lines(text);
+    string        line;
+    RemoteEntry   entry;
+
+    while(getline(lines, line)) {
+        if (parseFacts(line, entry)) {
+            entries.push_back(entry);
+        } // end if (parseFacts(...))
+    } // end while(getline(lines, line))
+} // end parseMlsd(const string&, Listing&)
+
+
+// parses one "fact=value;fact=value; name" line of MLSD or MLST; false
+// for a line that is not one, or names the directory or its parent
+bool ListingCache::parseFacts(const string& line, RemoteEntry& entry) {
+    size_t space = line.find(' ');
+    size_t end   = line.find_last_not_of("\r\n");
+
+    if (space == string::npos || end == string::npos || end <= space) {
+        return false;
+    } // end if (space == string::npos || ...)
+
+    entry.name     = line.substr(space + 1, end - space);
+    entry.size     = -1;
+    entry.modified = -1;
+    entry.type     = RemoteEntry::OTHER;
+
+    istringstream facts(line.substr(0, space));
+    string        fact;
+
+    while(getline(facts, fact, ';')) {
+        size_t equals = fact.find('=');
+
+        if (equals == string::npos) {
+            continue;
+        } // end if (equals == string::npos)
+        for (size_t i = 0; i < fact.length(); ++i) {
+            fact.at(i) = tolower(fact.at(i));
+        } // end for (i < fact.length())
+
+        string name(fact.substr(0, equals));
+        string value(fact.substr(equals + 1));
+
+        if (name == "type") {
+            if (value == "cdir" || value == "pdir") {
+                return false;
+            } // end if (value == "cdir" || ...)
+            if (value == "file") {
+                entry.type = RemoteEntry::REGULAR;
+            } // end if (value == "file")
+            else if (value == "dir") {
+                entry.type = RemoteEntry::DIRECTORY;
+            } // end else if (value == "dir")
+            else if (value.find("slink") != string::npos
+                     || value.find("symlink") != string::npos) {
+                entry.type = RemoteEntry::SYMLINK;
+            } // end else if (value.find(...) != npos || ...)
+        } // end if (name == "type")
+        else if (name == "size" || name == "sizd") {
+            entry.size = atoll(value.c_str());
+        } // end else if (name == "size" || ...)
+        else if (name == "modify") {
+            entry.modified = parseTime(value);
+        } // end else if (name == "modify")
+    } // end while(getline(facts, fact, ';'))
+
+    return true;
+} // end parseFacts(const string&, RemoteEntry&)
+
+
+// parses Unix "ls -l" style LIST output; lines in any other layout are
+// skipped, and a time without a year is taken to be within the last year
+void ListingCache::parseList(const string& text, Listing& entries) {
+    static const char MONTHS[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+    istringstream lines(text);
+    string        line;
+    time_t        now = time(NULL);
+
+    while(getline(lines, line)) {
+        istringstream fields(line);
+        string        perms, links, owner, group, month, day, clock;
+        RemoteEntry   entry;
+        struct tm     when;
+        const char   *named;
+
+        if (!(fields >> perms >> links >> owner >> group >> entry.size
+                     >> month >> day >> clock)
+                || perms.length() < 10 || month.length() != 3
+                || (named = strstr(MONTHS, month.c_str())) == NULL
+                || (named - MONTHS) % 3 != 0) {
+            continue;
+        } // end if (!(fields >> ...) || ...)
+        getline(fields, entry.name);
+        entry.name.erase(0, entry.name.find_first_not_of(' '));
+        entry.name.erase(entry.name.find_last_not_of("\r") + 1);
+
+        switch (perms.at(0)) {
+            case '-':
+                entry.type = RemoteEntry::REGULAR;
+                break;
+            case 'd':
+                entry.type = RemoteEntry::DIRECTORY;
+                break;
+            case 'l':
+                entry.type = RemoteEntry::SYMLINK;
+                entry.name.erase(entry.name.find(" -> ") == string::npos
+                                 ? entry.name.length()
+                                 : entry.name.find(" -> "));
+                break;
+            default:
+                entry.type = RemoteEntry::OTHER;
+                break;
+        } // end switch (perms.at(0))
+        if (entry.name.empty() || entry.name == "." || entry.name == "..") {
+            continue;
+        } // end if (entry.name.empty() || ...)
+
+        memset(&when, 0, sizeof(when));
+        gmtime_r(&now, &when);
+        when.tm_mon  = (named - MONTHS) / 3;
+        when.tm_mday = atoi(day.c_str());
+        when.tm_sec  = 0;
+        if (clock.find(':') != string::npos) {
+            when.tm_hour = atoi(clock.c_str());
+            when.tm_min  = atoi(clock.c_str() + clock.find(':') + 1);
+            // a time is only shown for the last six months or so
+            if (timegm(&when) > now + 86400) {
+                --when.tm_year;
+            } // end if (timegm(&when) > now + 86400)
+        } // end if (clock.find(':') != string::npos)
+        else {
+            when.tm_year = atoi(clock.c_str()) - 1900;
+            when.tm_hour = when.tm_min = 0;
+        } // end else
+        entry.modified = timegm(&when);
+
+        entries.push_back(entry);
+    } // end while(getline(lines, line))
+} // end parseList(const string&, Listing&)
+
+
+// converts an MLSD time, YYYYMMDDHHMMSS with optional fractions, in UTC;
+// -1 if it is not one
+time_t ListingCache::parseTime(const string& stamp) {
+    struct tm when;
+
+    if (stamp.length() < 14) {
+        return -1;
+    } // end if (stamp.length() < 14)
+    for (int i = 0; i < 14; ++i) {
+        if (!isdigit(stamp.at(i))) {
+            return -1;
+        } // end if (!isdigit(stamp.at(i)))
+    } // end for (i < 14)
+
+    memset(&when, 0, sizeof(when));
+    when.tm_year = atoi(stamp.substr(0, 4).c_str()) - 1900;
+    when.tm_mon  = atoi(stamp.substr(4, 2).c_str()) - 1;
+    when.tm_mday = atoi(stamp.substr(6, 2).c_str());
+    when.tm_hour = atoi(stamp.substr(8, 2).c_str());
+    when.tm_min  = atoi(stamp.substr(10, 2).c_str());
+    when.tm_sec  = atoi(stamp.substr(12, 2).c_str());
+
+    return timegm(&when);
+} // end parseTime(const string&)
+
+
+// resolves a path against a directory, as the server would without
+// symbolic links: "." is dropped, ".." removes a component, and the result
+// is absolute with no trailing slash
+string ListingCache::join(const string& directory, const string& path) {
+    vector<string> parts;
+    istringstream  names((path.empty() || path.at(0) != '/'
+                          ? directory + "/" : string("")) + path);
+    string         name, joined;
+
+    while(getline(names, name, '/')) {
+        if (name == "..") {
+            if (!parts.empty()) {
+                parts.pop_back();
+            } // end if (!parts.empty())
+        } // end if (name == "..")
+        else if (!name.empty() && name != ".") {
+            parts.push_back(name);
+        } // end else if (!name.empty() && ...)
+    } // end while(getline(names, name, '/'))
+
+    for (size_t i = 0; i < parts.size(); ++i) {
+        joined += "/" + parts[i];
+    } // end for (i < parts.size())
+
+    return joined.empty() ? "/" : joined;
+} // end join(const string&, const string&)
+
+
+// the directory an absolute path is in
+string ListingCache::parent(const string& path) {
+    size_t slash = path.rfind('/');
+
+    return slash == string::npos || slash == 0 ? "/" : path.substr(0, slash);
+} // end parent(const string&)
+
+
+// the last component of a path
+string ListingCache::base(const string& path) {
+    size_t slash = path.rfind('/');
+
+    return slash == string::npos ? path : path.substr(slash + 1);
+} // end base(const string&)
+
+
+// orders entries for lower_bound()
+bool ListingCache::byName(const RemoteEntry& a, const RemoteEntry& b) {
+    return a.name < b.name;
+} // end byName(const RemoteEntry&, const RemoteEntry&)
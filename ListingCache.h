@@ -0,0 +1,61 @@
+/*
+ * @file   ListingCache.h
+ * @brief  Remote directory listings parsed into name, size, modification
+ *          time and type, and kept per directory so that questions about the
+ *          remote tree are answered without listing it again. MLSD and MLST
+ *          replies are parsed as RFC 3659 lays them out; Unix LIST output is
+ *          understood for servers that have neither.
+ * @author Brendan Sweeney, ID #1161836
+ * @date   December 13, 2012
+ */
+
+#ifndef LISTINGCACHE_H
+#define	LISTINGCACHE_H
+
+#include <ctype.h>          // isdigit, tolower
+#include <stdlib.h>         // atoi, atoll
+#include <string.h>         // memset
+#include <time.h>           // time_t, timegm, gmtime_r
+#include <algorithm>        // sort, lower_bound
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+
+// one entry of a remote directory
+struct RemoteEntry {
+    enum kind {REGULAR, DIRECTORY, SYMLINK, OTHER};
+    string    name;         // name within its directory
+    long long size;         // bytes, or -1 if the server did not say
+    time_t    modified;     // last modification in UTC, or -1
+    kind      type;         // what the entry is
+};
+
+
+class ListingCache {
+public:
+    typedef vector<RemoteEntry> Listing;    // sorted by name
+    const Listing     *find(const string& directory) const;
+    const RemoteEntry *find(const string& directory,
+                            const string& name) const;
+    const Listing&     store(const string& directory, Listing& entries);
+    void   invalidate(const string& directory);
+    void   clear(void);
+    bool   empty(void) const;
+    static void   parseMlsd(const string& text, Listing& entries);
+    static bool   parseFacts(const string& line, RemoteEntry& entry);
+    static void   parseList(const string& text, Listing& entries);
+    static time_t parseTime(const string& stamp);
+    static string join(const string& directory, const string& path);
+    static string parent(const string& path);
+    static string base(const string& path);
+private:
+    map<string, Listing> listings;  // by absolute directory path
+
+    static bool byName(const RemoteEntry& a, const RemoteEntry& b);
+}; // end class ListingCache
+
+#endif	/* LISTINGCACHE_H */
@@ -0,0 +1,528 @@
+/*
+ * @file   Mirror.cpp
+ * @brief  Keeps a local directory tree in step with a remote one, or a
+ *          remote tree with a local one. Both trees are walked together, and
+ *          each file is compared by size and modification time, and by
+ *          checksum when asked, against a state file kept in the local tree,
+ *          so that only new and changed files are transferred. Files missing
+ *          from the source side can be deleted from the other.
+ * @author Brendan Sweeney, ID #1161836
+ * @date   December 13, 2012
+ */
+
+#include "Mirror.h"
+
+
+const char Mirror::STATE_FILE[] = ".ftpmirror";
+
+
+Mirror::Mirror(FtpBackend& backend, string remote, string local,
+               bool upload, bool deletes, bool checksums)
+               : backend(backend), localRoot(local), upload(upload),
+                 deletes(deletes), checksums(checksums), unchanged(0),
+                 failed(0) {
+    string cwd(backend.workingDirectory());
+
+    remoteRoot = ListingCache::join(cwd.empty() ? "/" : cwd, remote);
+    while(localRoot.length() > 1
+            && localRoot.at(localRoot.length() - 1) == '/') {
+        localRoot.erase(localRoot.length() - 1);
+    } // end while(localRoot.length() > 1 && ...)
+    if (localRoot.empty()) {
+        localRoot = ".";
+    } // end if (localRoot.empty())
+} // end constructor
+
+
+// walks both trees, creating the directories the target lacks, and adds a
+// job for every file that is new or changed on the source side
+string Mirror::scan(vector<TransferJob>& jobs) {
+    ostringstream message;
+    size_t        first = jobs.size();
+    struct stat   info;
+
+    // an empty source would otherwise look like everything was deleted
+    if (upload && (stat(localRoot.c_str(), &info) != 0
+                   || !S_ISDIR(info.st_mode))) {
+        ++failed;
+        return localRoot + ": not a directory\n";
+    } // end if (upload && ...)
+
+    load();
+    walk("", false);
+
+    for (size_t i = first; i < paths.size(); ++i) {
+        TransferJob job;
+
+        job.source = upload ? localPath(paths[i]) : remotePath(paths[i]);
+        job.target = upload ? remotePath(paths[i]) : localPath(paths[i]);
+        job.upload = upload;
+        job.offset = 0;
+        job.length = -1;
+        job.done   = false;
+        jobs.push_back(job);
+    } // end for (i < paths.size())
+
+    message << (upload ? localRoot : remoteRoot) << " -> "
+            << (upload ? remoteRoot : localRoot) << ": "
+            << paths.size() << " to transfer, " << unchanged
+            << " unchanged, " << doomed.size() << " to delete" << endl;
+    return message.str();
+} // end scan(vector<TransferJob>&)
+
+
+// records the files that arrived, applies deletions, and saves the state
+// for the next run
+string Mirror::finish(vector<TransferJob>& jobs) {
+    ostringstream message;
+    int           moved   = 0;
+    int           removed = 0;
+
+    for (size_t i = 0; i < paths.size() && i < jobs.size(); ++i) {
+        string      local(localPath(paths[i]));
+        struct stat info;
+        Record      record;
+
+        if (!jobs[i].done) {
+            ++failed;
+            continue;
+        } // end if (!jobs[i].done)
+        ++moved;
+
+        // a download takes the remote time so the next run can compare
+        if (!upload && remotes[i].modified >= 0) {
+            struct timeval times[2];
+
+            times[0].tv_sec  = times[1].tv_sec  = remotes[i].modified;
+            times[0].tv_usec = times[1].tv_usec = 0;
+            utimes(local.c_str(), times);
+        } // end if (!upload && ...)
+        if (stat(local.c_str(), &info) != 0) {
+            continue;
+        } // end if (stat(...) != 0)
+
+        record.localSize  = info.st_size;
+        record.localTime  = info.st_mtime;
+        record.remoteSize = upload ? info.st_size : remotes[i].size;
+        record.remoteTime = upload ? -1 : remotes[i].modified;
+        if (checksums) {
+            Checksum::kind algorithm;
+            string         theirs;
+
+            backend.ftpChecksum(remotePath(paths[i]), algorithm, theirs);
+            if (!theirs.empty()) {
+                string ours(localSum(local, algorithm));
+
+                if (ours != theirs) {
+                    message << paths[i] << ": " << Checksum::name(algorithm)
+                            << " MISMATCH after transfer" << endl;
+                    ++failed;
+                    continue;
+                } // end if (ours != theirs)
+                record.sum = Checksum::name(algorithm) + ":" + ours;
+            } // end if (!theirs.empty())
+        } // end if (checksums)
+        current[paths[i]] = record;
+        if (upload) {
+            backend.invalidate(ListingCache::parent(remotePath(paths[i])));
+        } // end if (upload)
+    } // end for (i < paths.size() && ...)
+
+    // children were doomed before their directories
+    for (size_t i = 0; i < doomed.size(); ++i) {
+        string path(doomed[i].first);
+        bool   ok;
+
+        if (upload) {
+            if (doomed[i].second) {
+                backend.ftpRmdir(remotePath(path));
+            } // end if (doomed[i].second)
+            else {
+                backend.ftpDelete(remotePath(path));
+            } // end else (!doomed[i].second)
+            ok = backend.lastReply().code / 100 == FtpBackend::POS_COMPL;
+        } // end if (upload)
+        else {
+            string local(localPath(path));
+
+            ok = (doomed[i].second ? rmdir(local.c_str())
+                                   : unlink(local.c_str())) == 0;
+        } // end else (!upload)
+
+        if (ok) {
+            ++removed;
+            message << "deleted " << path << endl;
+        } // end if (ok)
+        else {
+            ++failed;
+            message << path << ": could not delete" << endl;
+        } // end else (!ok)
+    } // end for (i < doomed.size())
+
+    // with nothing to record and nothing recorded before, leave no state
+    if ((!current.empty() || !previous.empty()) && !save()) {
+        ++failed;
+        message << localPath(STATE_FILE) << ": could not save state" << endl;
+    } // end if ((!current.empty() || ...) && !save())
+
+    message << moved << " transferred, " << unchanged << " unchanged, "
+            << removed << " deleted";
+    if (failed > 0) {
+        message << ", " << failed << " failed";
+    } // end if (failed > 0)
+    message << endl;
+
+    return message.str();
+} // end finish(vector<TransferJob>&)
+
+
+// transfers, deletions and listings that did not succeed
+int Mirror::failures(void) const {
+    return failed;
+} // end failures()
+
+
+// compares one directory of both trees, recursing into subdirectories;
+// created is set when the target directory was just made, so is empty
+void Mirror::walk(const string& path, bool created) {
+    const ListingCache::Listing *listed = NULL;
+    ListingCache::Listing        none;
+    vector<Local>                locals;
+    string                       remote(remotePath(path));
+    string                       local(localPath(path));
+
+    if (!(created && upload)) {
+        backend.ftpMlsd(remote, listed);
+    } // end if (!(created && upload))
+    if (listed == NULL && path.empty() && upload) {
+        // the remote root may not exist yet
+        backend.ftpMkdir(remote);
+        created = backend.lastReply().code / 100 == FtpBackend::POS_COMPL;
+    } // end if (listed == NULL && ...)
+    if (listed == NULL && !(created && upload)) {
+        cerr << remote << ": could not list" << endl;
+        ++failed;
+        return;
+    } // end if (listed == NULL && ...)
+    if (listed == NULL) {
+        listed = &none;
+    } // end if (listed == NULL)
+
+    if (path.empty() && !upload && mkdir(local.c_str(), 0755) == 0) {
+        created = true;
+    } // end if (path.empty() && ...)
+    if (!(created && !upload)) {
+        readLocal(local, locals);
+    } // end if (!(created && !upload))
+
+    // copy the listing, as creating a remote directory below invalidates it
+    ListingCache::Listing entries(*listed);
+    size_t r = 0, l = 0;
+
+    while(r < entries.size() || l < locals.size()) {
+        int order = r == entries.size() ? 1
+                  : l == locals.size() ? -1
+                  : entries[r].name.compare(locals[l].name);
+        const RemoteEntry *there = order <= 0 ? &entries[r] : NULL;
+        const Local       *here  = order >= 0 ? &locals[l] : NULL;
+        string name(there != NULL ? there->name : here->name);
+        string child(path.empty() ? name : path + "/" + name);
+
+        r += order <= 0 ? 1 : 0;
+        l += order >= 0 ? 1 : 0;
+        // the state file and any temporary copy of it stay local
+        if (path.empty()
+                && name.compare(0, sizeof(STATE_FILE) - 1, STATE_FILE) == 0) {
+            continue;
+        } // end if (path.empty() && ...)
+        // only files and directories are mirrored
+        if (there != NULL && there->type != RemoteEntry::REGULAR
+                && there->type != RemoteEntry::DIRECTORY) {
+            there = NULL;
+            if (here == NULL) {
+                continue;
+            } // end if (here == NULL)
+        } // end if (there != NULL && ...)
+
+        bool   isSource = upload ? here != NULL : there != NULL;
+        bool   isTarget = upload ? there != NULL : here != NULL;
+        bool   sourceDir = upload ? (here != NULL && here->directory)
+                                  : (there != NULL
+                                     && there->type == RemoteEntry::DIRECTORY);
+        bool   targetDir = upload ? (there != NULL
+                                     && there->type == RemoteEntry::DIRECTORY)
+                                  : (here != NULL && here->directory);
+
+        if (!isSource) {
+            if (deletes) {
+                doom(child, targetDir, upload);
+            } // end if (deletes)
+            continue;
+        } // end if (!isSource)
+        if (isTarget && sourceDir != targetDir) {
+            cerr << child << ": a file on one side and a directory on the "
+                 << "other; skipped" << endl;
+            ++failed;
+            continue;
+        } // end if (isTarget && ...)
+
+        if (sourceDir) {
+            bool made = false;
+
+            if (!isTarget && upload) {
+                backend.ftpMkdir(remotePath(child));
+                made = backend.lastReply().code / 100
+                       == FtpBackend::POS_COMPL;
+            } // end if (!isTarget && upload)
+            else if (!isTarget) {
+                made = mkdir(localPath(child).c_str(), 0755) == 0;
+            } // end else if (!isTarget)
+            if (!isTarget && !made) {
+                cerr << child << ": could not create directory" << endl;
+                ++failed;
+                continue;
+            } // end if (!isTarget && !made)
+            walk(child, made);
+            continue;
+        } // end if (sourceDir)
+
+        RemoteEntry entry;
+        Record      record;
+
+        if (there != NULL) {
+            entry = *there;
+        } // end if (there != NULL)
+        else {
+            entry.name     = name;
+            entry.size     = -1;
+            entry.modified = -1;
+            entry.type     = RemoteEntry::REGULAR;
+        } // end else (there == NULL)
+
+        if (isTarget && same(child, entry, *here, record)) {
+            current[child] = record;
+            ++unchanged;
+            continue;
+        } // end if (isTarget && ...)
+        paths.push_back(child);
+        remotes.push_back(entry);
+    } // end while(r < entries.size() || ...)
+} // end walk(const string&, bool)
+
+
+// true if a file present on both sides is still as it was when last in
+// step, filling in the record to keep for it
+bool Mirror::same(const string& path, const RemoteEntry& remote,
+                  const Local& local, Record& record) {
+    map<string, Record>::iterator was = previous.find(path);
+    bool                          alike;
+
+    if (was != previous.end()) {
+        const Record& last = was->second;
+
+        // an upload leaves the remote time to the server, so only its size
+        // tells whether someone else has changed the remote copy
+        alike = last.localSize == local.size
+                && last.localTime == local.modified
+                && last.remoteSize == remote.size
+                && (upload || last.remoteTime == remote.modified);
+        record = last;
+    } // end if (was != previous.end())
+    else {
+        // never mirrored: matching sizes, and times as a mirror leaves them
+        alike = local.size == remote.size && remote.modified >= 0
+                && (upload ? local.modified <= remote.modified
+                           : local.modified == remote.modified);
+        record.sum = "";
+    } // end else (was == previous.end())
+    record.localSize  = local.size;
+    record.localTime  = local.modified;
+    record.remoteSize = remote.size;
+    record.remoteTime = upload && was != previous.end() ? record.remoteTime
+                                                        : remote.modified;
+
+    if (alike && checksums) {
+        Checksum::kind algorithm;
+        string         theirs;
+
+        backend.ftpChecksum(remotePath(path), algorithm, theirs);
+        if (!theirs.empty()) {
+            string name(Checksum::name(algorithm) + ":");
+            string ours(record.sum.compare(0, name.length(), name) == 0
+                        ? record.sum.substr(name.length())
+                        : localSum(localPath(path), algorithm));
+
+            alike      = ours == theirs;
+            record.sum = name + theirs;
+        } // end if (!theirs.empty())
+    } // end if (alike && checksums)
+
+    return alike;
+} // end same(const string&, const RemoteEntry&, const Local&, Record&)
+
+
+// queues a target path the source no longer has for deletion, contents
+// first; remote is set when the path is on the server
+void Mirror::doom(const string& path, bool directory, bool remote) {
+    if (directory && remote) {
+        const ListingCache::Listing *listed;
+
+        backend.ftpMlsd(remotePath(path), listed);
+        if (listed == NULL) {
+            ++failed;
+            return;
+        } // end if (listed == NULL)
+
+        ListingCache::Listing entries(*listed);
+
+        for (size_t i = 0; i < entries.size(); ++i) {
+            doom(path + "/" + entries[i].name,
+                 entries[i].type == RemoteEntry::DIRECTORY, remote);
+        } // end for (i < entries.size())
+    } // end if (directory && remote)
+    else if (directory) {
+        vector<Local> entries;
+
+        readLocal(localPath(path), entries);
+        for (size_t i = 0; i < entries.size(); ++i) {
+            doom(path + "/" + entries[i].name, entries[i].directory, remote);
+        } // end for (i < entries.size())
+    } // end else if (directory)
+
+    doomed.push_back(make_pair(path, directory));
+} // end doom(const string&, bool, bool)
+
+
+// reads the state the last run saved, if it mirrored the same remote tree
+// in the same direction
+void Mirror::load(void) {
+    ifstream in(localPath(STATE_FILE).c_str());
+    string   line;
+
+    previous.clear();
+    if (!getline(in, line)
+            || line != (upload ? "# put " : "# get ") + remoteRoot) {
+        return;
+    } // end if (!getline(in, line) || ...)
+
+    while(getline(in, line)) {
+        istringstream fields(line);
+        Record        record;
+        string        path;
+        long long     remoteTime, localTime;
+
+        if (!(fields >> record.remoteSize >> remoteTime >> record.localSize
+                     >> localTime >> record.sum) || fields.get() != '\t'
+                || !getline(fields, path) || path.empty()) {
+            continue;
+        } // end if (!(fields >> ...) || ...)
+        record.remoteTime = remoteTime;
+        record.localTime  = localTime;
+        if (record.sum == "-") {
+            record.sum = "";
+        } // end if (record.sum == "-")
+        previous[path] = record;
+    } // end while(getline(in, line))
+} // end load()
+
+
+// writes the state for the next run, replacing the old state only once the
+// new one is complete
+bool Mirror::save(void) {
+    string   name(localPath(STATE_FILE));
+    string   temp(name + ".tmp");
+    ofstream out(temp.c_str());
+
+    out << (upload ? "# put " : "# get ") << remoteRoot << '\n';
+    for (map<string, Record>::iterator it = current.begin();
+            it != current.end(); ++it) {
+        const Record& record = it->second;
+
+        out << record.remoteSize << '\t' << (long long)record.remoteTime
+            << '\t' << record.localSize << '\t'
+            << (long long)record.localTime << '\t'
+            << (record.sum.empty() ? "-" : record.sum) << '\t'
+            << it->first << '\n';
+    } // end for (it != current.end())
+    out.close();
+
+    if (!out || rename(temp.c_str(), name.c_str()) != 0) {
+        unlink(temp.c_str());
+        return false;
+    } // end if (!out || ...)
+
+    return true;
+} // end save()
+
+
+// a path relative to the mirrored trees on the server
+string Mirror::remotePath(const string& path) const {
+    return path.empty() ? remoteRoot
+                        : ListingCache::join(remoteRoot, path);
+} // end remotePath(const string&)
+
+
+// a path relative to the mirrored trees on this machine
+string Mirror::localPath(const string& path) const {
+    return path.empty() ? localRoot : localRoot + "/" + path;
+} // end localPath(const string&)
+
+
+// the regular files and directories in a local directory, sorted by name;
+// symbolic links are followed, and anything else is left out
+void Mirror::readLocal(const string& directory, vector<Local>& entries) {
+    DIR           *dir = opendir(directory.c_str());
+    struct dirent *found;
+
+    entries.clear();
+    if (dir == NULL) {
+        return;
+    } // end if (dir == NULL)
+
+    while((found = readdir(dir)) != NULL) {
+        string      name(found->d_name);
+        struct stat info;
+        Local       entry;
+
+        if (name == "." || name == ".."
+                || stat((directory + "/" + name).c_str(), &info) != 0
+                || !(S_ISREG(info.st_mode) || S_ISDIR(info.st_mode))) {
+            continue;
+        } // end if (name == "." || ...)
+        entry.name      = name;
+        entry.size      = info.st_size;
+        entry.modified  = info.st_mtime;
+        entry.directory = S_ISDIR(info.st_mode);
+        entries.push_back(entry);
+    } // end while((found = readdir(dir)) != NULL)
+    closedir(dir);
+
+    sort(entries.begin(), entries.end(), byName);
+} // end readLocal(const string&, vector<Local>&)
+
+
+// the checksum of a local file in hex; empty if it cannot be read
+string Mirror::localSum(const string& file, Checksum::kind algorithm) {
+    Checksum     sum;
+    vector<char> buffer(READ_LEN);
+    int          fd = open(file.c_str(), O_RDONLY);
+    ssize_t      len;
+
+    if (fd < 0) {
+        return "";
+    } // end if (fd < 0)
+
+    sum.reset(algorithm);
+    while((len = read(fd, &buffer[0], buffer.size())) > 0) {
+        sum.update(&buffer[0], len);
+    } // end while((len = read(...)) > 0)
+    close(fd);
+
+    return len < 0 ? "" : sum.hex();
+} // end localSum(const string&, Checksum::kind)
+
+
+// orders local entries as listings are ordered
+bool Mirror::byName(const Local& a, const Local& b) {
+    return a.name < b.name;
+} // end byName(const Local&, const Local&)
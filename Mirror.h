@@ -0,0 +1,86 @@
+/*
+ * @file   Mirror.h
+ * @brief  Keeps a local directory tree in step with a remote one, or a
+ *          remote tree with a local one. Both trees are walked together, and
+ *          each file is compared by size and modification time, and by
+ *          checksum when asked, against a state file kept in the local tree,
+ *          so that only new and changed files are transferred. Files missing
+ *          from the source side can be deleted from the other.
+ * @author Brendan Sweeney, ID #1161836
+ * @date   December 13, 2012
+ */
+
+#ifndef MIRROR_H
+#define	MIRROR_H
+
+#include <sys/stat.h>       // stat, mkdir
+#include <sys/time.h>       // utimes
+#include <sys/types.h>
+#include <dirent.h>         // opendir, readdir
+#include <fcntl.h>          // open
+#include <stdio.h>          // rename
+#include <unistd.h>         // read, close, unlink, rmdir
+#include <algorithm>        // sort
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "Checksum.h"
+#include "FtpBackend.h"
+#include "ListingCache.h"
+#include "TransferScheduler.h"
+
+using namespace std;
+
+
+class Mirror {
+public:
+    static const char   STATE_FILE[];   // kept in the local root
+    static const size_t READ_LEN = 1048576; // bytes per read when summing
+    Mirror(FtpBackend& backend, string remote, string local, bool upload,
+           bool deletes, bool checksums);
+    string scan(vector<TransferJob>& jobs);
+    string finish(vector<TransferJob>& jobs);
+    int    failures(void) const;
+private:
+    // what a file looked like on both sides when it was last in step
+    struct Record {
+        long long remoteSize, localSize;
+        time_t    remoteTime, localTime;    // -1 when unknown
+        string    sum;      // "ALGORITHM:hex" if checksummed, or empty
+    };
+    struct Local {
+        string    name;
+        long long size;
+        time_t    modified;
+        bool      directory;
+    };
+    FtpBackend& backend;        // lists and deletes; transfers go elsewhere
+    string remoteRoot;          // absolute remote directory
+    string localRoot;           // local directory holding STATE_FILE
+    bool   upload;              // local is the source
+    bool   deletes;             // remove what the source no longer has
+    bool   checksums;           // compare checksums of unchanged files too
+    map<string, Record> previous;   // loaded state, by relative path
+    map<string, Record> current;    // state to save
+    vector<string>      paths;      // relative path of each job
+    vector<RemoteEntry> remotes;    // remote entry of each download job
+    vector<pair<string, bool> > doomed; // paths to delete, true if a dir
+    int    unchanged;           // files found in step
+    int    failed;              // transfers, deletes and listings that failed
+
+    void   walk(const string& path, bool created);
+    bool   same(const string& path, const RemoteEntry& remote,
+                const Local& local, Record& record);
+    void   doom(const string& path, bool directory, bool remote);
+    void   load(void);
+    bool   save(void);
+    string remotePath(const string& path) const;
+    string localPath(const string& path) const;
+    static void   readLocal(const string& directory, vector<Local>& entries);
+    static string localSum(const string& file, Checksum::kind algorithm);
+    static bool   byName(const Local& a, const Local& b);
+}; // end class Mirror
+
+#endif	/* MIRROR_H */
@@ -0,0 +1,284 @@
+/*
+ * @file   Newlines.cpp
+ * @brief  Line ending translation for TYPE A transfers, run on the bytes as
+ *          they pass through the transfer loop: CRLF becomes LF on the way
+ *          in and LF becomes CRLF on the way out. Buffers are scanned 32 or
+ *          16 bytes at a time with AVX2 or SSE2, so blocks without a line
+ *          ending are copied whole; there is a portable version too.
+ * @author Brendan Sweeney, ID #1161836
+ * @date   December 13, 2012
+ */
+
+#include "Newlines.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>      // _mm_cmpeq_epi8, _mm256_cmpeq_epi8
+#define	NEWLINES_X86 1
+#endif
+
+
+namespace {
+
+// what the processor offers, asked once
+#ifdef NEWLINES_X86
+const bool HAS_SSE2 = __builtin_cpu_supports("sse2");
+const bool HAS_AVX2 = __builtin_cpu_supports("avx2");
+#else
+const bool HAS_SSE2 = false;
+const bool HAS_AVX2 = false;
+#endif
+
+} // end namespace
+
+
+Newlines::Newlines() : carry(false) {
+} // end default constructor
+
+
+// forgets any CR held back, for a new transfer
+void Newlines::reset(void) {
+    carry = false;
+} // end reset()
+
+
+// turns each CRLF in a received buffer into LF, in place; a CR that ends
+// the buffer is held back until the next one shows what follows it, and is
+// then put back in the byte before data, which must be spare; returns
+// where the translated bytes start, and sets len to how many there are
+char *Newlines::toLocal(char *data, size_t& len) {
+    if (carry) {
+        *--data = '\r';
+        ++len;
+    } // end if (carry)
+
+    carry = len > 0 && data[len - 1] == '\r';
+    if (carry) {
+        --len;
+    } // end if (carry)
+
+    len = HAS_AVX2 ? stripAvx2(data, len)
+        : HAS_SSE2 ? stripSse2(data, len)
+                   : strip(data, len);
+    return data;
+} // end toLocal(char*, size_t&)
+
+
+// true if toLocal() is holding back a CR; at the end of a transfer it was
+// not part of a CRLF, and belongs at the end of the file
+bool Newlines::held(void) const {
+    return carry;
+} // end held()
+
+
+// turns each LF of a buffer to send into CRLF; out needs room for twice
+// len bytes; returns how many it holds
+size_t Newlines::toNetwork(const char *data, size_t len, char *out) {
+    return HAS_AVX2 ? expandAvx2(data, len, out)
+         : HAS_SSE2 ? expandSse2(data, len, out)
+                    : expand(data, len, out);
+} // end toNetwork(const char*, size_t, char*)
+
+
+// drops the CR of each CRLF one byte at a time; the buffer does not end
+// in CR, so every CR can see the byte after it
+size_t Newlines::strip(char *data, size_t len) {
+    size_t out = 0;
+
+    for (size_t i = 0; i < len; ++i) {
+        if (data[i] != '\r' || i + 1 == len || data[i + 1] != '\n') {
+            data[out++] = data[i];
+        } // end if (data[i] != '\r' || ...)
+    } // end for (i < len)
+
+    return out;
+} // end strip(char*, size_t)
+
+
+// puts a CR before each LF one byte at a time
+size_t Newlines::expand(const char *data, size_t len, char *out) {
+    size_t at = 0;
+
+    for (size_t i = 0; i < len; ++i) {
+        if (data[i] == '\n') {
+            out[at++] = '\r';
+        } // end if (data[i] == '\n')
+        out[at++] = data[i];
+    } // end for (i < len)
+
+    return at;
+} // end expand(const char*, size_t, char*)
+
+
+// copies a block of width bytes to out, leaving out the bytes whose bits
+// are set in drop; returns how many it copied
+size_t Newlines::compact(char *out, const char *block, size_t width,
+                         uint32_t drop) {
+    size_t from = 0, at = 0;
+
+    while(drop != 0) {
+        size_t bit = __builtin_ctz(drop);
+
+        memmove(out + at, block + from, bit - from);
+        at   += bit - from;
+        from  = bit + 1;
+        drop &= drop - 1;
+    } // end while(drop != 0)
+    memmove(out + at, block + from, width - from);
+
+    return at + width - from;
+} // end compact(char*, const char*, size_t, uint32_t)
+
+
+// copies a block of width bytes to out with a CR before each byte whose bit
+// is set in ends; returns how many it wrote
+size_t Newlines::insert(char *out, const char *block, size_t width,
+                        uint32_t ends) {
+    size_t from = 0, at = 0;
+
+    while(ends != 0) {
+        size_t bit = __builtin_ctz(ends);
+
+        memcpy(out + at, block + from, bit - from);
+        at        += bit - from;
+        out[at++]  = '\r';
+        from       = bit;
+        ends      &= ends - 1;
+    } // end while(ends != 0)
+    memcpy(out + at, block + from, width - from);
+
+    return at + width - from;
+} // end insert(char*, const char*, size_t, uint32_t)
+
+
+#ifdef NEWLINES_X86
+// drops the CR of each CRLF sixteen bytes at a time; a block is loaded
+// before anything is stored over it, and out never passes the block read
+__attribute__((target("sse2")))
+size_t Newlines::stripSse2(char *data, size_t len) {
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+    size_t        i = 0, out = 0;
+
+    // the byte after each block is looked at, so stop one short
+    while(i + 16 < len) {
+        __m128i  block = _mm_loadu_si128((const __m128i *)(data + i));
+        uint32_t crs   = _mm_movemask_epi8(_mm_cmpeq_epi8(block, cr));
+        uint32_t lfs   = _mm_movemask_epi8(_mm_cmpeq_epi8(block, lf));
+        uint32_t drop  = crs & (lfs >> 1 | (data[i + 16] == '\n') << 15);
+
+        if (drop == 0) {
+            _mm_storeu_si128((__m128i *)(data + out), block);
+            out += 16;
+        } // end if (drop == 0)
+        else {
+            char copy[16];
+
+            _mm_storeu_si128((__m128i *)copy, block);
+            out += compact(data + out, copy, 16, drop);
+        } // end else (drop != 0)
+        i += 16;
+    } // end while(i + 16 < len)
+
+    memmove(data + out, data + i, len - i);
+    return out + strip(data + out, len - i);
+} // end stripSse2(char*, size_t)
+
+
+// the same, thirty-two bytes at a time
+__attribute__((target("avx2")))
+size_t Newlines::stripAvx2(char *data, size_t len) {
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    size_t        i = 0, out = 0;
+
+    while(i + 32 < len) {
+        __m256i  block = _mm256_loadu_si256((const __m256i *)(data + i));
+        uint32_t crs   = _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, cr));
+        uint32_t lfs   = _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, lf));
+        uint32_t drop  = crs & (lfs >> 1
+                                | (uint32_t)(data[i + 32] == '\n') << 31);
+
+        if (drop == 0) {
+            _mm256_storeu_si256((__m256i *)(data + out), block);
+            out += 32;
+        } // end if (drop == 0)
+        else {
+            char copy[32];
+
+            _mm256_storeu_si256((__m256i *)copy, block);
+            out += compact(data + out, copy, 32, drop);
+        } // end else (drop != 0)
+        i += 32;
+    } // end while(i + 32 < len)
+
+    memmove(data + out, data + i, len - i);
+    return out + strip(data + out, len - i);
+} // end stripAvx2(char*, size_t)
+
+
+// puts a CR before each LF sixteen bytes at a time
+__attribute__((target("sse2")))
+size_t Newlines::expandSse2(const char *data, size_t len, char *out) {
+    const __m128i lf = _mm_set1_epi8('\n');
+    size_t        i = 0, at = 0;
+
+    while(i + 16 <= len) {
+        __m128i  block = _mm_loadu_si128((const __m128i *)(data + i));
+        uint32_t ends  = _mm_movemask_epi8(_mm_cmpeq_epi8(block, lf));
+
+        if (ends == 0) {
+            _mm_storeu_si128((__m128i *)(out + at), block);
+            at += 16;
+        } // end if (ends == 0)
+        else {
+            at += insert(out + at, data + i, 16, ends);
+        } // end else (ends != 0)
+        i += 16;
+    } // end while(i + 16 <= len)
+
+    return at + expand(data + i, len - i, out + at);
+} // end expandSse2(const char*, size_t, char*)
+
+
+// the same, thirty-two bytes at a time
+__attribute__((target("avx2")))
+size_t Newlines::expandAvx2(const char *data, size_t len, char *out) {
+    const __m256i lf = _mm256_set1_epi8('\n');
+    size_t        i = 0, at = 0;
+
+    while(i + 32 <= len) {
+        __m256i  block = _mm256_loadu_si256((const __m256i *)(data + i));
+        uint32_t ends  = _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, lf));
+
+        if (ends == 0) {
+            _mm256_storeu_si256((__m256i *)(out + at), block);
+            at += 32;
+        } // end if (ends == 0)
+        else {
+            at += insert(out + at, data + i, 32, ends);
+        } // end else (ends != 0)
+        i += 32;
+    } // end while(i + 32 <= len)
+
+    return at + expand(data + i, len - i, out + at);
+} // end expandAvx2(const char*, size_t, char*)
+#else
+size_t Newlines::stripSse2(char *data, size_t len) {
+    return strip(data, len);
+} // end stripSse2(char*, size_t)
+
+
+size_t Newlines::stripAvx2(char *data, size_t len) {
+    return strip(data, len);
+} // end stripAvx2(char*, size_t)
+
+
+size_t Newlines::expandSse2(const char *data, size_t len, char *out) {
+    return expand(data, len, out);
+} // end expandSse2(const char*, size_t, char*)
+
+
+size_t Newlines::expandAvx2(const char *data, size_t len, char *out) {
+    return expand(data, len, out);
+} // end expandAvx2(const char*, size_t, char*)
+#endif
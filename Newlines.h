@@ -0,0 +1,44 @@
+/*
+ * @file   Newlines.h
+ * @brief  Line ending translation for TYPE A transfers, run on the bytes as
+ *          they pass through the transfer loop: CRLF becomes LF on the way
+ *          in and LF becomes CRLF on the way out. Buffers are scanned 32 or
+ *          16 bytes at a time with AVX2 or SSE2, so blocks without a line
+ *          ending are copied whole; there is a portable version too.
+ * @author Brendan Sweeney, ID #1161836
+ * @date   December 13, 2012
+ */
+
+#ifndef NEWLINES_H
+#define	NEWLINES_H
+
+#include <stddef.h>         // size_t
+#include <stdint.h>         // uint32_t
+#include <string.h>         // memcpy, memmove
+
+using namespace std;
+
+
+class Newlines {
+public:
+    Newlines();
+    void   reset(void);
+    char  *toLocal(char *data, size_t& len);
+    bool   held(void) const;
+    static size_t toNetwork(const char *data, size_t len, char *out);
+private:
+    bool   carry;           // a CR ended the last buffer given to toLocal()
+
+    static size_t strip(char *data, size_t len);
+    static size_t stripSse2(char *data, size_t len);
+    static size_t stripAvx2(char *data, size_t len);
+    static size_t expand(const char *data, size_t len, char *out);
+    static size_t expandSse2(const char *data, size_t len, char *out);
+    static size_t expandAvx2(const char *data, size_t len, char *out);
+    static size_t compact(char *out, const char *block, size_t width,
+                          uint32_t drop);
+    static size_t insert(char *out, const char *block, size_t width,
+                         uint32_t ends);
+}; // end class Newlines
+
+#endif	/* NEWLINES_H */
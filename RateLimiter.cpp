@@ -0,0 +1,253 @@
+/*
+ * @file   RateLimiter.cpp
+ * @brief  Token bucket rate limiting for FTP transfers. A total rate is
+ *          shared fairly by every transfer running at once, each transfer
+ *          can be capped on its own, and shares are worked out again as
+ *          transfers come and go and as their speeds change. Transfers only
+ *          pay for any of this while a limit is set.
+ * @author Brendan Sweeney, ID #1161836
+ * @date   December 13, 2012
+ */
+
+#include "RateLimiter.h"
+
+
+RateLimiter::RateLimiter() : totalRate(0), eachRate(0), nextRebalance(0),
+                             lastRebalance(0) {
+    pthread_mutex_init(&lock, NULL);
+} // end default constructor
+
+
+RateLimiter::~RateLimiter() {
+    pthread_mutex_destroy(&lock);
+} // end destructor
+
+
+// parses a rate such as 50M, 512K or 1.5G bytes per second, in the same
+// decimal units that formatRate() and the transfer reports use; "off" and
+// anything unreadable are 0, which is unlimited
+long long RateLimiter::parseRate(const string& text) {
+    char  *end;
+    double value = strtod(text.c_str(), &end);
+
+    switch (*end) {
+        case 'G': case 'g':
+            value *= 1000;
+            // fall through
+        case 'M': case 'm':
+            value *= 1000;
+            // fall through
+        case 'K': case 'k':
+            value *= 1000;
+        default:
+            break;
+    } // end switch (*end)
+
+    return value > 0 ? (long long)value : 0;
+} // end parseRate(const string&)
+
+
+// a rate for people
+string RateLimiter::formatRate(long long rate) {
+    ostringstream text;
+
+    if (rate <= 0) {
+        return "unlimited";
+    } // end if (rate <= 0)
+
+    text << rate / 1000.0 << " Kbytes/s";
+    return text.str();
+} // end formatRate(long long)
+
+
+// sets the rate shared by all transfers and the cap on each; 0 lifts either
+void RateLimiter::setRate(long long total, long long each) {
+    pthread_mutex_lock(&lock);
+    totalRate = total;
+    eachRate  = each;
+    rebalance(TransferMetrics::now());
+    pthread_mutex_unlock(&lock);
+} // end setRate(long long, long long)
+
+
+// the rate shared by all transfers, or 0
+long long RateLimiter::total(void) const {
+    return totalRate;
+} // end total()
+
+
+// the cap on each transfer, or 0
+long long RateLimiter::each(void) const {
+    return eachRate;
+} // end each()
+
+
+// registers a starting transfer and gives it its share; NULL when nothing
+// is limited, so an unlimited transfer never comes back here
+RateLimiter::Flow *RateLimiter::join(void) {
+    if (totalRate == 0 && eachRate == 0) {
+        return NULL;
+    } // end if (totalRate == 0 && ...)
+
+    Flow *flow = new Flow();
+
+    flow->rate     = 0;
+    flow->used     = 0;
+    flow->tokens   = 0.0;
+    flow->refilled = 0;
+
+    pthread_mutex_lock(&lock);
+    flows.push_back(flow);
+    rebalance(TransferMetrics::now());
+    pthread_mutex_unlock(&lock);
+
+    return flow;
+} // end join()
+
+
+// unregisters a finished transfer and hands its share to the others
+void RateLimiter::leave(Flow *flow) {
+    if (flow == NULL) {
+        return;
+    } // end if (flow == NULL)
+
+    pthread_mutex_lock(&lock);
+    for (size_t i = 0; i < flows.size(); ++i) {
+        if (flows[i] == flow) {
+            flows.erase(flows.begin() + i);
+            break;
+        } // end if (flows[i] == flow)
+    } // end for (i < flows.size())
+    rebalance(TransferMetrics::now());
+    pthread_mutex_unlock(&lock);
+
+    delete flow;
+} // end leave(Flow*)
+
+
+// tops up the bucket and returns how many bytes may move now; 0 means
+// wait delay() nanoseconds first
+size_t RateLimiter::grant(Flow *flow) {
+    long long at = TransferMetrics::now();
+
+    if (at >= nextRebalance) {
+        pthread_mutex_lock(&lock);
+        if (at >= nextRebalance) {
+            rebalance(at);
+        } // end if (at >= nextRebalance)
+        pthread_mutex_unlock(&lock);
+    } // end if (at >= nextRebalance)
+
+    long long rate = flow->rate;
+    long long last = flow->refilled;
+
+    if (rate <= 0) {
+        return (size_t)-1;
+    } // end if (rate <= 0)
+
+    // a short burst keeps the pacing smooth at any rate
+    double burst = (double)rate * BURST / 1e9;
+
+    if (burst < MIN_GRANT) {
+        burst = MIN_GRANT;
+    } // end if (burst < MIN_GRANT)
+    if (last != 0) {
+        flow->tokens += (double)(at - last) * rate / 1e9;
+    } // end if (last != 0)
+    if (flow->tokens > burst) {
+        flow->tokens = burst;
+    } // end if (flow->tokens > burst)
+    flow->refilled = at;
+
+    return flow->tokens < MIN_GRANT ? 0 : (size_t)flow->tokens;
+} // end grant(Flow*)
+
+
+// takes bytes that were moved out of the bucket
+void RateLimiter::consume(Flow *flow, size_t bytes) {
+    flow->tokens -= bytes;
+    flow->used   += bytes;
+} // end consume(Flow*, size_t)
+
+
+// nanoseconds until grant() will have a segment to give
+long long RateLimiter::delay(Flow *flow) const {
+    long long rate = flow->rate;
+    long long ns;
+
+    if (rate <= 0 || flow->tokens >= MIN_GRANT) {
+        return 0;
+    } // end if (rate <= 0 || ...)
+
+    ns = (long long)((MIN_GRANT - flow->tokens) * 1e9 / rate);
+    return ns > 1000 ? ns : 1000;
+} // end delay(Flow*)
+
+
+// divides the total among the flows by water-filling: a flow that left a
+// fifth of its last share unused is held back somewhere else, so it gets a
+// little more than it used and the rest is split evenly among the others;
+// called with lock held
+void RateLimiter::rebalance(long long at) {
+    long long      elapsed = at - lastRebalance;
+    long long      budget  = totalRate;
+    long long      cap     = eachRate;
+    size_t         left    = flows.size();
+    vector<double> demand(flows.size());
+    vector<bool>   fixed(flows.size(), false);
+    bool           changed = true;
+
+    lastRebalance = at;
+    nextRebalance = at + REBALANCE;
+
+    for (size_t i = 0; i < flows.size(); ++i) {
+        double used    = (double)flows[i]->used.exchange(0);
+        double allowed = (double)flows[i]->rate;
+
+        demand[i] = 1e18;
+        if (flows[i]->refilled != 0 && allowed > 0
+                && elapsed >= REBALANCE / 2) {
+            double measured = used * 1e9 / elapsed;
+
+            if (measured < 0.8 * allowed) {
+                demand[i] = 1.25 * measured;
+                // leave room to speed up again
+                if (budget > 0 && demand[i] < budget / flows.size() / 8.0) {
+                    demand[i] = budget / flows.size() / 8.0;
+                } // end if (budget > 0 && ...)
+            } // end if (measured < 0.8 * allowed)
+        } // end if (flows[i]->refilled != 0 && ...)
+        if (cap > 0 && demand[i] > cap) {
+            demand[i] = cap;
+        } // end if (cap > 0 && ...)
+    } // end for (i < flows.size())
+
+    // without a total, each flow only has its own cap
+    if (budget == 0) {
+        for (size_t i = 0; i < flows.size(); ++i) {
+            flows[i]->rate = cap;
+        } // end for (i < flows.size())
+        return;
+    } // end if (budget == 0)
+
+    while(changed && left > 0) {
+        double share = (double)budget / left;
+
+        changed = false;
+        for (size_t i = 0; i < flows.size(); ++i) {
+            if (!fixed[i] && demand[i] < share) {
+                flows[i]->rate = (long long)demand[i] + 1;
+                budget        -= (long long)demand[i];
+                fixed[i]       = true;
+                changed        = true;
+                --left;
+            } // end if (!fixed[i] && ...)
+        } // end for (i < flows.size())
+    } // end while(changed && left > 0)
+
+    for (size_t i = 0; i < flows.size(); ++i) {
+        if (!fixed[i]) {
+            flows[i]->rate = budget / (long long)left;
+        } // end if (!fixed[i])
+    } // end for (i < flows.size())
+} // end rebalance(long long)
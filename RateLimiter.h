@@ -0,0 +1,63 @@
+/*
+ * @file   RateLimiter.h
+ * @brief  Token bucket rate limiting for FTP transfers. A total rate is
+ *          shared fairly by every transfer running at once, each transfer
+ *          can be capped on its own, and shares are worked out again as
+ *          transfers come and go and as their speeds change. Transfers only
+ *          pay for any of this while a limit is set.
+ * @author Brendan Sweeney, ID #1161836
+ * @date   December 13, 2012
+ */
+
+#ifndef RATELIMITER_H
+#define	RATELIMITER_H
+
+#include <pthread.h>
+#include <stddef.h>         // size_t
+#include <stdlib.h>         // strtod
+#include <atomic>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "TransferMetrics.h"
+
+using namespace std;
+
+
+class RateLimiter {
+public:
+    // one transfer's bucket; only its own thread touches the tokens, and
+    // rebalance() reads the rest from whichever thread holds the lock
+    struct Flow {
+        atomic<long long> rate;     // bytes/second allowed, 0 unlimited
+        atomic<long long> used;     // bytes moved since the last rebalance
+        double    tokens;           // bytes that may move now
+        atomic<long long> refilled; // when tokens were last topped up
+    };
+    static const long long MIN_GRANT = 1448,        // one full segment
+                           BURST     = 2000000LL,   // ns of rate per burst
+                           REBALANCE = 50000000LL;  // ns between rebalances
+    RateLimiter();
+    ~RateLimiter();
+    static long long parseRate(const string& text);
+    static string    formatRate(long long rate);
+    void   setRate(long long total, long long each);
+    long long total(void) const;
+    long long each(void) const;
+    Flow  *join(void);
+    void   leave(Flow *flow);
+    size_t grant(Flow *flow);
+    void   consume(Flow *flow, size_t bytes);
+    long long delay(Flow *flow) const;
+private:
+    pthread_mutex_t   lock;         // guards flows and the limits
+    vector<Flow *>    flows;        // transfers running now
+    atomic<long long> totalRate;    // bytes/second for all, 0 unlimited
+    atomic<long long> eachRate;     // bytes/second per transfer, 0 none
+    atomic<long long> nextRebalance;    // when shares are next worked out
+    long long         lastRebalance;    // when they last were
+
+    void rebalance(long long at);
+}; // end class RateLimiter
+
+#endif	/* RATELIMITER_H */
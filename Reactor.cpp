@@ -0,0 +1,218 @@
+/*
+ * @file   Reactor.cpp
+ * @brief  Runs coroutine Tasks on one thread over epoll. A Task that has to
+ *          wait for a socket awaits ready(), which parks it until the socket
+ *          can be read or written, or until a timeout passes, and the thread
+ *          goes on with whichever other Task can run. One Reactor can so keep
+ *          hundreds of FTP sessions and their transfers going at once.
+ * @author Brendan Sweeney, ID #1161836
+ * @date   December 13, 2012
+ */
+
+#include "Reactor.h"
+
+
+Reactor::Ready::Ready(Reactor& reactor, int fd, unsigned events,
+                      int timeout) :
+        reactor(reactor), fd(fd), events(events), timeout(timeout),
+        fired(false) {
+} // end constructor
+
+
+// always parks, as the socket was found not ready before the wait
+bool Reactor::Ready::await_ready(void) const noexcept {
+    return false;
+} // end await_ready()
+
+
+void Reactor::Ready::await_suspend(coroutine_handle<> waiter) {
+    reactor.watch(this, waiter);
+} // end await_suspend(coroutine_handle<>)
+
+
+bool Reactor::Ready::await_resume(void) const noexcept {
+    return fired;
+} // end await_resume()
+
+
+Reactor::Reactor() : parked(0) {
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+} // end default constructor
+
+
+// destroys tasks that never finished, as when run() threw
+Reactor::~Reactor() {
+    for (size_t i = 0; i < roots.size(); ++i) {
+        roots[i].destroy();
+    } // end for (i < roots.size())
+    close(epollFd);
+} // end destructor
+
+
+// a wait on a socket, to be co_await'ed: for events, EPOLLIN or EPOLLOUT,
+// or for timeout ms, whichever comes first
+Reactor::Ready Reactor::ready(int fd, unsigned events, int timeout) {
+    return Ready(*this, fd, events, timeout);
+} // end ready(int, unsigned, int)
+
+
+// takes a socket out of the epoll set before it is closed; its number may
+// be given to the next socket opened
+void Reactor::forget(int fd) {
+    if (fd >= 0 && (size_t)fd < watched.size() && watched[fd]) {
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, NULL);
+        watched[fd] = false;
+    } // end if (fd >= 0 && ...)
+} // end forget(int)
+
+
+// hands a task to the reactor, which starts it on the next run()
+void Reactor::spawn(Task<void> task) {
+    Root root = task.release();
+
+    roots.push_back(root);
+    runnable.push_back(root);
+} // end spawn(Task<void>)
+
+
+// resumes tasks as their sockets become ready until every spawned task
+// has finished; an exception a task ended with is thrown from here
+void Reactor::run(void) {
+    struct epoll_event events[EVENTS];
+
+    while(true) {
+        // resuming a task can make others runnable, so take them in turn
+        while(!runnable.empty()) {
+            vector<coroutine_handle<> > batch;
+
+            batch.swap(runnable);
+            for (size_t i = 0; i < batch.size(); ++i) {
+                batch[i].resume();
+            } // end for (i < batch.size())
+        } // end while(!runnable.empty())
+        reap();
+        if (roots.empty()) {
+            break;
+        } // end if (roots.empty())
+        if (parked == 0) {
+            break;              // nothing left that could wake a task
+        } // end if (parked == 0)
+
+        int count = epoll_wait(epollFd, events, EVENTS, nextTimeout());
+
+        if (count < 0 && errno != EINTR) {
+            break;
+        } // end if (count < 0 && ...)
+        for (int i = 0; i < count; ++i) {
+            Waiter& waiter = waiters[events[i].data.fd];
+
+            // a wait that timed out may still see its event arrive
+            if (waiter.who) {
+                waiter.wait->fired = true;
+                runnable.push_back(waiter.who);
+                waiter.who = nullptr;
+                --parked;
+            } // end if (waiter.who)
+        } // end for (i < count)
+        expire();
+    } // end while(true)
+} // end run()
+
+
+// registers a parked coroutine for its socket, armed for one event
+void Reactor::watch(Ready *wait, coroutine_handle<> who) {
+    struct epoll_event event;
+    int    fd = wait->fd;
+
+    if ((size_t)fd >= waiters.size()) {
+        Waiter none = {nullptr, NULL, 0};
+
+        waiters.resize(fd + 1, none);
+        watched.resize(fd + 1, false);
+    } // end if (fd >= waiters.size())
+
+    event.events  = wait->events | EPOLLONESHOT;
+    event.data.u64 = 0;
+    event.data.fd = fd;
+    // a socket closed without forget() left the set on its own
+    if (!watched[fd] || (epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &event) < 0
+                         && errno == ENOENT)) {
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+        watched[fd] = true;
+    } // end if (!watched[fd] || ...)
+
+    waiters[fd].who      = who;
+    waiters[fd].wait     = wait;
+    waiters[fd].deadline = wait->timeout < 0 ? 0
+                           : TransferMetrics::now()
+                             + wait->timeout * 1000000LL;
+    ++parked;
+} // end watch(Ready*, coroutine_handle<>)
+
+
+// milliseconds until the nearest deadline, or -1 if no wait has one
+int Reactor::nextTimeout(void) {
+    long long first = 0;
+
+    for (size_t i = 0; i < waiters.size(); ++i) {
+        if (waiters[i].who && waiters[i].deadline != 0
+                && (first == 0 || waiters[i].deadline < first)) {
+            first = waiters[i].deadline;
+        } // end if (waiters[i].who && ...)
+    } // end for (i < waiters.size())
+
+    if (first == 0) {
+        return -1;
+    } // end if (first == 0)
+
+    long long left = first - TransferMetrics::now();
+
+    return left <= 0 ? 0 : (int)((left + 999999) / 1000000);
+} // end nextTimeout()
+
+
+// resumes the waits whose deadline has passed, telling them so
+void Reactor::expire(void) {
+    long long now = TransferMetrics::now();
+
+    for (size_t i = 0; i < waiters.size(); ++i) {
+        if (waiters[i].who && waiters[i].deadline != 0
+                && waiters[i].deadline <= now) {
+            waiters[i].wait->fired = false;
+            runnable.push_back(waiters[i].who);
+            waiters[i].who = nullptr;
+            --parked;
+        } // end if (waiters[i].who && ...)
+    } // end for (i < waiters.size())
+} // end expire()
+
+
+// destroys the spawned tasks that have finished, throwing the first error
+// one of them ended with
+void Reactor::reap(void) {
+    exception_ptr error;
+
+    for (size_t i = 0; i < roots.size(); ) {
+        if (roots[i].done()) {
+            if (!error) {
+                error = roots[i].promise().error;
+            } // end if (!error)
+            roots[i].destroy();
+            roots.erase(roots.begin() + i);
+        } // end if (roots[i].done())
+        else {
+            ++i;
+        } // end else
+    } // end for (i < roots.size())
+
+    if (error) {
+        rethrow_exception(error);
+    } // end if (error)
+} // end reap()
+
+
+// runs a task that returns nothing, and notes that it has
+Task<void> Reactor::keep(Task<void> task, bool *into) {
+    co_await task;
+    *into = true;
+} // end keep(Task<void>, bool*)
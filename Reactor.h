@@ -0,0 +1,105 @@
+/*
+ * @file   Reactor.h
+ * @brief  Runs coroutine Tasks on one thread over epoll. A Task that has to
+ *          wait for a socket awaits ready(), which parks it until the socket
+ *          can be read or written, or until a timeout passes, and the thread
+ *          goes on with whichever other Task can run. One Reactor can so keep
+ *          hundreds of FTP sessions and their transfers going at once.
+ * @author Brendan Sweeney, ID #1161836
+ * @date   December 13, 2012
+ */
+
+#ifndef REACTOR_H
+#define	REACTOR_H
+
+#include <sys/epoll.h>      // epoll_create1, epoll_ctl, epoll_wait
+#include <errno.h>
+#include <unistd.h>         // close
+#include <coroutine>
+#include <vector>
+#include "Task.h"
+#include "TransferMetrics.h"
+
+using namespace std;
+
+
+class Reactor {
+public:
+    static const int EVENTS = 256;      // events taken per epoll_wait()
+
+    // co_await'ed to wait on a socket; true if it became ready, false if
+    // the timeout passed first
+    class Ready {
+    public:
+        Ready(Reactor& reactor, int fd, unsigned events, int timeout);
+        bool await_ready(void) const noexcept;
+        void await_suspend(coroutine_handle<> waiter);
+        bool await_resume(void) const noexcept;
+    private:
+        Reactor& reactor;   // where the wait is registered
+        int      fd;        // socket waited on
+        unsigned events;    // EPOLLIN, EPOLLOUT or both
+        int      timeout;   // milliseconds, or -1 to wait for ever
+        bool     fired;     // the socket became ready
+        friend class Reactor;
+    }; // end class Ready
+
+    Reactor();
+    ~Reactor();
+    Ready  ready(int fd, unsigned events, int timeout = -1);
+    void   forget(int fd);
+    void   spawn(Task<void> task);
+    void   run(void);
+    template <typename T> T block(Task<T> task);
+private:
+    struct Waiter {
+        coroutine_handle<> who;     // coroutine to resume, or null
+        Ready    *wait;             // told whether the socket fired
+        long long deadline;         // when to give up, ns, or 0 for never
+    };
+    typedef coroutine_handle<Task<void>::promise_type> Root;
+    int    epollFd;                 // the epoll instance
+    vector<Waiter> waiters;         // by file descriptor
+    vector<bool>   watched;         // descriptor is in the epoll set
+    vector<Root>   roots;           // spawned tasks not yet finished
+    vector<coroutine_handle<> > runnable;   // to resume next
+    int    parked;                  // waiters with a coroutine
+
+    void   watch(Ready *wait, coroutine_handle<> who);
+    int    nextTimeout(void);
+    void   expire(void);
+    void   reap(void);
+    template <typename T> static Task<void> keep(Task<T> task, T *into);
+    static Task<void> keep(Task<void> task, bool *into);
+}; // end class Reactor
+
+
+// runs a task, and every task already spawned, to the end and returns what
+// it returned, so a blocking caller can use the coroutine API
+template <typename T>
+T Reactor::block(Task<T> task) {
+    T result;
+
+    spawn(keep(move(task), &result));
+    run();
+    return result;
+} // end block(Task<T>)
+
+
+// runs a task and keeps what it returns
+template <typename T>
+Task<void> Reactor::keep(Task<T> task, T *into) {
+    *into = co_await task;
+} // end keep(Task<T>, T*)
+
+
+// as block(Task<T>), for a task that returns nothing
+template <>
+inline void Reactor::block(Task<void> task) {
+    bool done = false;
+
+    spawn(keep(move(task), &done));
+    run();
+} // end block(Task<void>)
+
+#endif	/* REACTOR_H */
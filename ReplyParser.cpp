@@ -0,0 +1,146 @@
+/*
+ * @file   ReplyParser.cpp
+ * @brief  Assembles FTP replies from a control connection. Bytes are kept
+ *          until a complete RFC 959 reply has arrived, single-line or
+ *          multi-line ("xyz-" up to the closing "xyz " line), and any bytes
+ *          past it are kept for the next reply. The buffer is read into and
+ *          parsed in place, and keeps its size from one reply to the next, so
+ *          a session that is up and running allocates nothing here.
+ * @author Brendan Sweeney, ID #1161836
+ * @date   December 13, 2012
+ */
+
+#include "ReplyParser.h"
+
+
+ReplyParser::ReplyParser() : buffer(""), head(0), scanned(0) {
+} // end default constructor
+
+
+// adds bytes read from the control connection
+void ReplyParser::feed(const char *data, size_t len) {
+    buffer.append(data, len);
+} // end feed(const char*, size_t)
+
+
+// removes the oldest complete reply; false if none has fully arrived
+bool ReplyParser::next(FtpReply& reply) {
+    size_t end = complete();
+
+    if (end == 0) {
+        // nothing is waiting on the bytes already parsed, so they go
+        if (head > 0) {
+            buffer.erase(0, head);
+            head = 0;
+        } // end if (head > 0)
+        return false;
+    } // end if (end == 0)
+
+    take(reply, end);
+    return true;
+} // end next(FtpReply&)
+
+
+// reads from a socket until a complete reply is available; false if the
+// connection closed or stayed silent for TIMEOUT ms first
+bool ReplyParser::read(int sd, FtpReply& reply) {
+    return read(sd, reply, TIMEOUT);
+} // end read(int, FtpReply&)
+
+
+// as read(int, FtpReply&), giving up after timeout ms of silence
+bool ReplyParser::read(int sd, FtpReply& reply, int timeout) {
+    while(!next(reply)) {
+        struct pollfd ufds;
+        ufds.fd      = sd;
+        ufds.events  = POLLIN;
+        ufds.revents = 0;
+
+        int val = poll(&ufds, 1, timeout);
+        if (val < 0 && errno == EINTR)
+            continue;
+        if (val <= 0) {
+            // hand back whatever partial text arrived so it can be shown
+            reply.code = 0;
+            reply.text.assign(buffer, head, string::npos);
+            clear();
+            return false;
+        } // end if (val <= 0)
+
+        // read straight onto the end of the buffer, which only grows the
+        // first time a reply is longer than any before it
+        size_t  had   = buffer.length();
+        buffer.resize(had + BUFLEN);
+        ssize_t nread = ::read(sd, &buffer[had], BUFLEN);
+        buffer.resize(nread > 0 ? had + nread : had);
+
+        if (nread < 0 && (errno == EINTR || errno == EAGAIN))
+            continue;
+        if (nread <= 0) {
+            reply.code = 0;
+            reply.text.assign(buffer, head, string::npos);
+            clear();
+            return false;
+        } // end if (nread <= 0)
+    } // end while(!next(reply))
+
+    return true;
+} // end read(int, FtpReply&, int)
+
+
+// forgets everything, as when a connection is closed
+void ReplyParser::clear(void) {
+    buffer.clear();
+    head    = 0;
+    scanned = 0;
+} // end clear()
+
+
+// length of the first complete reply past head, or 0 if it is
+// incomplete; lines already known not to close the reply are not scanned
+// again
+size_t ReplyParser::complete(void) {
+    size_t end = buffer.find('\n', head);
+
+    if (end == string::npos) {
+        return 0;
+    } // end if (end == string::npos)
+
+    // a single-line reply, or the closing line of a multi-line reply, is
+    // the three digits of the first line followed by a space
+    if (end - head < 3 || buffer.at(head + 3) != '-') {
+        return end + 1 - head;
+    } // end if (end - head < 3 || ...)
+
+    size_t line = head + scanned > end ? head + scanned : end + 1;
+
+    while(true) {
+        size_t stop = buffer.find('\n', line);
+
+        if (stop == string::npos) {
+            scanned = line - head;  // resume at the unfinished line
+            return 0;
+        } // end if (stop == string::npos)
+        if (stop - line >= 3
+                && buffer.compare(line, 3, buffer, head, 3) == 0
+                && (stop - line == 3 || buffer.at(line + 3) == ' '
+                    || buffer.at(line + 3) == '\r')) {
+            return stop + 1 - head;
+        } // end if (stop - line >= 3 && ...)
+        line = stop + 1;
+    } // end while(true)
+} // end complete()
+
+
+// copies the reply of len bytes at head into reply, reusing the room its
+// text already has, and moves head past it
+void ReplyParser::take(FtpReply& reply, size_t len) {
+    reply.code = 0;
+    for (size_t i = head; i < head + 3 && i < head + len
+                          && buffer[i] >= '0' && buffer[i] <= '9'; ++i) {
+        reply.code = reply.code * 10 + (buffer[i] - '0');
+    } // end for (i < head + 3 && ...)
+    reply.text.assign(buffer, head, len);
+    head   += len;
+    scanned = 0;
+} // end take(FtpReply&, size_t)
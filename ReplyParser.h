@@ -0,0 +1,50 @@
+/*
+ * @file   ReplyParser.h
+ * @brief  Assembles FTP replies from a control connection. Bytes are kept
+ *          until a complete RFC 959 reply has arrived, single-line or
+ *          multi-line ("xyz-" up to the closing "xyz " line), and any bytes
+ *          past it are kept for the next reply. The buffer is read into and
+ *          parsed in place, and keeps its size from one reply to the next, so
+ *          a session that is up and running allocates nothing here.
+ * @author Brendan Sweeney, ID #1161836
+ * @date   December 13, 2012
+ */
+
+#ifndef REPLYPARSER_H
+#define	REPLYPARSER_H
+
+#include <errno.h>
+#include <poll.h>           // poll
+#include <unistd.h>         // read
+#include <string>
+
+using namespace std;
+
+
+// one complete reply from the server
+struct FtpReply {
+    int    code;            // three-digit reply code, or 0 if none arrived
+    string text;            // every line of the reply, including CRLFs
+};
+
+
+class ReplyParser {
+public:
+    static const int TIMEOUT = 60000;   // milliseconds to wait for a reply
+    ReplyParser();
+    void feed(const char *data, size_t len);
+    bool next(FtpReply& reply);
+    bool read(int sd, FtpReply& reply);
+    bool read(int sd, FtpReply& reply, int timeout);
+    void clear(void);
+private:
+    static const int BUFLEN = 1448;     // one Ethernet MSS per read
+    string buffer;                      // bytes read, from head on unparsed
+    size_t head;                        // first byte not yet in a reply
+    size_t scanned;                     // bytes past head known incomplete
+
+    size_t complete(void);
+    void   take(FtpReply& reply, size_t end);
+}; // end class ReplyParser
+
+#endif	/* REPLYPARSER_H */
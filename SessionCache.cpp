@@ -0,0 +1,244 @@
+/*
+ * @file   SessionCache.cpp
+ * @brief  Keeps authenticated control connections open after close so that
+ *          a later open to the same host, port and user can take one over
+ *          without connecting or logging in again. Idle connections are kept
+ *          alive with NOOP, and resolved host addresses are remembered too.
+ * @author Brendan Sweeney, ID #1161836
+ * @date   December 13, 2012
+ */
+
+#include "SessionCache.h"
+
+
+SessionCache::SessionCache() : stopping(false) {
+    pthread_mutex_init(&lock, NULL);
+    pthread_cond_init(&wake, NULL);
+    pthread_create(&keeper, NULL, keepalive, this);
+} // end default constructor
+
+
+// stops the keepalive thread and logs out of every idle session
+SessionCache::~SessionCache() {
+    pthread_mutex_lock(&lock);
+    stopping = true;
+    pthread_cond_signal(&wake);
+    pthread_mutex_unlock(&lock);
+    pthread_join(keeper, NULL);
+
+    for (multimap<string, Idle>::iterator it = idle.begin();
+            it != idle.end(); ++it) {
+        quit(it->second.sd);
+    } // end for (it != idle.end())
+
+    pthread_cond_destroy(&wake);
+    pthread_mutex_destroy(&lock);
+} // end destructor
+
+
+// true if any user has an idle session to this host and port
+bool SessionCache::holds(const string& host, const string& port) {
+    string suffix("@" + host + ":" + port);
+    bool   found = false;
+
+    pthread_mutex_lock(&lock);
+    for (multimap<string, Idle>::iterator it = idle.begin();
+            it != idle.end() && !found; ++it) {
+        found = it->first.length() >= suffix.length()
+                && it->first.compare(it->first.length() - suffix.length(),
+                                     suffix.length(), suffix) == 0;
+    } // end for (it != idle.end()...)
+    pthread_mutex_unlock(&lock);
+
+    return found;
+} // end holds(const string&, const string&)
+
+
+// takes an idle session for this host, port and user out of the cache; one
+// that has not answered a NOOP recently is checked before it is handed out,
+// after the lock is let go so a slow server holds up no one else
+bool SessionCache::checkout(const string& host, const string& port,
+                            const string& user, int& sd) {
+    string name(key(host, port, user));
+
+    while(true) {
+        pthread_mutex_lock(&lock);
+        multimap<string, Idle>::iterator it = idle.find(name);
+
+        if (it == idle.end()) {
+            pthread_mutex_unlock(&lock);
+            return false;
+        } // end if (it == idle.end())
+
+        Idle session = it->second;
+        idle.erase(it);
+        pthread_mutex_unlock(&lock);
+
+        if (time(NULL) - session.checked < KEEPALIVE || noop(session.sd)) {
+            sd = session.sd;
+            return true;
+        } // end if (time(NULL) - session.checked < KEEPALIVE || ...)
+        close(session.sd);      // the server let it go; try the next one
+    } // end while(true)
+} // end checkout(const string&, const string&, const string&, int&)
+
+
+// parks an authenticated session for a later checkout()
+void SessionCache::checkin(const string& host, const string& port,
+                           const string& user, int sd) {
+    Idle session;
+
+    session.sd      = sd;
+    session.since   = time(NULL);
+    session.checked = session.since;
+
+    pthread_mutex_lock(&lock);
+    if (idle.size() >= (size_t)MAX_IDLE_SESSIONS) {
+        pthread_mutex_unlock(&lock);
+        quit(sd);
+        return;
+    } // end if (idle.size() >= MAX_IDLE_SESSIONS)
+    idle.insert(make_pair(key(host, port, user), session));
+    pthread_mutex_unlock(&lock);
+} // end checkin(const string&, const string&, const string&, int)
+
+
+// resolves a host name to all of its addresses, with the port set, reusing
+// a recent answer; error says why there are none
+bool SessionCache::resolve(const string& host, int port,
+                           vector<Endpoint>& endpoints, string& error) {
+    time_t now   = time(NULL);
+    bool   fresh = false;
+
+    pthread_mutex_lock(&lock);
+    map<string, Address>::iterator it = addresses.find(host);
+
+    if (it != addresses.end() && it->second.expires > now) {
+        endpoints = it->second.endpoints;
+        fresh     = true;
+    } // end if (it != addresses.end() && ...)
+    pthread_mutex_unlock(&lock);
+
+    // the lookup can take seconds, so it runs with the lock let go
+    if (!fresh) {
+        Address resolved;
+
+        if (!Connector::resolve(host, 0, resolved.endpoints, error)) {
+            return false;
+        } // end if (!Connector::resolve(...))
+        resolved.expires = now + ADDR_TTL;
+        endpoints        = resolved.endpoints;
+
+        pthread_mutex_lock(&lock);
+        addresses[host] = resolved;
+        pthread_mutex_unlock(&lock);
+    } // end if (!fresh)
+
+    for (size_t i = 0; i < endpoints.size(); ++i) {
+        Connector::setPort(endpoints[i], port);
+    } // end for (i < endpoints.size())
+    return true;
+} // end resolve(const string&, int, vector<Endpoint>&, string&)
+
+
+// the cache key of a session
+string SessionCache::key(const string& host, const string& port,
+                         const string& user) {
+    return user + "@" + host + ":" + port;
+} // end key(const string&, const string&, const string&)
+
+
+// sends NOOP on an idle session; true if the server answered it
+bool SessionCache::noop(int sd) {
+    ReplyParser parser;
+    FtpReply    reply;
+
+    if (write(sd, "NOOP\r\n", 6) != 6) {
+        return false;
+    } // end if (write(...) != 6)
+
+    return parser.read(sd, reply, PROBE_TIMEOUT) && reply.code / 100 == 2;
+} // end noop(int)
+
+
+// logs out of a session without waiting for the goodbye
+void SessionCache::quit(int sd) {
+    write(sd, "QUIT\r\n", 6);
+    close(sd);
+} // end quit(int)
+
+
+// thread body: every KEEPALIVE seconds, sends NOOP on each idle session,
+// dropping those that do not answer or have been idle for MAX_IDLE; the
+// sessions due are taken out of the cache while the NOOPs go out, so the
+// lock is never held across a round trip
+void *SessionCache::keepalive(void *arg) {
+    SessionCache *cache = (SessionCache *)arg;
+
+    pthread_mutex_lock(&cache->lock);
+    while(!cache->stopping) {
+        struct timespec until;
+
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_sec += KEEPALIVE;
+        pthread_cond_timedwait(&cache->wake, &cache->lock, &until);
+        if (cache->stopping)
+            break;
+
+        time_t now = time(NULL);
+        vector<pair<string, Idle> > expired, due;
+        multimap<string, Idle>::iterator it = cache->idle.begin();
+
+        while(it != cache->idle.end()) {
+            if (now - it->second.since >= MAX_IDLE) {
+                expired.push_back(*it);
+                cache->idle.erase(it++);
+            } // end if (now - it->second.since >= MAX_IDLE)
+            else if (now - it->second.checked >= KEEPALIVE) {
+                due.push_back(*it);
+                cache->idle.erase(it++);
+            } // end else if (now - it->second.checked >= KEEPALIVE)
+            else {
+                ++it;
+            } // end else
+        } // end while(it != cache->idle.end())
+        pthread_mutex_unlock(&cache->lock);
+
+        for (size_t i = 0; i < expired.size(); ++i) {
+            quit(expired[i].second.sd);
+        } // end for (i < expired.size())
+        for (size_t i = 0; i < due.size(); ++i) {
+            if (!noop(due[i].second.sd)) {
+                close(due[i].second.sd);
+                due[i].second.sd = -1;
+            } // end if (!noop(...))
+            due[i].second.checked = now;
+        } // end for (i < due.size())
+
+        // those that answered go back, unless the cache filled meanwhile
+        vector<int> overflow;
+
+        pthread_mutex_lock(&cache->lock);
+        for (size_t i = 0; i < due.size(); ++i) {
+            if (due[i].second.sd < 0) {
+                continue;
+            } // end if (due[i].second.sd < 0)
+            if (cache->idle.size() >= (size_t)MAX_IDLE_SESSIONS) {
+                overflow.push_back(due[i].second.sd);
+            } // end if (cache->idle.size() >= MAX_IDLE_SESSIONS)
+            else {
+                cache->idle.insert(due[i]);
+            } // end else
+        } // end for (i < due.size())
+        if (!overflow.empty()) {
+            pthread_mutex_unlock(&cache->lock);
+            for (size_t i = 0; i < overflow.size(); ++i) {
+                quit(overflow[i]);
+            } // end for (i < overflow.size())
+            pthread_mutex_lock(&cache->lock);
+        } // end if (!overflow.empty())
+    } // end while(!cache->stopping)
+    pthread_mutex_unlock(&cache->lock);
+
+    return NULL;
+} // end keepalive(void*)
@@ -0,0 +1,66 @@
+/*
+ * @file   SessionCache.h
+ * @brief  Keeps authenticated control connections open after close so that
+ *          a later open to the same host, port and user can take one over
+ *          without connecting or logging in again. Idle connections are kept
+ *          alive with NOOP, and resolved host addresses are remembered too.
+ * @author Brendan Sweeney, ID #1161836
+ * @date   December 13, 2012
+ */
+
+#ifndef SESSIONCACHE_H
+#define	SESSIONCACHE_H
+
+#include <pthread.h>
+#include <time.h>           // time
+#include <unistd.h>         // write, close
+#include <map>
+#include <string>
+#include <vector>
+#include "Connector.h"
+#include "ReplyParser.h"
+
+using namespace std;
+
+
+class SessionCache {
+public:
+    static const int KEEPALIVE = 30,        // seconds between NOOPs
+                     MAX_IDLE  = 600,       // seconds before a session quits
+                     MAX_IDLE_SESSIONS = 64,
+                     ADDR_TTL  = 300;       // seconds a resolution is kept
+    SessionCache();
+    ~SessionCache();
+    bool holds(const string& host, const string& port);
+    bool checkout(const string& host, const string& port,
+                  const string& user, int& sd);
+    void checkin(const string& host, const string& port,
+                 const string& user, int sd);
+    bool resolve(const string& host, int port, vector<Endpoint>& endpoints,
+                 string& error);
+private:
+    static const int PROBE_TIMEOUT = 5000;  // ms to wait for a NOOP reply
+    struct Idle {
+        int    sd;              // authenticated control connection
+        time_t since;           // when it was checked in
+        time_t checked;         // when it last answered a NOOP
+    };
+    struct Address {
+        vector<Endpoint> endpoints; // every address of the host
+        time_t           expires;   // when to resolve the host again
+    };
+    multimap<string, Idle> idle;        // by "user@host:port"
+    map<string, Address>   addresses;   // by host name
+    pthread_mutex_t        lock;        // guards idle and addresses
+    pthread_cond_t         wake;        // signals the keepalive thread
+    pthread_t              keeper;      // runs keepalive()
+    bool                   stopping;    // tells keepalive() to return
+
+    static string key(const string& host, const string& port,
+                      const string& user);
+    static bool noop(int sd);
+    static void quit(int sd);
+    static void *keepalive(void *arg);
+}; // end class SessionCache
+
+#endif	/* SESSIONCACHE_H */
@@ -0,0 +1,153 @@
+/*
+ * @file   Task.h
+ * @brief  A C++20 coroutine that produces one value. A Task starts when it
+ *          is awaited, or when a Reactor is given it to run, and hands its
+ *          value, or the exception it ended with, to whatever awaited it.
+ *          Control passes straight from a finished Task to its awaiter, so a
+ *          chain of awaits does not grow the stack.
+ * @author Brendan Sweeney, ID #1161836
+ * @date   December 13, 2012
+ */
+
+#ifndef TASK_H
+#define	TASK_H
+
+#include <coroutine>
+#include <exception>        // exception_ptr, rethrow_exception
+#include <utility>          // move, exchange
+
+using namespace std;
+
+
+// what every Task promise keeps, whatever it produces
+class TaskPromiseBase {
+public:
+    coroutine_handle<> next;    // coroutine awaiting this one, if any
+    exception_ptr      error;   // what the coroutine ended with, if thrown
+
+    // passes control to the awaiter, if there is one, once the body ends
+    struct Final {
+        bool await_ready(void) noexcept {
+            return false;
+        } // end await_ready()
+
+        template <typename P>
+        coroutine_handle<> await_suspend(coroutine_handle<P> self) noexcept {
+            coroutine_handle<> waiter = self.promise().next;
+
+            return waiter ? waiter : noop_coroutine();
+        } // end await_suspend(coroutine_handle<P>)
+
+        void await_resume(void) noexcept {
+        } // end await_resume()
+    }; // end struct Final
+
+    suspend_always initial_suspend(void) noexcept {
+        return suspend_always();
+    } // end initial_suspend()
+
+    Final final_suspend(void) noexcept {
+        return Final();
+    } // end final_suspend()
+
+    void unhandled_exception(void) {
+        error = current_exception();
+    } // end unhandled_exception()
+}; // end class TaskPromiseBase
+
+
+// keeps the value a Task returns
+template <typename T>
+class TaskPromise : public TaskPromiseBase {
+public:
+    T value;
+
+    void return_value(T result) {
+        value = move(result);
+    } // end return_value(T)
+
+    T result(void) {
+        if (error) {
+            rethrow_exception(error);
+        } // end if (error)
+        return move(value);
+    } // end result()
+}; // end class TaskPromise
+
+
+// a Task that returns nothing
+template <>
+class TaskPromise<void> : public TaskPromiseBase {
+public:
+    void return_void(void) {
+    } // end return_void()
+
+    void result(void) {
+        if (error) {
+            rethrow_exception(error);
+        } // end if (error)
+    } // end result()
+}; // end class TaskPromise<void>
+
+
+template <typename T = void>
+class Task {
+public:
+    struct promise_type : public TaskPromise<T> {
+        Task get_return_object(void) {
+            return Task(coroutine_handle<promise_type>::from_promise(*this));
+        } // end get_return_object()
+    }; // end struct promise_type
+
+    Task() : handle(nullptr) {
+    } // end default constructor
+
+    Task(Task&& other) noexcept : handle(exchange(other.handle, nullptr)) {
+    } // end move constructor
+
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            if (handle) {
+                handle.destroy();
+            } // end if (handle)
+            handle = exchange(other.handle, nullptr);
+        } // end if (this != &other)
+        return *this;
+    } // end operator=(Task&&)
+
+    ~Task() {
+        if (handle) {
+            handle.destroy();
+        } // end if (handle)
+    } // end destructor
+
+    // co_await runs the Task to its end and gives back what it returned
+    bool await_ready(void) const noexcept {
+        return !handle || handle.done();
+    } // end await_ready()
+
+    coroutine_handle<> await_suspend(coroutine_handle<> waiter) noexcept {
+        handle.promise().next = waiter;
+        return handle;
+    } // end await_suspend(coroutine_handle<>)
+
+    T await_resume(void) {
+        return handle.promise().result();
+    } // end await_resume()
+
+    // gives up the coroutine, which the caller must then destroy
+    coroutine_handle<promise_type> release(void) {
+        return exchange(handle, nullptr);
+    } // end release()
+private:
+    coroutine_handle<promise_type> handle;  // the coroutine, or null
+
+    explicit Task(coroutine_handle<promise_type> coroutine) :
+            handle(coroutine) {
+    } // end constructor
+
+    Task(const Task&);
+    Task& operator=(const Task&);
+}; // end class Task
+
+#endif	/* TASK_H */
@@ -8,31 +8,37 @@
 // Constructor ----------------------------------------------------------------
 Timer::Timer( ) {
   startTime.tv_sec = 0;
-  startTime.tv_usec = 0;
+  startTime.tv_nsec = 0;
   endTime.tv_sec = 0;
-  endTime.tv_usec = 0;
+  endTime.tv_nsec = 0;
 }
 
 // Memorize the current time in startTime -------------------------------------
+// CLOCK_MONOTONIC does not jump when the wall clock is set
 void Timer::start( ) {
-  gettimeofday( &startTime, NULL );
+  clock_gettime( CLOCK_MONOTONIC, &startTime );
 }
 
 // Get the diff between the start and the curren time -------------------------
 long Timer::lap( ) {
-  gettimeofday( &endTime, NULL );
-  long interval =
-    ( endTime.tv_sec - startTime.tv_sec ) * 1000000 +
-    ( endTime.tv_usec - startTime.tv_usec );
+  return lapNsec( ) / 1000;
+}
+
+// Get the diff between the start and the curren time in nsec -----------------
+long long Timer::lapNsec( ) {
+  clock_gettime( CLOCK_MONOTONIC, &endTime );
+  long long interval =
+    ( endTime.tv_sec - startTime.tv_sec ) * 1000000000LL +
+    ( endTime.tv_nsec - startTime.tv_nsec );
   return interval;
 }
 
 // Get the diff between the old and the current time --------------------------
 long Timer::lap( long oldTv_sec, long oldTv_usec ) {
-  gettimeofday( &endTime, NULL );
+  clock_gettime( CLOCK_MONOTONIC, &endTime );
   long interval =
     ( endTime.tv_sec - oldTv_sec ) * 1000000 +
-    ( endTime.tv_usec - oldTv_usec );
+    ( endTime.tv_nsec / 1000 - oldTv_usec );
   return interval;
 }
 
@@ -43,5 +49,5 @@ long Timer::getSec( ) {
 
 // Get usec -------------------------------------------------------------------
 long Timer::getUsec( ) {
-  return startTime.tv_usec;
+  return startTime.tv_nsec / 1000;
 }
@@ -12,7 +12,7 @@ using namespace std;
 
 extern "C"
 {
-#include <sys/time.h>
+#include <time.h>
 }
 
 class Timer {
@@ -22,10 +22,11 @@ class Timer {
   long lap( );               // endTime - startTime
   long lap( long oldTv_sec, long oldTv_usec ); // endTime - oldTime
   long getSec( );            // get startTime.tv_sec
-  long getUsec( );           // get startTime.tv_usec
+  long getUsec( );           // get startTime in usec past getSec( )
+  long long lapNsec( );      // endTime - startTime in nanoseconds
  private:
-  struct timeval startTime;  // Memorize the time to have started an evaluation
-  struct timeval endTime;    // Memorize the time to have stopped an evaluation
+  struct timespec startTime; // Memorize the time to have started an evaluation
+  struct timespec endTime;   // Memorize the time to have stopped an evaluation
 };
 
 #endif
@@ -0,0 +1,985 @@
+/*
+ * @file   TransferEngine.cpp
+ * @brief  Drives an FTP data connection and its control connection together
+ *          from one thread. Both sockets are made non-blocking and watched
+ *          with epoll, so the payload is moved while the preliminary and
+ *          final replies are collected, and the outcome of the transfer is
+ *          returned to the caller as a TransferResult.
+ * @author Brendan Sweeney, ID #1161836
+ * @date   December 13, 2012
+ */
+
+#include "TransferEngine.h"
+
+
+TransferEngine::TransferEngine(TransferTuner& tuner, ReplyParser& parser,
+                               TransferMetrics& metrics) :
+        tuner(tuner), parser(parser), metrics(metrics), limiter(NULL),
+        flow(NULL), quota((size_t)-1), digest(NULL), dataSd(-1), file(-1),
+        listing(NULL),
+        zeroCopy(false), asyncDisk(true), async(false), reserved(false),
+        fileEnd(-1), zlib(false), compressing(false), ascii(false),
+        shared(NULL), reader(0), writeAt(-1),
+        limit(-1), pending(0), sent(0), offset(0), count(0), syscalls(0),
+        sendPath(0),
+        map(NULL), mapBase(0), mapLen(0) {
+    pipeFd[0] = pipeFd[1] = -1;
+} // end constructor
+
+
+// receives a file into an open descriptor, by splice() if zeroCopy is set
+TransferResult TransferEngine::receive(int ctrlSd, int sd, int out,
+                                       bool splicing) {
+    return receive(ctrlSd, sd, out, -1, -1, splicing);
+} // end receive(int, int, int, bool)
+
+
+// receives up to length bytes into a file starting at offset at, leaving
+// the file position alone; a negative at writes at the current position
+// and a negative length takes everything the server sends; the disk writer
+// takes precedence over splice(), which blocks on the file, and MODE Z over
+// both, as the compressor writes the file itself; TYPE A needs the bytes in
+// hand to translate them, so it uses neither
+TransferResult TransferEngine::receive(int ctrlSd, int sd, int out, off_t at,
+                                       long long length, bool splicing) {
+    writeAt  = at;
+    limit    = length;
+    dataSd   = sd;
+    file     = out;
+    async    = !zlib && !ascii && asyncDisk && disk.start(file, at);
+    reserved = false;
+    fileEnd  = at >= 0 && length >= 0 ? at + length : -1;
+    zeroCopy = splicing && !zlib && !ascii && !async && digest == NULL;
+    lines.reset();
+    compressing = zlib && codec.startInflate(file, at, NULL, digest,
+                                             ascii ? &lines : NULL);
+    tuner.start(dataSd, false);
+
+    if (zeroCopy && pipe(pipeFd) < 0) {
+        zeroCopy = false;
+    } // end if (zeroCopy && ...)
+    if (zeroCopy) {
+        fcntl(pipeFd[1], F_SETPIPE_SZ, (int)tuner.bufferSize());
+    } // end if (zeroCopy)
+    buffer.resize(tuner.bufferSize());
+
+    return run(ctrlSd, TO_FILE);
+} // end receive(int, int, int, off_t, long long, bool)
+
+
+// receives a directory listing into a string
+TransferResult TransferEngine::receive(int ctrlSd, int sd, string& text) {
+    dataSd  = sd;
+    listing = &text;
+    compressing = zlib && codec.startInflate(-1, -1, listing, NULL, NULL);
+    tuner.start(dataSd, false);
+    buffer.resize(tuner.bufferSize());
+
+    return run(ctrlSd, TO_STRING);
+} // end receive(int, int, string&)
+
+
+// sends an open file from its current position; TYPE A is translated in a
+// buffer, so it is always copied
+TransferResult TransferEngine::send(int ctrlSd, int sd, int in) {
+    dataSd   = sd;
+    file     = in;
+    offset   = lseek(file, 0, SEEK_CUR);
+    sendPath = ascii ? 2
+             : digest == NULL ? 0 : 1;  // a checksum needs the bytes mapped
+    pending  = sent = 0;
+    compressing = zlib && codec.startDeflate(file, digest,
+                                             ascii ? &lines : NULL);
+    tuner.start(dataSd, true);
+    buffer.resize(tuner.bufferSize());
+
+    return run(ctrlSd, FROM_FILE);
+} // end send(int, int, int)
+
+
+// sends a file that other connections are sending too, from the chunks
+// source has read into memory; reader numbers this connection in source,
+// which it leaves when done
+TransferResult TransferEngine::send(int ctrlSd, int sd, Broadcast& source,
+                                    int place) {
+    dataSd  = sd;
+    shared  = &source;
+    reader  = place;
+    compressing = false;
+    tuner.start(dataSd, true);
+
+    TransferResult result = run(ctrlSd, FROM_FILE);
+
+    source.leave(place);
+    return result;
+} // end send(int, int, Broadcast&, int)
+
+
+// paces later file transfers with a shared limiter; NULL stops pacing
+void TransferEngine::setRateLimiter(RateLimiter *shared) {
+    limiter = shared;
+} // end setRateLimiter(RateLimiter*)
+
+
+// turns the disk writer on or off for later downloads
+void TransferEngine::setDiskWriter(bool on) {
+    asyncDisk = on;
+} // end setDiskWriter(bool)
+
+
+// checksums the payload of later file transfers as it moves; the bytes
+// must pass through memory, so splice() and sendfile() are not used while
+// it is set; NULL stops checksumming
+void TransferEngine::setChecksum(Checksum *sum) {
+    digest = sum;
+} // end setChecksum(Checksum*)
+
+
+// deflates later uploads and inflates later downloads and listings, for a
+// server that has been put in MODE Z; the compressor feeds any checksum
+void TransferEngine::setCompression(bool on) {
+    zlib = on;
+} // end setCompression(bool)
+
+
+// translates line endings of later file transfers, for a server that has
+// been put in TYPE A: CRLF becomes LF in downloads and LF becomes CRLF in
+// uploads; byte counts are of the data connection, checksums of the file
+void TransferEngine::setText(bool on) {
+    ascii = on;
+} // end setText(bool)
+
+
+// watches both sockets until the data is moved and a final reply arrives
+TransferResult TransferEngine::run(int ctrlSd, mode dir) {
+    TransferResult     result = {0, 0, 0, 0, "", "", 0, -1};
+    struct epoll_event ev, events[4];
+    int    ctrlFlags = fcntl(ctrlSd, F_GETFL);
+    int    dataFlags = fcntl(dataSd, F_GETFL);
+    int    epfd      = epoll_create1(EPOLL_CLOEXEC);
+    int    timerFd   = -1;      // wakes a paused transfer, when limited
+    bool   paused    = false;   // data socket is out of the epoll set
+    bool   backed    = false;   // same, until the disk or codec catches up
+    long   diskCalls = disk.syscalls();
+    bool   opened    = false;   // a 1xx reply has arrived
+    bool   dataDone  = false;   // nothing more will move on the data socket
+    bool   ctrlDone  = false;   // control connection closed or failed
+    Timer  tick;
+
+    count    = 0;
+    syscalls = 0;
+    fcntl(ctrlSd, F_SETFL, ctrlFlags | O_NONBLOCK);
+    fcntl(dataSd, F_SETFL, dataFlags | O_NONBLOCK);
+
+    ev.events  = EPOLLIN;
+    ev.data.fd = ctrlSd;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, ctrlSd, &ev);
+
+    // only a limited file transfer needs a timer; listings are not paced
+    flow = limiter != NULL && dir != TO_STRING ? limiter->join() : NULL;
+    if (flow != NULL) {
+        timerFd    = timerfd_create(CLOCK_MONOTONIC,
+                                    TFD_NONBLOCK | TFD_CLOEXEC);
+        ev.data.fd = timerFd;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, timerFd, &ev);
+    } // end if (flow != NULL)
+
+    // the disk writer says when buffers come free
+    if (async) {
+        ev.data.fd = disk.event();
+        epoll_ctl(epfd, EPOLL_CTL_ADD, disk.event(), &ev);
+    } // end if (async)
+
+    // and so does the compressor, or that it has deflated more to send
+    if (compressing) {
+        ev.data.fd = codec.event();
+        epoll_ctl(epfd, EPOLL_CTL_ADD, codec.event(), &ev);
+    } // end if (compressing)
+
+    // and a shared source, that the slowest reader has freed a chunk
+    if (shared != NULL) {
+        ev.data.fd = shared->event(reader);
+        epoll_ctl(epfd, EPOLL_CTL_ADD, shared->event(reader), &ev);
+    } // end if (shared != NULL)
+
+    // a receiver drains whatever arrives; a sender waits for the 1xx reply
+    if (dir != FROM_FILE) {
+        ev.data.fd = dataSd;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, dataSd, &ev);
+    } // end if (dir != FROM_FILE)
+
+    tick.start();
+    metrics.sent();
+
+    while((result.code == 0 || !dataDone) && !ctrlDone) {
+        int ready = epoll_wait(epfd, events, 4, TIMEOUT);
+
+        ++syscalls;
+
+        if (ready < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("TransferEngine: epoll_wait");
+            break;
+        } // end if (ready < 0)
+        if (ready == 0) {
+            break;      // neither side has moved in TIMEOUT ms
+        } // end if (ready == 0)
+
+        for (int i = 0; i < ready; ++i) {
+            if (events[i].data.fd == ctrlSd) {
+                char     chunk[BUFLEN];
+                ssize_t  l;
+                FtpReply reply;
+
+                while((l = read(ctrlSd, chunk, BUFLEN)) > 0) {
+                    ++syscalls;
+                    parser.feed(chunk, l);
+                } // end while((l = read(...)) > 0)
+                ++syscalls;     // the read that found the socket empty
+                if (l == 0 || (errno != EAGAIN && errno != EINTR)) {
+                    ctrlDone = true;
+                } // end if (l == 0 || ...)
+
+                while(parser.next(reply)) {
+                    if (reply.code / 100 == 1) {
+                        result.preliminary.append(reply.text);
+                        metrics.preliminary(reply.text);
+                        if (!opened && dir == FROM_FILE) {
+                            ev.events  = EPOLLOUT;
+                            ev.data.fd = dataSd;
+                            epoll_ctl(epfd, EPOLL_CTL_ADD, dataSd, &ev);
+                        } // end if (!opened && ...)
+                        opened = true;
+                    } // end if (reply.code / 100 == 1)
+                    else {
+                        result.code   = reply.code;
+                        result.reply += reply.text;
+                        // a refusal or abort ends the data side too
+                        if (reply.code / 100 != 2 && !dataDone) {
+                            dataDone    = true;
+                            result.usec = tick.lap();
+                            metrics.ended();
+                            epoll_ctl(epfd, EPOLL_CTL_DEL, dataSd, NULL);
+                        } // end if (reply.code / 100 != 2 && ...)
+                    } // end else (reply.code / 100 != 1)
+                } // end while(parser.next(reply))
+            } // end if (events[i].data.fd == ctrlSd)
+            else if (events[i].data.fd == timerFd) {
+                uint64_t expired;
+
+                // the bucket has refilled; watch the data socket again
+                read(timerFd, &expired, sizeof(expired));
+                if (paused && !dataDone) {
+                    ev.events  = dir == FROM_FILE ? EPOLLOUT : EPOLLIN;
+                    ev.data.fd = dataSd;
+                    epoll_ctl(epfd, EPOLL_CTL_ADD, dataSd, &ev);
+                } // end if (paused && !dataDone)
+                paused = false;
+            } // end else if (events[i].data.fd == timerFd)
+            else if ((async && events[i].data.fd == disk.event())
+                     || (compressing && events[i].data.fd == codec.event())
+                     || (shared != NULL
+                         && events[i].data.fd == shared->event(reader))) {
+                // a failed write surfaces at the next pump
+                if (async) {
+                    disk.reap();
+                } // end if (async)
+                else if (compressing) {
+                    codec.reap();
+                } // end else if (compressing)
+                else {
+                    shared->reap(reader);
+                } // end else (shared != NULL)
+                if (backed && !dataDone) {
+                    ev.events  = dir == FROM_FILE ? EPOLLOUT : EPOLLIN;
+                    ev.data.fd = dataSd;
+                    epoll_ctl(epfd, EPOLL_CTL_ADD, dataSd, &ev);
+                } // end if (backed && !dataDone)
+                backed = false;
+            } // end else if ((async && ...) || ...)
+            else if (!dataDone) {
+                status moved;
+
+                if (flow == NULL) {
+                    while((moved = pump(dir)) == MOVED) {
+                    } // end while((moved = pump(dir)) == MOVED)
+                } // end if (flow == NULL)
+                else {
+                    moved = pumpLimited(dir);
+                } // end else (flow != NULL)
+                metrics.moved(compressing ? codec.bytes() : count);
+
+                // out of tokens: sleep on the timer, not on a ready socket
+                if (moved == THROTTLED) {
+                    struct itimerspec wait = {{0, 0}, {0, 0}};
+                    long long         ns   = limiter->delay(flow);
+
+                    wait.it_value.tv_sec  = ns / 1000000000LL;
+                    wait.it_value.tv_nsec = ns % 1000000000LL;
+                    epoll_ctl(epfd, EPOLL_CTL_DEL, dataSd, NULL);
+                    timerfd_settime(timerFd, 0, &wait, NULL);
+                    paused = true;
+                    continue;
+                } // end if (moved == THROTTLED)
+
+                // every buffer is with the disk writer or the compressor;
+                // leave the socket until one comes back rather than block
+                if (moved == WAITING) {
+                    epoll_ctl(epfd, EPOLL_CTL_DEL, dataSd, NULL);
+                    backed = true;
+                    continue;
+                } // end if (moved == WAITING)
+
+                if (moved != BLOCKED) {
+                    dataDone    = true;
+                    result.usec = tick.lap();
+                    metrics.ended();
+                    epoll_ctl(epfd, EPOLL_CTL_DEL, dataSd, NULL);
+
+                    // EOF completes an upload; otherwise make the server
+                    // give up on the connection instead of waiting on it
+                    shutdown(dataSd, moved == FINISHED && dir == FROM_FILE
+                                     ? SHUT_WR : SHUT_RDWR);
+                } // end if (moved != BLOCKED)
+            } // end else if (!dataDone)
+        } // end for (i < ready)
+    } // end while((result.code == 0...)
+
+    if (!dataDone) {
+        result.usec = tick.lap();
+    } // end if (!dataDone)
+    result.bytes    = count;
+    result.syscalls = syscalls;
+
+    // an aborted download still has writes out on its buffers
+    if (async) {
+        long long started = TransferMetrics::now();
+
+        disk.finish();
+        metrics.disk(TransferMetrics::now() - started);
+        async = false;
+    } // end if (async)
+    result.syscalls += disk.syscalls() - diskCalls;
+
+    // so does one being inflated, and the compressor counts file bytes
+    if (compressing) {
+        codec.finish();
+        result.plain     = codec.bytes();
+        result.syscalls += codec.syscalls();
+        compressing      = false;
+    } // end if (compressing)
+
+    fcntl(ctrlSd, F_SETFL, ctrlFlags);
+    fcntl(dataSd, F_SETFL, dataFlags);
+    close(epfd);
+    if (flow != NULL) {
+        close(timerFd);
+        limiter->leave(flow);
+        flow  = NULL;
+        quota = (size_t)-1;
+    } // end if (flow != NULL)
+    tuner.finish(count, result.usec);
+    metrics.finish(result.code);
+    release();
+
+    return result;
+} // end run(int, mode)
+
+
+// moves as much as one call allows in the direction of the transfer
+TransferEngine::status TransferEngine::pump(mode dir) {
+    switch (dir) {
+        case TO_FILE:
+            if (zlib)
+                return compressing ? pumpInflate() : FAILED;
+            if (async)
+                return pumpAsync();
+            return zeroCopy ? pumpSplice() : pumpCopy();
+        case TO_STRING:
+            if (zlib)
+                return compressing ? pumpInflate() : FAILED;
+            return pumpString();
+        case FROM_FILE:
+            if (shared != NULL)
+                return pumpShared();
+            if (zlib)
+                return compressing ? pumpDeflate() : FAILED;
+            if (sendPath == 0)
+                return pumpSendfile();
+            if (sendPath == 1)
+                return pumpMapped();
+            return pumpCopyOut();
+        default:
+            return FAILED;
+    } // end switch (dir)
+} // end pump(mode)
+
+
+// pumps while the limiter grants bytes, then reports THROTTLED
+TransferEngine::status TransferEngine::pumpLimited(mode dir) {
+    status moved = MOVED;
+
+    while(moved == MOVED) {
+        long long before = count;
+
+        if ((quota = limiter->grant(flow)) == 0) {
+            return THROTTLED;
+        } // end if ((quota = ...) == 0)
+        moved = pump(dir);
+        limiter->consume(flow, count - before);
+    } // end while(moved == MOVED)
+
+    return moved;
+} // end pumpLimited(mode)
+
+
+// moves socket data into the file through the pipe without copying it into
+// user space; switches to pumpCopy() if splice() is not supported
+TransferEngine::status TransferEngine::pumpSplice(void) {
+    size_t  len = wanted(tuner.bufferSize());
+    ssize_t in;
+
+    if (len == 0)
+        return FINISHED;
+    ++syscalls;
+    in = splice(dataSd, NULL, pipeFd[1], NULL, len,
+                SPLICE_F_MOVE | SPLICE_F_MORE | SPLICE_F_NONBLOCK);
+    if (in == 0)
+        return FINISHED;
+    if (in < 0) {
+        if (errno == EINTR)
+            return MOVED;
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return BLOCKED;
+        if (count == 0 && (errno == EINVAL || errno == ENOSYS)) {
+            zeroCopy = false;
+            return MOVED;
+        } // end if (count == 0 && ...)
+        perror("pumpSplice(): splice from socket");
+        return FAILED;
+    } // end if (in < 0)
+
+    // a full pipe means more is waiting; let it hold more next time
+    bool filled = (size_t)in == len;
+
+    // drain everything just moved into the pipe out to the file
+    long long started = TransferMetrics::now();
+
+    while(in > 0) {
+        ++syscalls;
+        ssize_t out = splice(pipeFd[0], NULL, file,
+                             writeAt < 0 ? NULL : &writeAt, in,
+                             SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (out < 0 && errno == EINTR)
+            continue;
+        if (out <= 0) {
+            // file cannot take spliced pages; copy what the pipe holds
+            while(in > 0) {
+                ++syscalls;
+                ssize_t l = read(pipeFd[0], &buffer[0],
+                                 (size_t)in < buffer.size() ? in
+                                                            : buffer.size());
+                if (l <= 0 || !store(&buffer[0], l)) {
+                    perror("pumpSplice(): write");
+                    return FAILED;
+                } // end if (l <= 0 || ...)
+                count += l;
+                in    -= l;
+            } // end while(in > 0)
+            zeroCopy = false;
+            return MOVED;
+        } // end if (out <= 0)
+        count += out;
+        in    -= out;
+    } // end while(in > 0)
+    metrics.disk(TransferMetrics::now() - started);
+
+    if (tuner.sample(count, filled)) {
+        fcntl(pipeFd[1], F_SETPIPE_SZ, (int)tuner.bufferSize());
+    } // end if (tuner.sample(...))
+
+    return MOVED;
+} // end pumpSplice()
+
+
+// copies socket data into the file through a user-space buffer; in TYPE A
+// the first byte is kept spare for a CR that lines held back
+TransferEngine::status TransferEngine::pumpCopy(void) {
+    char   *into = &buffer[ascii ? 1 : 0];
+    size_t  len  = wanted(buffer.size() - (ascii ? 1 : 0));
+    ssize_t l;
+
+    if (len == 0)
+        return settle();
+    ++syscalls;
+    l = read(dataSd, into, len);
+    if (l == 0)
+        return settle();
+    if (l < 0) {
+        if (errno == EINTR)
+            return MOVED;
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return BLOCKED;
+        perror("pumpCopy(): read");
+        return FAILED;
+    } // end if (l < 0)
+
+    char   *data = into;
+    size_t  out  = l;
+
+    if (ascii) {
+        data = lines.toLocal(into, out);
+    } // end if (ascii)
+    if (!store(data, out)) {
+        perror("pumpCopy(): write");
+        return FAILED;
+    } // end if (!store(...))
+    if (digest != NULL) {
+        digest->update(data, out);
+    } // end if (digest != NULL)
+    count += l;
+
+    if (tuner.sample(count, (size_t)l == buffer.size())) {
+        buffer.resize(tuner.bufferSize());
+    } // end if (tuner.sample(...))
+
+    return MOVED;
+} // end pumpCopy()
+
+
+// ends a copied download; a CR that ended a TYPE A stream was not part of
+// a CRLF, and is written out now
+TransferEngine::status TransferEngine::settle(void) {
+    if (!ascii || !lines.held())
+        return FINISHED;
+    if (!store("\r", 1)) {
+        perror("settle(): write");
+        return FAILED;
+    } // end if (!store("\r", 1))
+    if (digest != NULL) {
+        digest->update("\r", 1);
+    } // end if (digest != NULL)
+    lines.reset();
+
+    return FINISHED;
+} // end settle()
+
+
+// reads socket data straight into the disk writer's next free buffer; the
+// file is written behind the socket, so a slow disk does not stall it
+TransferEngine::status TransferEngine::pumpAsync(void) {
+    size_t  room;
+    char   *at;
+    ssize_t l;
+
+    // the size may only be known once the 1xx reply has been read
+    if (!reserved) {
+        long long end = fileEnd >= 0 ? fileEnd : metrics.last().size;
+
+        if (end >= 0) {
+            disk.reserve(end);
+            reserved = true;
+        } // end if (end >= 0)
+    } // end if (!reserved)
+
+    if ((at = disk.space(room)) == NULL)
+        return WAITING;
+
+    size_t len = wanted(room < tuner.bufferSize() ? room
+                                                  : tuner.bufferSize());
+
+    if (len == 0)
+        return flush();
+    ++syscalls;
+    l = read(dataSd, at, len);
+    if (l == 0)
+        return flush();
+    if (l < 0) {
+        if (errno == EINTR)
+            return MOVED;
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return BLOCKED;
+        perror("pumpAsync(): read");
+        return FAILED;
+    } // end if (l < 0)
+    if (digest != NULL) {
+        digest->update(at, l);
+    } // end if (digest != NULL)
+
+    long long started = TransferMetrics::now();
+
+    if (!disk.commit(l)) {
+        perror("pumpAsync(): write");
+        return FAILED;
+    } // end if (!disk.commit(l))
+    metrics.disk(TransferMetrics::now() - started);
+    count += l;
+    tuner.sample(count, (size_t)l == len);
+
+    return MOVED;
+} // end pumpAsync()
+
+
+// waits for the disk writer to write out everything received
+TransferEngine::status TransferEngine::flush(void) {
+    long long started = TransferMetrics::now();
+    bool      written = disk.finish();
+
+    metrics.disk(TransferMetrics::now() - started);
+    if (!written) {
+        perror("flush(): write");
+        return FAILED;
+    } // end if (!written)
+
+    return FINISHED;
+} // end flush()
+
+
+// appends socket data to the listing
+TransferEngine::status TransferEngine::pumpString(void) {
+    ssize_t l = read(dataSd, &buffer[0], buffer.size());
+
+    ++syscalls;
+    if (l == 0)
+        return FINISHED;
+    if (l < 0) {
+        if (errno == EINTR)
+            return MOVED;
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return BLOCKED;
+        perror("pumpString(): read");
+        return FAILED;
+    } // end if (l < 0)
+
+    listing->append(&buffer[0], l);
+    count += l;
+    return MOVED;
+} // end pumpString()
+
+
+// trims a read size so that a ranged receive stops at its last byte and a
+// limited transfer stays within its grant
+size_t TransferEngine::wanted(size_t len) const {
+    if (len > quota) {
+        len = quota;
+    } // end if (len > quota)
+    if (limit >= 0 && (long long)len > limit - count) {
+        return limit - count;
+    } // end if (limit >= 0 && ...)
+    return len;
+} // end wanted(size_t)
+
+
+// writes a whole buffer to the file, at writeAt when a range is set
+bool TransferEngine::store(const char *data, size_t len) {
+    long long started = TransferMetrics::now();
+
+    while(len > 0) {
+        ++syscalls;
+        ssize_t w = writeAt < 0 ? write(file, data, len)
+                                : pwrite(file, data, len, writeAt);
+        if (w < 0 && errno == EINTR)
+            continue;
+        if (w <= 0)
+            return false;
+        if (writeAt >= 0)
+            writeAt += w;
+        data += w;
+        len  -= w;
+    } // end while(len > 0)
+
+    metrics.disk(TransferMetrics::now() - started);
+    return true;
+} // end store(const char*, size_t)
+
+
+// pushes the file from the page cache to the socket with sendfile();
+// switches to pumpMapped() if the file cannot be a sendfile() source
+TransferEngine::status TransferEngine::pumpSendfile(void) {
+    size_t  len = wanted(tuner.bufferSize());
+    ssize_t l   = sendfile(dataSd, file, &offset, len);
+
+    ++syscalls;
+    if (l == 0)
+        return FINISHED;
+    if (l < 0) {
+        if (errno == EINTR)
+            return MOVED;
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return BLOCKED;
+        if (errno == EINVAL || errno == ENOSYS) {
+            sendPath = 1;
+            return MOVED;
+        } // end if (errno == EINVAL...)
+        perror("pumpSendfile(): sendfile");
+        return FAILED;
+    } // end if (l < 0)
+
+    count += l;     // offset has already been advanced by sendfile()
+    tuner.sample(count, (size_t)l == len);
+    return MOVED;
+} // end pumpSendfile()
+
+
+// maps the file in large windows and sends each window with batched
+// writev() calls; switches to pumpCopyOut() if the file cannot be mapped
+TransferEngine::status TransferEngine::pumpMapped(void) {
+    const off_t window = (off_t)IOV_LEN * IOV_COUNT;
+
+    if (map == NULL) {
+        struct stat info;
+
+        if (fstat(file, &info) < 0 || !S_ISREG(info.st_mode)) {
+            lseek(file, offset, SEEK_SET);
+            sendPath = 2;
+            return MOVED;
+        } // end if (fstat(...) < 0...)
+        if (offset >= info.st_size)
+            return FINISHED;
+
+        mapBase = offset - offset % window;     // keep mmap() page aligned
+        mapLen  = info.st_size - mapBase < window ? info.st_size - mapBase
+                                                  : window;
+        map     = (char *)mmap(NULL, mapLen, PROT_READ, MAP_SHARED, file,
+                               mapBase);
+        if (map == MAP_FAILED) {
+            map = NULL;
+            lseek(file, offset, SEEK_SET);
+            sendPath = 2;
+            return MOVED;
+        } // end if (map == MAP_FAILED)
+        madvise(map, mapLen, MADV_SEQUENTIAL);
+    } // end if (map == NULL)
+
+    struct iovec vec[IOV_COUNT];
+    size_t       at   = offset - mapBase;
+    size_t       room = wanted((size_t)IOV_LEN * IOV_COUNT);
+    int          cnt  = 0;
+
+    while(cnt < IOV_COUNT && at < mapLen && room > 0) {
+        vec[cnt].iov_base = map + at;
+        vec[cnt].iov_len  = mapLen - at < (size_t)IOV_LEN ? mapLen - at
+                                                          : IOV_LEN;
+        if (vec[cnt].iov_len > room) {
+            vec[cnt].iov_len = room;
+        } // end if (vec[cnt].iov_len > room)
+        at   += vec[cnt].iov_len;
+        room -= vec[cnt].iov_len;
+        ++cnt;
+    } // end while(cnt < IOV_COUNT...)
+
+    ssize_t l = writev(dataSd, vec, cnt);
+    ++syscalls;
+    if (l < 0) {
+        if (errno == EINTR)
+            return MOVED;
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return BLOCKED;
+        perror("pumpMapped(): writev");
+        return FAILED;
+    } // end if (l < 0)
+
+    if (digest != NULL) {
+        digest->update(map + (offset - mapBase), l);
+    } // end if (digest != NULL)
+    count  += l;
+    offset += l;
+    if ((size_t)(offset - mapBase) >= mapLen) {
+        munmap(map, mapLen);
+        map = NULL;
+    } // end if (offset - mapBase >= mapLen)
+
+    return MOVED;
+} // end pumpMapped()
+
+
+// copies the file to the socket through a user-space buffer; in TYPE A
+// the file is read into text and translated into the buffer, which has
+// room for every LF to gain a CR
+TransferEngine::status TransferEngine::pumpCopyOut(void) {
+    if (sent == pending) {
+        size_t    room    = ascii ? buffer.size() / 2 : buffer.size();
+        char     *into    = &buffer[0];
+
+        if (ascii) {
+            text.resize(room);
+            into = &text[0];
+        } // end if (ascii)
+
+        long long started = TransferMetrics::now();
+        ssize_t   l       = read(file, into, room);
+
+        metrics.disk(TransferMetrics::now() - started);
+        ++syscalls;
+        if (l == 0)
+            return FINISHED;
+        if (l < 0) {
+            if (errno == EINTR)
+                return MOVED;
+            perror("pumpCopyOut(): read");
+            return FAILED;
+        } // end if (l < 0)
+        pending = l;
+        sent    = 0;
+        if (ascii) {
+            if (digest != NULL) {
+                digest->update(into, l);
+            } // end if (digest != NULL)
+            pending = Newlines::toNetwork(into, l, &buffer[0]);
+        } // end if (ascii)
+    } // end if (sent == pending)
+
+    ssize_t w = write(dataSd, &buffer[sent], wanted(pending - sent));
+    ++syscalls;
+    if (w < 0) {
+        if (errno == EINTR)
+            return MOVED;
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return BLOCKED;
+        perror("pumpCopyOut(): write");
+        return FAILED;
+    } // end if (w < 0)
+
+    if (digest != NULL && !ascii) {
+        digest->update(&buffer[sent], w);
+    } // end if (digest != NULL && !ascii)
+    sent  += w;
+    count += w;
+    if (sent == pending && tuner.sample(count, pending == buffer.size())) {
+        buffer.resize(tuner.bufferSize());
+    } // end if (sent == pending && ...)
+
+    return MOVED;
+} // end pumpCopyOut()
+
+
+// reads compressed socket data into the compressor, whose thread inflates
+// it into the file or listing
+TransferEngine::status TransferEngine::pumpInflate(void) {
+    size_t  room;
+    char   *at = codec.space(room);
+    ssize_t l;
+
+    if (at == NULL)
+        return WAITING;
+
+    size_t len = wanted(room);
+
+    ++syscalls;
+    l = read(dataSd, at, len);
+    if (l == 0) {
+        if (codec.finish())
+            return FINISHED;
+        fputs("pumpInflate(): MODE Z data is corrupt or cut short, or the "
+              "file could not be written\n", stderr);
+        return FAILED;
+    } // end if (l == 0)
+    if (l < 0) {
+        if (errno == EINTR)
+            return MOVED;
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return BLOCKED;
+        perror("pumpInflate(): read");
+        return FAILED;
+    } // end if (l < 0)
+
+    if (!codec.commit(l)) {
+        fputs("pumpInflate(): MODE Z data is corrupt, or the file could not "
+              "be written\n", stderr);
+        return FAILED;
+    } // end if (!codec.commit(l))
+    count += l;
+    tuner.sample(count, (size_t)l == len);
+
+    return MOVED;
+} // end pumpInflate()
+
+
+// sends what the compressor's thread has deflated from the file
+TransferEngine::status TransferEngine::pumpDeflate(void) {
+    size_t      len;
+    const char *data = codec.peek(len);
+
+    if (data == NULL) {
+        if (!codec.drained())
+            return WAITING;
+        if (codec.finish())
+            return FINISHED;
+        fputs("pumpDeflate(): the file could not be read\n", stderr);
+        return FAILED;
+    } // end if (data == NULL)
+
+    ssize_t w = write(dataSd, data, wanted(len));
+    ++syscalls;
+    if (w < 0) {
+        if (errno == EINTR)
+            return MOVED;
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return BLOCKED;
+        perror("pumpDeflate(): write");
+        return FAILED;
+    } // end if (w < 0)
+
+    codec.consume(w);
+    count += w;
+    return MOVED;
+} // end pumpDeflate()
+
+
+// sends what a shared source holds for this connection; waits when the
+// next chunk is not read yet and this connection is a window ahead
+TransferEngine::status TransferEngine::pumpShared(void) {
+    size_t      len;
+    const char *data = shared->peek(reader, len);
+
+    if (data == NULL) {
+        if (shared->drained(reader))
+            return FINISHED;
+        if (!shared->failed())
+            return WAITING;
+        fputs("pumpShared(): the file could not be read\n", stderr);
+        return FAILED;
+    } // end if (data == NULL)
+
+    ssize_t w = write(dataSd, data, wanted(len));
+    ++syscalls;
+    if (w < 0) {
+        if (errno == EINTR)
+            return MOVED;
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return BLOCKED;
+        perror("pumpShared(): write");
+        return FAILED;
+    } // end if (w < 0)
+
+    if (digest != NULL) {
+        digest->update(data, w);
+    } // end if (digest != NULL)
+    shared->consume(reader, w);
+    count += w;
+    tuner.sample(count, (size_t)w == len);
+
+    return MOVED;
+} // end pumpShared()
+
+
+// frees everything held for the finished transfer
+void TransferEngine::release(void) {
+    if (pipeFd[0] >= 0) {
+        close(pipeFd[0]);
+        close(pipeFd[1]);
+        pipeFd[0] = pipeFd[1] = -1;
+    } // end if (pipeFd[0] >= 0)
+    if (map != NULL) {
+        munmap(map, mapLen);
+        map = NULL;
+    } // end if (map != NULL)
+
+    listing = NULL;
+    shared  = NULL;
+    writeAt = -1;
+    limit   = -1;
+    file    = -1;
+    dataSd  = -1;
+} // end release()
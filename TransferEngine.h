@@ -0,0 +1,136 @@
+/*
+ * @file   TransferEngine.h
+ * @brief  Drives an FTP data connection and its control connection together
+ *          from one thread. Both sockets are made non-blocking and watched
+ *          with epoll, so the payload is moved while the preliminary and
+ *          final replies are collected, and the outcome of the transfer is
+ *          returned to the caller as a TransferResult.
+ * @author Brendan Sweeney, ID #1161836
+ * @date   December 13, 2012
+ */
+
+#ifndef TRANSFERENGINE_H
+#define	TRANSFERENGINE_H
+
+#include <sys/epoll.h>      // epoll_create1, epoll_ctl, epoll_wait
+#include <sys/mman.h>       // mmap, madvise
+#include <sys/sendfile.h>   // sendfile
+#include <sys/socket.h>     // shutdown
+#include <sys/stat.h>       // fstat
+#include <sys/timerfd.h>    // timerfd_create, timerfd_settime
+#include <sys/types.h>
+#include <sys/uio.h>        // writev
+#include <errno.h>
+#include <fcntl.h>          // fcntl, splice
+#include <stdio.h>          // perror
+#include <unistd.h>         // read, write, close, pipe
+#include <string>
+#include <vector>
+#include "Broadcast.h"
+#include "Checksum.h"
+#include "Compressor.h"
+#include "DiskWriter.h"
+#include "Newlines.h"
+#include "RateLimiter.h"
+#include "ReplyParser.h"
+#include "Timer.h"
+#include "TransferMetrics.h"
+#include "TransferTuner.h"
+
+using namespace std;
+
+
+// outcome of one data transfer
+struct TransferResult {
+    long long bytes;        // payload bytes moved over the data connection
+    long      usec;         // time spent moving them, in microseconds
+    long      syscalls;     // system calls made while moving them
+    int       code;         // final reply code, or 0 if none arrived
+    string    preliminary;  // 1xx reply that opened the transfer
+    string    reply;        // final reply that closed the transfer
+    int       verified;     // 1 checksums matched, -1 differed, 0 unchecked
+    long long plain;        // file or listing bytes under MODE Z, else -1
+};
+
+
+class TransferEngine {
+public:
+    TransferEngine(TransferTuner& tuner, ReplyParser& parser,
+                   TransferMetrics& metrics);
+    TransferResult receive(int ctrlSd, int dataSd, int file, bool zeroCopy);
+    TransferResult receive(int ctrlSd, int dataSd, int file, off_t at,
+                           long long length, bool zeroCopy);
+    TransferResult receive(int ctrlSd, int dataSd, string& listing);
+    TransferResult send(int ctrlSd, int dataSd, int file);
+    TransferResult send(int ctrlSd, int dataSd, Broadcast& source,
+                        int reader);
+    void   setRateLimiter(RateLimiter *limiter);
+    void   setDiskWriter(bool on);
+    void   setChecksum(Checksum *sum);
+    void   setCompression(bool on);
+    void   setText(bool on);
+private:
+    enum   mode   {TO_FILE, TO_STRING, FROM_FILE};
+    enum   status {MOVED, BLOCKED, THROTTLED, WAITING, FINISHED, FAILED};
+    static const int TIMEOUT   = 60000,     // idle milliseconds before abort
+                     BUFLEN    = 1448,      // control read size
+                     IOV_LEN   = 1048576,   // bytes per writev() segment
+                     IOV_COUNT = 16;        // segments per writev() batch
+    TransferTuner& tuner;       // sizes buffers for the data connection
+    ReplyParser&   parser;      // assembles replies from the control socket
+    TransferMetrics& metrics;   // records where the time went
+    RateLimiter *limiter;       // paces file transfers, if set
+    RateLimiter::Flow *flow;    // this transfer's bucket, or NULL
+    size_t quota;               // bytes the next pump may move
+    Checksum *digest;           // fed every payload byte, if set
+    int    dataSd;              // data connection of the current transfer
+    int    file;                // local file read or written
+    string *listing;            // destination of a listing
+    bool   zeroCopy;            // splice() into the file while it works
+    DiskWriter disk;            // writes downloads behind the socket
+    bool   asyncDisk;           // hand file writes to disk when it can
+    bool   async;               // disk is writing the current transfer
+    bool   reserved;            // disk has been told the file size
+    long long fileEnd;          // offset a ranged receive stops at, or -1
+    Compressor codec;           // deflates or inflates on its own thread
+    bool   zlib;                // the data connection is in MODE Z
+    bool   compressing;         // codec is running the current transfer
+    bool   ascii;               // the data connection is in TYPE A
+    Newlines lines;             // translates its line endings
+    vector<char> text;          // file bytes read before translation
+    Broadcast *shared;          // source of a fan-out upload, or NULL
+    int    reader;              // this connection's place in shared
+    loff_t writeAt;             // file offset to write at, or -1 to append
+    long long limit;            // bytes wanted, or -1 for everything
+    int    pipeFd[2];           // splice() staging pipe
+    vector<char> buffer;        // user-space staging buffer
+    size_t pending, sent;       // unsent bytes staged in buffer
+    off_t  offset;              // next file byte to send
+    long long count;            // payload bytes moved so far
+    long   syscalls;            // system calls made by the current transfer
+    int    sendPath;            // 0 sendfile, 1 mapped writev, 2 copy
+    char   *map;                // current mapped window of the file
+    off_t  mapBase;             // file offset of map
+    size_t mapLen;              // length of map
+
+    TransferResult run(int ctrlSd, mode dir);
+    status pump(mode dir);
+    status pumpLimited(mode dir);
+    status pumpSplice(void);
+    status pumpCopy(void);
+    status settle(void);
+    status pumpAsync(void);
+    status flush(void);
+    status pumpString(void);
+    status pumpSendfile(void);
+    status pumpMapped(void);
+    status pumpCopyOut(void);
+    status pumpInflate(void);
+    status pumpDeflate(void);
+    status pumpShared(void);
+    size_t wanted(size_t len) const;
+    bool   store(const char *data, size_t len);
+    void   release(void);
+}; // end class TransferEngine
+
+#endif	/* TRANSFERENGINE_H */
@@ -0,0 +1,338 @@
+/*
+ * @file   TransferMetrics.cpp
+ * @brief  Records where the time of each FTP transfer went, on the monotonic
+ *          clock in nanoseconds: the PASV round trip, the data connect, the
+ *          wait for the first byte, the transfer itself, time in the disk,
+ *          stalls and the final reply, plus the rates seen along the way and
+ *          the round trips of control commands. Can draw a live progress bar
+ *          and append one JSON line per transfer to a log.
+ * @author Brendan Sweeney, ID #1161836
+ * @date   December 13, 2012
+ */
+
+#include "TransferMetrics.h"
+
+
+TransferMetrics::TransferMetrics() : progress(false), drawn(false), log(NULL),
+                                     began(0), sentAt(0), firstAt(0),
+                                     endedAt(0), lastMove(0), sampleAt(0),
+                                     sampleBytes(0), transfers(0),
+                                     failures(0), totalBytes(0), totalNs(0),
+                                     commands(0), rttTotal(0), rttMin(0),
+                                     rttMax(0), rttLast(0) {
+    begin("", "", -1);
+} // end default constructor
+
+
+TransferMetrics::~TransferMetrics() {
+    if (log != NULL) {
+        fclose(log);
+    } // end if (log != NULL)
+} // end destructor
+
+
+// nanoseconds on a clock that never jumps
+long long TransferMetrics::now(void) {
+    struct timespec at;
+
+    clock_gettime(CLOCK_MONOTONIC, &at);
+    return at.tv_sec * 1000000000LL + at.tv_nsec;
+} // end now()
+
+
+// turns the progress bar on or off
+void TransferMetrics::setProgress(bool on) {
+    progress = on;
+} // end setProgress(bool)
+
+
+// appends a JSON line per transfer to a file; an empty path stops logging
+bool TransferMetrics::setLog(const string& path) {
+    if (log != NULL) {
+        fclose(log);
+        log = NULL;
+    } // end if (log != NULL)
+
+    if (!path.empty() && (log = fopen(path.c_str(), "a")) == NULL) {
+        perror(path.c_str());
+        return false;
+    } // end if (!path.empty() && ...)
+
+    return true;
+} // end setLog(const string&)
+
+
+// starts a new record, before the PASV of the transfer
+void TransferMetrics::begin(const string& verb, const string& name,
+                            long long size) {
+    current.verb      = verb;
+    current.name      = name;
+    current.size      = size;
+    current.bytes     = 0;
+    current.passive   = 0;
+    current.connect   = 0;
+    current.firstByte = 0;
+    current.transfer  = 0;
+    current.disk      = 0;
+    current.final     = 0;
+    current.stalls    = 0;
+    current.stalled   = 0;
+    current.rate      = 0.0;
+    current.smoothed  = 0.0;
+    current.peak      = 0.0;
+    current.code      = 0;
+
+    began   = now();
+    sentAt  = firstAt = endedAt = 0;
+    drawn   = false;
+} // end begin(const string&, const string&, long long)
+
+
+// the PASV round trip of the current transfer
+void TransferMetrics::passive(long long ns) {
+    current.passive = ns;
+} // end passive(long long)
+
+
+// how long the data connection took to set up
+void TransferMetrics::connected(long long ns) {
+    current.connect = ns;
+} // end connected(long long)
+
+
+// marks the transfer command as sent; the wait for data starts here
+void TransferMetrics::sent(void) {
+    sentAt      = now();
+    lastMove    = sentAt;
+    sampleAt    = sentAt;
+    sampleBytes = 0;
+} // end sent()
+
+
+// takes the expected size from a 1xx reply such as "(1234 bytes)" when
+// the caller did not know it
+void TransferMetrics::preliminary(const string& text) {
+    size_t open = text.rfind('(');
+
+    if (current.size < 0 && open != string::npos
+            && text.find(" bytes)", open) != string::npos) {
+        current.size = strtoll(text.c_str() + open + 1, NULL, 10);
+    } // end if (current.size < 0 && ...)
+} // end preliminary(const string&)
+
+
+// called by the transfer loop with the running byte count
+void TransferMetrics::moved(long long count) {
+    if (count <= current.bytes) {
+        return;
+    } // end if (count <= current.bytes)
+
+    long long at = now();
+
+    if (firstAt == 0) {
+        firstAt           = at;
+        current.firstByte = at - sentAt;
+    } // end if (firstAt == 0)
+    else if (at - lastMove >= STALL) {
+        ++current.stalls;
+        current.stalled += at - lastMove;
+    } // end else if (at - lastMove >= STALL)
+    lastMove      = at;
+    current.bytes = count;
+
+    if (at - sampleAt >= SAMPLE) {
+        current.rate     = (double)(count - sampleBytes) * 1e9
+                           / (at - sampleAt);
+        current.smoothed = current.smoothed == 0.0
+                           ? current.rate
+                           : 0.7 * current.smoothed + 0.3 * current.rate;
+        if (current.rate > current.peak) {
+            current.peak = current.rate;
+        } // end if (current.rate > current.peak)
+        sampleAt    = at;
+        sampleBytes = count;
+
+        if (progress) {
+            draw();
+        } // end if (progress)
+    } // end if (at - sampleAt >= SAMPLE)
+} // end moved(long long)
+
+
+// adds time spent reading or writing the local file
+void TransferMetrics::disk(long long ns) {
+    current.disk += ns;
+} // end disk(long long)
+
+
+// marks the end of the data; a transfer too short to be sampled gets its
+// average as every rate
+void TransferMetrics::ended(void) {
+    if (endedAt != 0) {
+        return;
+    } // end if (endedAt != 0)
+
+    endedAt = now();
+    if (firstAt != 0) {
+        current.transfer = endedAt - firstAt;
+        if (endedAt - lastMove >= STALL) {
+            ++current.stalls;
+            current.stalled += endedAt - lastMove;
+        } // end if (endedAt - lastMove >= STALL)
+    } // end if (firstAt != 0)
+
+    if (current.peak == 0.0 && current.transfer > 0) {
+        current.rate     = (double)current.bytes * 1e9 / current.transfer;
+        current.smoothed = current.rate;
+        current.peak     = current.rate;
+    } // end if (current.peak == 0.0 && ...)
+} // end ended()
+
+
+// closes the record once the final reply is in and adds it to the totals
+void TransferMetrics::finish(int code) {
+    ended();
+    current.final = now() - endedAt;
+    current.code  = code;
+
+    ++transfers;
+    if (code / 100 != 2) {
+        ++failures;
+    } // end if (code / 100 != 2)
+    totalBytes += current.bytes;
+    totalNs    += now() - began;
+
+    // clear the bar; the caller prints its own summary line
+    if (drawn) {
+        fprintf(stderr, "\r%*s\r", BAR_WIDTH + 50, "");
+        drawn = false;
+    } // end if (drawn)
+    record();
+} // end finish(int)
+
+
+// adds the round trip of one control command
+void TransferMetrics::command(long long ns) {
+    if (commands == 0 || ns < rttMin) {
+        rttMin = ns;
+    } // end if (commands == 0 || ...)
+    if (ns > rttMax) {
+        rttMax = ns;
+    } // end if (ns > rttMax)
+    rttLast   = ns;
+    rttTotal += ns;
+    ++commands;
+} // end command(long long)
+
+
+// the latest transfer, finished or not
+const TransferStats& TransferMetrics::last(void) const {
+    return current;
+} // end last()
+
+
+// the counters, for people; times are shown in milliseconds
+string TransferMetrics::summary(void) const {
+    ostringstream text;
+    double        ms = 1000000.0;
+
+    text.setf(ios::fixed);
+    text.precision(3);
+    text << "Transfers: " << transfers << " (" << failures << " failed), "
+         << totalBytes << " bytes in " << totalNs / 1e9 << " seconds";
+    if (totalNs > 0) {
+        text << " (" << totalBytes * 1e6 / totalNs << " Kbytes/s)";
+    } // end if (totalNs > 0)
+    text << endl;
+
+    if (transfers > 0) {
+        text << "Last: " << current.verb << " " << current.name << ", "
+             << current.bytes << " of ";
+        if (current.size >= 0) {
+            text << current.size;
+        } // end if (current.size >= 0)
+        else {
+            text << "?";
+        } // end else (current.size < 0)
+        text << " bytes, reply " << current.code << endl
+             << "  PASV " << current.passive / ms << " ms, connect "
+             << current.connect / ms << " ms, first byte "
+             << current.firstByte / ms << " ms, transfer "
+             << current.transfer / ms << " ms" << endl
+             << "  disk " << current.disk / ms << " ms, final reply "
+             << current.final / ms << " ms, " << current.stalls
+             << " stalls (" << current.stalled / ms << " ms)" << endl
+             << "  rate " << current.rate / 1000.0 << " Kbytes/s (smoothed "
+             << current.smoothed / 1000.0 << ", peak "
+             << current.peak / 1000.0 << ")" << endl;
+    } // end if (transfers > 0)
+
+    text << "Control: " << commands << " round trips";
+    if (commands > 0) {
+        text << ", last " << rttLast / ms << " ms, min " << rttMin / ms
+             << " ms, avg " << rttTotal / commands / ms << " ms, max "
+             << rttMax / ms << " ms";
+    } // end if (commands > 0)
+    text << endl;
+
+    return text.str();
+} // end summary()
+
+
+// redraws the progress line on stderr
+void TransferMetrics::draw(void) {
+    double kbytes = current.smoothed / 1000.0;
+
+    if (current.size > 0) {
+        char bar[BAR_WIDTH + 1];
+        int  filled  = (int)(BAR_WIDTH * current.bytes / current.size);
+        long seconds = current.smoothed > 0.0
+                       ? (long)((current.size - current.bytes)
+                                / current.smoothed) : 0;
+
+        for (int i = 0; i < BAR_WIDTH; ++i) {
+            bar[i] = i < filled ? '=' : (i == filled ? '>' : ' ');
+        } // end for (i < BAR_WIDTH)
+        bar[BAR_WIDTH] = '\0';
+
+        fprintf(stderr, "\r%3d%% [%s] %lld bytes %.1f Kbytes/s ETA %ld:%02ld",
+                (int)(100 * current.bytes / current.size), bar,
+                current.bytes, kbytes, seconds / 60, seconds % 60);
+    } // end if (current.size > 0)
+    else {
+        fprintf(stderr, "\r%lld bytes %.1f Kbytes/s", current.bytes, kbytes);
+    } // end else (current.size <= 0)
+
+    drawn = true;
+} // end draw()
+
+
+// appends the finished transfer to the log as one JSON object
+void TransferMetrics::record(void) {
+    if (log == NULL) {
+        return;
+    } // end if (log == NULL)
+
+    fprintf(log, "{\"verb\": \"%s\", \"name\": \"", current.verb.c_str());
+    for (size_t i = 0; i < current.name.length(); ++i) {
+        char c = current.name.at(i);
+
+        if (c == '"' || c == '\\') {
+            fputc('\\', log);
+        } // end if (c == '"' || ...)
+        if ((unsigned char)c >= ' ') {
+            fputc(c, log);
+        } // end if (c >= ' ')
+    } // end for (i < current.name.length())
+    fprintf(log, "\", \"size\": %lld, \"bytes\": %lld, \"code\": %d, "
+            "\"passive_ns\": %lld, \"connect_ns\": %lld, "
+            "\"first_byte_ns\": %lld, \"transfer_ns\": %lld, "
+            "\"disk_ns\": %lld, \"final_ns\": %lld, \"stalls\": %d, "
+            "\"stalled_ns\": %lld, \"rate\": %.0f, \"smoothed\": %.0f, "
+            "\"peak\": %.0f}\n",
+            current.size, current.bytes, current.code, current.passive,
+            current.connect, current.firstByte, current.transfer,
+            current.disk, current.final, current.stalls, current.stalled,
+            current.rate, current.smoothed, current.peak);
+    fflush(log);
+} // end record()
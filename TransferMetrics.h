@@ -0,0 +1,90 @@
+/*
+ * @file   TransferMetrics.h
+ * @brief  Records where the time of each FTP transfer went, on the monotonic
+ *          clock in nanoseconds: the PASV round trip, the data connect, the
+ *          wait for the first byte, the transfer itself, time in the disk,
+ *          stalls and the final reply, plus the rates seen along the way and
+ *          the round trips of control commands. Can draw a live progress bar
+ *          and append one JSON line per transfer to a log.
+ * @author Brendan Sweeney, ID #1161836
+ * @date   December 13, 2012
+ */
+
+#ifndef TRANSFERMETRICS_H
+#define	TRANSFERMETRICS_H
+
+#include <stdio.h>          // FILE, fopen, fprintf, snprintf
+#include <stdlib.h>         // strtoll
+#include <time.h>           // clock_gettime
+#include <sstream>
+#include <string>
+
+using namespace std;
+
+
+// the breakdown of one transfer; every time is in nanoseconds
+struct TransferStats {
+    string    verb;         // RETR, STOR, APPE, LIST or NLST
+    string    name;         // file the transfer was for
+    long long size;         // bytes expected, or -1 if unknown
+    long long bytes;        // payload bytes moved
+    long long passive;      // PASV round trip
+    long long connect;      // data connection setup
+    long long firstByte;    // command sent to first payload byte moved
+    long long transfer;     // first payload byte to end of data
+    long long disk;         // spent reading or writing the local file
+    long long final;        // end of data to final reply
+    int       stalls;       // gaps of STALL or more with nothing moved
+    long long stalled;      // total length of those gaps
+    double    rate;         // latest instantaneous rate, bytes/second
+    double    smoothed;     // exponentially smoothed rate, bytes/second
+    double    peak;         // highest instantaneous rate, bytes/second
+    int       code;         // final reply code
+};
+
+
+class TransferMetrics {
+public:
+    static const long long STALL  = 500000000LL,  // ns without data
+                           SAMPLE = 200000000LL;  // ns between rate samples
+    TransferMetrics();
+    ~TransferMetrics();
+    static long long now(void);
+    void   setProgress(bool on);
+    bool   setLog(const string& path);
+    void   begin(const string& verb, const string& name, long long size);
+    void   passive(long long ns);
+    void   connected(long long ns);
+    void   sent(void);
+    void   preliminary(const string& text);
+    void   moved(long long count);
+    void   disk(long long ns);
+    void   ended(void);
+    void   finish(int code);
+    void   command(long long ns);
+    const TransferStats& last(void) const;
+    string summary(void) const;
+private:
+    static const int BAR_WIDTH = 30;        // characters in the progress bar
+    TransferStats current;      // transfer in progress or last finished
+    bool      progress;         // draw a progress bar on stderr
+    bool      drawn;            // a progress line is on the screen
+    FILE     *log;              // JSON lines log, or NULL
+    long long began;            // begin() time
+    long long sentAt;           // transfer command sent
+    long long firstAt;          // first payload byte moved, or 0
+    long long endedAt;          // end of data, or 0
+    long long lastMove;         // last time a byte moved
+    long long sampleAt;         // time of the last rate sample
+    long long sampleBytes;      // byte count at the last rate sample
+    // totals since the client started
+    long      transfers, failures;
+    long long totalBytes, totalNs;
+    long      commands;
+    long long rttTotal, rttMin, rttMax, rttLast;
+
+    void draw(void);
+    void record(void);
+}; // end class TransferMetrics
+
+#endif	/* TRANSFERMETRICS_H */
@@ -0,0 +1,349 @@
+/*
+ * @file   TransferScheduler.cpp
+ * @brief  Runs batches of file transfers over a pool of authenticated control
+ *          sessions to one server. Each session works on its own queue of
+ *          files on its own thread, and a session whose queue runs dry takes
+ *          work from the back of the longest remaining queue, so one slow
+ *          file cannot hold up the rest of the batch.
+ * @author Brendan Sweeney, ID #1161836
+ * @date   December 13, 2012
+ */
+
+#include "TransferScheduler.h"
+
+
+TransferScheduler::TransferScheduler(string hostname, string port,
+                                     string username, string password,
+                                     string directory,
+                                     SessionCache *cache,
+                                     RateLimiter *limiter) :
+        hostname(hostname), port(port), username(username),
+        password(password), directory(directory), cache(cache),
+        limiter(limiter), verify(Checksum::NONE), compress(true),
+        ascii(false) {
+    pthread_mutex_init(&lock, NULL);
+} // end constructor
+
+
+// logs every session out of the server, or parks it in the session cache
+TransferScheduler::~TransferScheduler() {
+    for (size_t i = 0; i < workers.size(); ++i) {
+        workers[i]->backend.ftpClose();
+        delete workers[i];
+    } // end for (i < workers.size())
+
+    pthread_mutex_destroy(&lock);
+} // end destructor
+
+
+// checks the files of later runs against server checksums; the segments
+// of getSegmented() are not checked
+void TransferScheduler::setVerify(Checksum::kind algorithm) {
+    verify = algorithm;
+} // end setVerify(Checksum::kind)
+
+
+// compresses the files of later runs with MODE Z where the server offers
+// it; segments are always sent in stream mode
+void TransferScheduler::setCompression(bool on) {
+    compress = on;
+} // end setCompression(bool)
+
+
+// moves the files of later runs in TYPE A, translating line endings;
+// segments are always moved in TYPE I
+void TransferScheduler::setAscii(bool on) {
+    ascii = on;
+} // end setAscii(bool)
+
+
+// opens up to the requested number of sessions; returns how many logged in
+int TransferScheduler::open(int sessions) {
+    if (sessions > MAX_SESSIONS) {
+        sessions = MAX_SESSIONS;
+    } // end if (sessions > MAX_SESSIONS)
+
+    // sessions are set up one at a time, before any thread is running
+    while((int)workers.size() < sessions) {
+        Worker *worker = new Worker();
+
+        worker->owner  = this;
+        worker->bytes  = 0;
+        worker->files  = 0;
+        worker->failed = 0;
+        worker->backend.setSessionCache(cache);
+        worker->backend.setRateLimiter(limiter);
+        worker->backend.setVerify(verify);
+        worker->backend.setCompression(compress);
+        worker->backend.setAscii(ascii);
+
+        if (!login(worker->backend)) {
+            delete worker;
+            break;
+        } // end if (!login(...))
+        workers.push_back(worker);
+    } // end while(workers.size() < sessions)
+
+    return workers.size();
+} // end open(int)
+
+
+// moves every job, spreading them over the open sessions, then prints an
+// aggregate throughput summary; marks each job that succeeded done and
+// returns how many failed
+int TransferScheduler::run(vector<TransferJob>& jobs) {
+    long      time;
+    Timer     tick;
+    long long bytes  = 0;
+    int       files  = 0;
+    int       failed = 0;
+
+    if (workers.empty()) {
+        cerr << "No sessions available." << endl;
+        return jobs.size();
+    } // end if (workers.empty())
+
+    // deal the jobs out in turn; stealing evens out what is left over
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        jobs[i].done = false;
+        workers[i % workers.size()]->queue.push_back(&jobs[i]);
+    } // end for (i < jobs.size())
+
+    tick.start();
+    for (size_t i = 0; i < workers.size(); ++i) {
+        pthread_create(&workers[i]->thread, NULL, work, workers[i]);
+    } // end for (i < workers.size())
+
+    for (size_t i = 0; i < workers.size(); ++i) {
+        pthread_join(workers[i]->thread, NULL);
+        bytes  += workers[i]->bytes;
+        files  += workers[i]->files;
+        failed += workers[i]->failed;
+        workers[i]->bytes = workers[i]->files = workers[i]->failed = 0;
+    } // end for (i < workers.size())
+
+    // jobs still queued once every session was lost were never tried
+    for (size_t i = 0; i < workers.size(); ++i) {
+        while(!workers[i]->queue.empty()) {
+            cout << workers[i]->queue.front()->source
+                 << ": not tried, no session left" << endl;
+            workers[i]->queue.pop_front();
+            ++failed;
+        } // end while(!workers[i]->queue.empty())
+    } // end for (i < workers.size())
+    time = tick.lap();
+
+    cout << files << (jobs[0].length < 0 ? " files, " : " segments, ")
+         << bytes << " bytes transferred in "
+         << (double)time / 1000000.0 << " seconds ("
+         << 1000.0 * (double)bytes / time << " Kbytes/s) over "
+         << workers.size() << " sessions";
+    if (failed > 0) {
+        cout << "; " << failed << " failed";
+    } // end if (failed > 0)
+    cout << endl;
+
+    return failed;
+} // end run(vector<TransferJob>&)
+
+
+// downloads one file in byte ranges, one per session, written in place
+// into a preallocated local file; true if every segment arrived
+bool TransferScheduler::getSegmented(string remote, string local) {
+    vector<TransferJob> jobs;
+    TransferJob         job;
+    long long           size;
+    mode_t              mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH;
+    int                 file;
+    int                 segments = workers.size();
+
+    if (workers.empty()) {
+        cerr << "No sessions available." << endl;
+        return false;
+    } // end if (workers.empty())
+
+    cout << workers[0]->backend.ftpSize(remote, size);
+    if (size < 0) {
+        cerr << remote << ": size unknown, cannot segment" << endl;
+        return false;
+    } // end if (size < 0)
+
+    if ((file = ::open(local.c_str(), O_WRONLY | O_CREAT | O_TRUNC,
+                       mode)) < 0) {
+        perror(local.c_str());
+        return false;
+    } // end if ((file = open(...)) < 0)
+    if (posix_fallocate(file, 0, size) != 0) {
+        ftruncate(file, size);
+    } // end if (posix_fallocate(...) != 0)
+    close(file);
+
+    // small files are not worth a connection per megabyte
+    if (size / MIN_SEGMENT < segments) {
+        segments = size / MIN_SEGMENT > 0 ? size / MIN_SEGMENT : 1;
+    } // end if (size / MIN_SEGMENT < segments)
+
+    job.source = remote;
+    job.target = local;
+    job.upload = false;
+    for (int i = 0; i < segments; ++i) {
+        job.offset = size / segments * i;
+        job.length = i + 1 < segments ? size / segments
+                                      : size - job.offset;
+        jobs.push_back(job);
+    } // end for (i < segments)
+
+    if (run(jobs) == 0) {
+        return true;
+    } // end if (run(jobs) == 0)
+
+    // a missing segment is a hole of zeros that looks like data, so the
+    // file is cut back to it and reget can finish the rest
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        if (!jobs[i].done) {
+            truncate(local.c_str(), jobs[i].offset);
+            cerr << local << ": incomplete, kept the first "
+                 << jobs[i].offset << " bytes" << endl;
+            break;
+        } // end if (!jobs[i].done)
+    } // end for (i < jobs.size())
+
+    return false;
+} // end getSegmented(string, string)
+
+
+// runs the open, user and pass sequence on a new session and enters the
+// working directory of the session the batch was started from; a session
+// parked by an earlier batch only needs the directory
+bool TransferScheduler::login(FtpBackend& backend) {
+    if (backend.ftpResume(hostname, port, username)) {
+        if (directory.empty()) {
+            return true;
+        } // end if (directory.empty())
+        
+        backend.ftpCd(directory);
+        if (backend.lastReply().code / 100 == FtpBackend::POS_COMPL) {
+            return true;
+        } // end if (backend.lastReply().code / 100 == POS_COMPL)
+        backend.ftpQuit();
+    } // end if (backend.ftpResume(...))
+    
+    try {
+        string reply(backend.ftpOpen(hostname, port));
+
+        if (atoi(&reply.at(0)) / 100 != FtpBackend::POS_COMPL) {
+            return false;
+        } // end if (atoi(...) != POS_COMPL)
+
+        // user, password and directory go out as one pipelined batch
+        if (!backend.ftpLogin(username, password, directory)) {
+            backend.ftpClose();
+            return false;
+        } // end if (!backend.ftpLogin(...))
+    } catch (exception& e) {
+        cerr << e.what() << endl;
+        return false;
+    } // end try atoi()
+
+    return true;
+} // end login(FtpBackend&)
+
+
+// hands a worker its next job, stealing from the back of the longest queue
+// when its own is empty; NULL once every queue is empty
+TransferJob *TransferScheduler::take(Worker *self) {
+    Worker      *victim = self;
+    TransferJob *job;
+
+    pthread_mutex_lock(&lock);
+    if (self->queue.empty()) {
+        for (size_t i = 0; i < workers.size(); ++i) {
+            if (workers[i]->queue.size() > victim->queue.size()) {
+                victim = workers[i];
+            } // end if (workers[i]->queue.size() > ...)
+        } // end for (i < workers.size())
+    } // end if (self->queue.empty())
+
+    if (victim->queue.empty()) {
+        pthread_mutex_unlock(&lock);
+        return NULL;
+    } // end if (victim->queue.empty())
+
+    // the owner works from the front; thieves take from the back
+    if (victim == self) {
+        job = victim->queue.front();
+        victim->queue.pop_front();
+    } // end if (victim == self)
+    else {
+        job = victim->queue.back();
+        victim->queue.pop_back();
+    } // end else (victim != self)
+    pthread_mutex_unlock(&lock);
+
+    return job;
+} // end take(Worker*)
+
+
+// thread body: moves jobs over one session until no work is left anywhere
+void *TransferScheduler::work(void *arg) {
+    Worker            *self  = (Worker *)arg;
+    TransferScheduler *owner = self->owner;
+    TransferJob       *next;
+
+    while((next = owner->take(self)) != NULL) {
+        TransferJob& job = *next;
+        string reply;
+        bool   ok;
+
+        if (job.length >= 0) {
+            reply = self->backend.ftpGetRange(job.source, job.target,
+                                              job.offset, job.length);
+        } // end if (job.length >= 0)
+        else if (job.upload) {
+            reply = self->backend.ftpPut(job.source, job.target);
+        } // end else if (job.upload)
+        else {
+            reply = self->backend.ftpGet(job.source, job.target);
+        } // end else
+
+        const TransferResult& result = self->backend.lastTransfer();
+
+        // a segment is cut off on purpose, so the server may report an abort
+        ok = job.length >= 0 ? result.code != 0 && result.bytes == job.length
+                             : result.code / 100 == FtpBackend::POS_COMPL
+                               && result.verified >= 0;
+
+        pthread_mutex_lock(&owner->lock);
+        job.done = ok;
+        if (ok) {
+            self->bytes += result.bytes;
+            ++self->files;
+            cout << job.source;
+            if (job.length >= 0) {
+                cout << " [" << job.offset << "-"
+                     << job.offset + job.length - 1 << "]";
+            } // end if (job.length >= 0)
+            cout << " -> " << job.target << ": " << result.bytes
+                 << " bytes in " << (double)result.usec / 1000000.0
+                 << " seconds (" << 1000.0 * (double)result.bytes
+                                    / result.usec
+                 << " Kbytes/s)" << endl;
+        } // end if (ok)
+        else {
+            ++self->failed;
+            cout << job.source << ": " << (result.reply.empty()
+                                          ? reply : result.reply);
+        } // end else (!ok)
+        pthread_mutex_unlock(&owner->lock);
+
+        // a session with no control connection left can move nothing more,
+        // so its queue is left for the others to steal: a transfer that
+        // started and got no final reply hung it up, as did a lost batch
+        if (!ok && ((result.code == 0 && !result.preliminary.empty())
+                    || self->backend.lastReply().code == 0)) {
+            break;
+        } // end if (!ok && ...)
+    } // end while((next = owner->take(self)) != NULL)
+
+    return NULL;
+} // end work(void*)
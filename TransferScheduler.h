@@ -0,0 +1,78 @@
+/*
+ * @file   TransferScheduler.h
+ * @brief  Runs batches of file transfers over a pool of authenticated control
+ *          sessions to one server. Each session works on its own queue of
+ *          files on its own thread, and a session whose queue runs dry takes
+ *          work from the back of the longest remaining queue, so one slow
+ *          file cannot hold up the rest of the batch.
+ * @author Brendan Sweeney, ID #1161836
+ * @date   December 13, 2012
+ */
+
+#ifndef TRANSFERSCHEDULER_H
+#define	TRANSFERSCHEDULER_H
+
+#include <fcntl.h>          // open, posix_fallocate
+#include <pthread.h>
+#include <unistd.h>         // ftruncate, truncate, close
+#include <deque>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "FtpBackend.h"
+#include "Timer.h"
+
+using namespace std;
+
+
+// one file to move between the local and remote working directories
+struct TransferJob {
+    string source;          // name of the file to read
+    string target;          // name of the file to write
+    bool   upload;          // true for put, false for get
+    long long offset;       // first byte of a segment
+    long long length;       // bytes in a segment, or -1 for the whole file
+    bool   done;            // set by run() once the job has succeeded
+};
+
+
+class TransferScheduler {
+public:
+    static const int MAX_SESSIONS = 32,
+                     MIN_SEGMENT  = 1048576;    // smallest useful segment
+    TransferScheduler(string hostname, string port, string username,
+                      string password, string directory,
+                      SessionCache *cache = NULL,
+                      RateLimiter *limiter = NULL);
+    ~TransferScheduler();
+    void setVerify(Checksum::kind algorithm);
+    void setCompression(bool on);
+    void setAscii(bool on);
+    int  open(int sessions);
+    int  run(vector<TransferJob>& jobs);
+    bool getSegmented(string remote, string local);
+private:
+    struct Worker {
+        TransferScheduler *owner;   // scheduler that holds the queues
+        FtpBackend         backend; // this worker's control session
+        deque<TransferJob *> queue; // files assigned to this worker
+        pthread_t          thread;  // runs work() for this worker
+        long long          bytes;   // payload bytes this worker moved
+        int                files;   // files this worker completed
+        int                failed;  // files this worker could not move
+    };
+    string hostname, port, username, password, directory;
+    SessionCache    *cache;         // lends and takes back sessions, if set
+    RateLimiter     *limiter;       // shares a rate among sessions, if set
+    Checksum::kind   verify;        // checksum whole files are checked with
+    bool             compress;      // MODE Z for whole files, if offered
+    bool             ascii;         // TYPE A for whole files
+    vector<Worker *> workers;       // one per authenticated session
+    pthread_mutex_t  lock;          // guards every queue and cout
+
+    bool login(FtpBackend& backend);
+    TransferJob *take(Worker *self);
+    static void *work(void *arg);
+}; // end class TransferScheduler
+
+#endif	/* TRANSFERSCHEDULER_H */
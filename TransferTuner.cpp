@@ -0,0 +1,175 @@
+/*
+ * @file   TransferTuner.cpp
+ * @brief  Picks transfer buffer and kernel socket buffer sizes for the FTP
+ *          client. Sizes start from the bandwidth-delay product measured on
+ *          earlier transfers and grow while a transfer ramps up, using the
+ *          kernel's own TCP_INFO estimates of the connection's window. The
+ *          socket buffers are otherwise left to the kernel's autotuning.
+ * @author Brendan Sweeney, ID #1161836
+ * @date   December 13, 2012
+ */
+
+#include "TransferTuner.h"
+
+
+TransferTuner::TransferTuner() : dataSd(-1), sending(false), buffer(MIN_BUF),
+                                 pinned(0), bdp(MIN_BUF), nextSample(0),
+                                 rtt(0) {
+} // end default constructor
+
+
+// disables Nagle on a control connection so short commands are not delayed
+void TransferTuner::tuneControl(int sd) {
+    int on = 1;
+
+    setsockopt(sd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+} // end tuneControl(int)
+
+
+// fixes the transfer buffer at a size instead of tuning it; 0 tunes again
+void TransferTuner::pin(size_t size) {
+    pinned = size;
+} // end pin(size_t)
+
+
+// sizes kernel buffers of a data socket before connect(), so that the
+// window scale negotiated in the handshake can cover the expected BDP; this
+// is the only time they are set, since setting one turns off the kernel's
+// autotuning of it for good
+void TransferTuner::prepare(int sd) {
+    // leave kernel autotuning alone until a larger window has been seen
+    if (bdp > (size_t)MIN_BUF) {
+        dataSd = sd;
+        applySockBuf(2 * bdp);
+    } // end if (bdp > MIN_BUF)
+} // end prepare(int)
+
+
+// begins a transfer on a connected data socket
+void TransferTuner::start(int sd, bool send) {
+    dataSd     = sd;
+    sending    = send;
+    buffer     = pinned > 0 ? pinned : clamp(bdp / 4);
+    nextSample = (long long)buffer * SAMPLE_ROUNDS;
+} // end start(int, bool)
+
+
+// the number of bytes the transfer loop should move per call
+size_t TransferTuner::bufferSize(void) const {
+    return buffer;
+} // end bufferSize()
+
+
+// called by transfer loops with the running byte count and whether the last
+// call filled the whole buffer; returns true if bufferSize() has grown
+bool TransferTuner::sample(long long count, bool filled) {
+    if (pinned > 0 || count < nextSample) {
+        return false;
+    } // end if (pinned > 0 || ...)
+
+    size_t window = measure();
+    size_t old    = buffer;
+
+    // the kernel buffers are left to autotuning once connected; a larger
+    // window only sizes the next transfer's, in prepare()
+    if (window > bdp) {
+        bdp = window;
+    } // end if (window > bdp)
+
+    // only grow while reads or writes keep filling the buffer
+    if (filled && buffer < clamp(bdp)) {
+        buffer *= 2;
+    } // end if (filled && ...)
+
+    nextSample = count + (long long)buffer * SAMPLE_ROUNDS;
+    return buffer != old;
+} // end sample(long long, bool)
+
+
+// records achieved throughput so the next transfer starts from it
+void TransferTuner::finish(long long count, long usec) {
+    if (usec > 0 && rtt > 0) {
+        // bytes per microsecond times microseconds of round trip
+        size_t achieved = (size_t)((double)count / usec * rtt);
+        if (achieved > bdp) {
+            bdp = clamp(achieved);
+        } // end if (achieved > bdp)
+    } // end if (usec > 0 && rtt > 0)
+
+    dataSd = -1;
+} // end finish(long long, long)
+
+
+// asks the kernel for its current view of the connection's window in bytes
+size_t TransferTuner::measure(void) {
+    struct tcp_info info;
+    socklen_t       len = sizeof(info);
+
+    if (getsockopt(dataSd, IPPROTO_TCP, TCP_INFO, &info, &len) < 0) {
+        return 0;
+    } // end if (getsockopt(...) < 0)
+
+    rtt = sending ? info.tcpi_rtt : info.tcpi_rcv_rtt;
+
+    // the receive side estimates the sender's window per RTT directly; the
+    // send side has it as congestion window times segment size
+    if (sending) {
+        return (size_t)info.tcpi_snd_cwnd * info.tcpi_snd_mss;
+    } // end if (sending)
+    return info.tcpi_rcv_space;
+} // end measure()
+
+
+// sets the kernel buffers of a socket that is not yet connected, and so may
+// move data either way; each is only set if the size asked for, after the
+// kernel caps it at rmem_max or wmem_max and doubles it, is more than
+// autotuning would reach by itself, since otherwise setting it can only
+// leave the window smaller
+void TransferTuner::applySockBuf(size_t size) {
+    static const size_t RCV_CAP  = limit("/proc/sys/net/core/rmem_max", 0),
+                        SND_CAP  = limit("/proc/sys/net/core/wmem_max", 0),
+                        RCV_AUTO = limit("/proc/sys/net/ipv4/tcp_rmem", 2),
+                        SND_AUTO = limit("/proc/sys/net/ipv4/tcp_wmem", 2);
+    size_t value = clamp(size);
+    int    asked = (int)value;
+
+    if (2 * (value < RCV_CAP ? value : RCV_CAP) > RCV_AUTO) {
+        setsockopt(dataSd, SOL_SOCKET, SO_RCVBUF, &asked, sizeof(asked));
+    } // end if (2 * min(value, RCV_CAP) > RCV_AUTO)
+    if (2 * (value < SND_CAP ? value : SND_CAP) > SND_AUTO) {
+        setsockopt(dataSd, SOL_SOCKET, SO_SNDBUF, &asked, sizeof(asked));
+    } // end if (2 * min(value, SND_CAP) > SND_AUTO)
+} // end applySockBuf(size_t)
+
+
+// reads one number, by position, from a sysctl file such as tcp_rmem; a
+// file that cannot be read gives MAX_BUF, the most this class asks for
+size_t TransferTuner::limit(const char *path, int field) {
+    FILE         *file  = fopen(path, "r");
+    unsigned long value = MAX_BUF;
+
+    if (file == NULL) {
+        return value;
+    } // end if (file == NULL)
+    for (int i = 0; i <= field; ++i) {
+        if (fscanf(file, "%lu", &value) != 1) {
+            value = MAX_BUF;
+            break;
+        } // end if (fscanf(...) != 1)
+    } // end for (i <= field)
+    fclose(file);
+
+    return value;
+} // end limit(const char*, int)
+
+
+// rounds a size up to a power of two within [MIN_BUF, MAX_BUF]
+size_t TransferTuner::clamp(size_t size) {
+    size_t rounded = MIN_BUF;
+
+    while(rounded < size && rounded < (size_t)MAX_BUF) {
+        rounded *= 2;
+    } // end while(rounded < size...)
+
+    return rounded;
+} // end clamp(size_t)
@@ -0,0 +1,52 @@
+/*
+ * @file   TransferTuner.h
+ * @brief  Picks transfer buffer and kernel socket buffer sizes for the FTP
+ *          client. Sizes start from the bandwidth-delay product measured on
+ *          earlier transfers and grow while a transfer ramps up, using the
+ *          kernel's own TCP_INFO estimates of the connection's window. The
+ *          socket buffers are otherwise left to the kernel's autotuning.
+ * @author Brendan Sweeney, ID #1161836
+ * @date   December 13, 2012
+ */
+
+#ifndef TRANSFERTUNER_H
+#define	TRANSFERTUNER_H
+
+#include <netinet/in.h>     // IPPROTO_TCP
+#include <netinet/tcp.h>    // TCP_NODELAY, TCP_INFO
+#include <sys/socket.h>     // setsockopt, getsockopt
+#include <stddef.h>         // size_t
+#include <stdio.h>          // fopen, fscanf
+
+using namespace std;
+
+
+class TransferTuner {
+public:
+    static const int MIN_BUF = 16384,       // smallest transfer buffer
+                     MAX_BUF = 8388608;     // largest transfer/socket buffer
+    TransferTuner();
+    static void tuneControl(int sd);
+    void   pin(size_t size);
+    void   prepare(int sd);
+    void   start(int sd, bool sending);
+    size_t bufferSize(void) const;
+    bool   sample(long long count, bool filled);
+    void   finish(long long count, long usec);
+private:
+    static const int SAMPLE_ROUNDS = 16;    // buffers moved between samples
+    int       dataSd;                       // socket of the current transfer
+    bool      sending;                      // direction of current transfer
+    size_t    buffer;                       // current transfer buffer size
+    size_t    pinned;                       // fixed buffer size, or 0
+    size_t    bdp;                          // bandwidth-delay product estimate
+    long long nextSample;                   // byte count of the next sample
+    long      rtt;                          // last smoothed RTT, microseconds
+
+    size_t measure(void);
+    void   applySockBuf(size_t size);
+    static size_t clamp(size_t size);
+    static size_t limit(const char *path, int field);
+}; // end class TransferTuner
+
+#endif	/* TRANSFERTUNER_H */
@@ -0,0 +1,326 @@
+/*
+ * @file   LoopbackServer.cpp
+ * @brief  A minimal FTP server stand-in for benchmarking the client. It
+ *          listens on an ephemeral loopback port, serves files from one
+ *          directory with sendfile(), throws uploads away as fast as they
+ *          arrive and makes up directory listings, so the numbers measured
+ *          against it are the client's own.
+ * @author Brendan Sweeney, ID #1161836
+ * @date   December 13, 2012
+ */
+
+#include "LoopbackServer.h"
+
+
+LoopbackServer::LoopbackServer(string root) : root(root), listenSd(-1),
+                                              portNum(0) {
+} // end constructor
+
+
+// stops accepting; sessions end when their clients hang up
+LoopbackServer::~LoopbackServer() {
+    if (listenSd >= 0) {
+        shutdown(listenSd, SHUT_RDWR);
+        pthread_join(acceptor, NULL);
+        close(listenSd);
+    } // end if (listenSd >= 0)
+} // end destructor
+
+
+// binds the control listener and starts accepting; false on failure
+bool LoopbackServer::start(void) {
+    if ((listenSd = listenOn(portNum)) < 0) {
+        return false;
+    } // end if ((listenSd = listenOn(...)) < 0)
+
+    if (pthread_create(&acceptor, NULL, accepter, this) != 0) {
+        close(listenSd);
+        listenSd = -1;
+        return false;
+    } // end if (pthread_create(...) != 0)
+
+    return true;
+} // end start()
+
+
+// the port clients should connect to
+int LoopbackServer::port(void) const {
+    return portNum;
+} // end port()
+
+
+// thread body: gives every control connection a thread of its own
+void *LoopbackServer::accepter(void *arg) {
+    LoopbackServer *server = (LoopbackServer *)arg;
+    int             sd;
+
+    while((sd = accept(server->listenSd, NULL, NULL)) >= 0
+          || errno == EINTR) {
+        if (sd < 0)
+            continue;
+
+        Session  *session = new Session();
+        pthread_t thread;
+
+        session->owner  = server;
+        session->sd     = sd;
+        session->pasvSd = -1;
+        session->rest   = 0;
+        if (pthread_create(&thread, NULL, serve, session) != 0) {
+            close(sd);
+            delete session;
+            continue;
+        } // end if (pthread_create(...) != 0)
+        pthread_detach(thread);
+    } // end while((sd = accept(...)) >= 0 || ...)
+
+    return NULL;
+} // end accepter(void*)
+
+
+// thread body: answers one client's commands until it quits or hangs up
+void *LoopbackServer::serve(void *arg) {
+    Session *session = (Session *)arg;
+    char     chunk[4096];
+    ssize_t  l;
+    bool     open = true;
+    int      on   = 1;
+
+    setsockopt(session->sd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    reply(session, "220 loopback benchmark server ready");
+
+    while(open && (l = read(session->sd, chunk, sizeof(chunk))) > 0) {
+        size_t end;
+
+        session->line.append(chunk, l);
+        // commands may arrive pipelined, several to a read
+        while(open && (end = session->line.find("\r\n")) != string::npos) {
+            string text(session->line, 0, end);
+            size_t space;
+
+            // older commands are written with their terminating NUL
+            session->line.erase(0, end + 2);
+            text.erase(0, text.find_first_not_of('\0'));
+            space = text.find(' ');
+            open = session->owner->handle(session,
+                                          text.substr(0, space),
+                                          space == string::npos
+                                          ? "" : text.substr(space + 1));
+        } // end while(open && ...)
+    } // end while(open && ...)
+
+    if (session->pasvSd >= 0) {
+        close(session->pasvSd);
+    } // end if (session->pasvSd >= 0)
+    close(session->sd);
+    delete session;
+
+    return NULL;
+} // end serve(void*)
+
+
+// opens a listener on an ephemeral loopback port; returns its descriptor
+int LoopbackServer::listenOn(int& port) {
+    struct sockaddr_in addr;
+    socklen_t          len = sizeof(addr);
+    int                sd  = socket(AF_INET, SOCK_STREAM, 0);
+
+    if (sd < 0) {
+        return -1;
+    } // end if (sd < 0)
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port        = 0;
+
+    // a reactor connects all of its sessions at once, and a client whose
+    // handshake overflowed the queue waits on a greeting that never comes
+    if (bind(sd, (sockaddr *)&addr, sizeof(addr)) < 0
+            || listen(sd, SOMAXCONN) < 0
+            || getsockname(sd, (sockaddr *)&addr, &len) < 0) {
+        close(sd);
+        return -1;
+    } // end if (bind(...) < 0 || ...)
+
+    port = ntohs(addr.sin_port);
+    return sd;
+} // end listenOn(int&)
+
+
+// sends one reply line
+void LoopbackServer::reply(Session *session, const string& text) {
+    string line(text + "\r\n");
+
+    write(session->sd, line.c_str(), line.length());
+} // end reply(Session*, const string&)
+
+
+// accepts the data connection set up by the last PASV or EPSV
+int LoopbackServer::dataConnection(Session *session) {
+    int sd;
+
+    if (session->pasvSd < 0) {
+        reply(session, "425 Use PASV first");
+        return -1;
+    } // end if (session->pasvSd < 0)
+
+    sd = accept(session->pasvSd, NULL, NULL);
+    close(session->pasvSd);
+    session->pasvSd = -1;
+
+    if (sd < 0) {
+        reply(session, "425 Cannot open data connection");
+    } // end if (sd < 0)
+    return sd;
+} // end dataConnection(Session*)
+
+
+// answers one command; false once the session is over
+bool LoopbackServer::handle(Session *session, const string& verb,
+                            const string& arg) {
+    char text[128];
+
+    if (verb.compare("USER") == 0) {
+        reply(session, "331 Password required");
+    } // end if (verb.compare("USER") == 0)
+    else if (verb.compare("PASS") == 0) {
+        reply(session, "230 Logged in");
+    } // end else if (verb.compare("PASS") == 0)
+    else if (verb.compare("SYST") == 0) {
+        reply(session, "215 UNIX Type: L8");
+    } // end else if (verb.compare("SYST") == 0)
+    else if (verb.compare("PWD") == 0) {
+        reply(session, "257 \"/\" is the current directory");
+    } // end else if (verb.compare("PWD") == 0)
+    else if (verb.compare("CWD") == 0) {
+        reply(session, "250 Directory changed");
+    } // end else if (verb.compare("CWD") == 0)
+    else if (verb.compare("REST") == 0) {
+        session->rest = atoll(arg.c_str());
+        reply(session, "350 Restarting at " + arg);
+    } // end else if (verb.compare("REST") == 0)
+    else if (verb.compare("SIZE") == 0) {
+        struct stat info;
+
+        if (stat((root + "/" + arg).c_str(), &info) < 0) {
+            reply(session, "550 " + arg + ": No such file");
+        } // end if (stat(...) < 0)
+        else {
+            snprintf(text, sizeof(text), "213 %lld",
+                     (long long)info.st_size);
+            reply(session, text);
+        } // end else
+    } // end else if (verb.compare("SIZE") == 0)
+    else if (verb.compare("PASV") == 0 || verb.compare("EPSV") == 0) {
+        int port;
+
+        if (session->pasvSd >= 0) {
+            close(session->pasvSd);
+        } // end if (session->pasvSd >= 0)
+        if ((session->pasvSd = listenOn(port)) < 0) {
+            reply(session, "425 Cannot open passive connection");
+        } // end if ((session->pasvSd = listenOn(...)) < 0)
+        else if (verb.compare("EPSV") == 0) {
+            snprintf(text, sizeof(text),
+                     "229 Entering Extended Passive Mode (|||%d|)", port);
+            reply(session, text);
+        } // end else if (verb.compare("EPSV") == 0)
+        else {
+            snprintf(text, sizeof(text),
+                     "227 Entering Passive Mode (127,0,0,1,%d,%d)",
+                     port / 256, port % 256);
+            reply(session, text);
+        } // end else
+    } // end else if (verb.compare("PASV") == 0 || ...)
+    else if (verb.compare("RETR") == 0) {
+        retrieve(session, arg);
+    } // end else if (verb.compare("RETR") == 0)
+    else if (verb.compare("STOR") == 0 || verb.compare("APPE") == 0) {
+        store(session);
+    } // end else if (verb.compare("STOR") == 0 || ...)
+    else if (verb.compare("LIST") == 0 || verb.compare("NLST") == 0) {
+        list(session, verb.compare("NLST") == 0);
+    } // end else if (verb.compare("LIST") == 0 || ...)
+    else if (verb.compare("QUIT") == 0) {
+        reply(session, "221 Goodbye");
+        return false;
+    } // end else if (verb.compare("QUIT") == 0)
+    else {
+        // TYPE, NOOP and the rest need nothing done
+        reply(session, "200 OK");
+    } // end else
+
+    return true;
+} // end handle(Session*, const string&, const string&)
+
+
+// sends a file from the REST offset with sendfile()
+void LoopbackServer::retrieve(Session *session, const string& name) {
+    int   file = open((root + "/" + name).c_str(), O_RDONLY);
+    off_t at   = session->rest;
+    int   sd;
+
+    session->rest = 0;
+    if (file < 0) {
+        reply(session, "550 " + name + ": No such file");
+        return;
+    } // end if (file < 0)
+    if ((sd = dataConnection(session)) < 0) {
+        close(file);
+        return;
+    } // end if ((sd = dataConnection(...)) < 0)
+
+    reply(session, "150 Opening BINARY mode data connection");
+    while(sendfile(sd, file, &at, BUFLEN) > 0) {
+    } // end while(sendfile(...) > 0)
+    close(sd);
+    close(file);
+    reply(session, "226 Transfer complete");
+} // end retrieve(Session*, const string&)
+
+
+// reads an upload and throws it away
+void LoopbackServer::store(Session *session) {
+    vector<char> buffer(BUFLEN);
+    int          sd;
+
+    session->rest = 0;
+    if ((sd = dataConnection(session)) < 0) {
+        return;
+    } // end if ((sd = dataConnection(...)) < 0)
+
+    reply(session, "150 Ok to send data");
+    while(read(sd, &buffer[0], buffer.size()) > 0) {
+    } // end while(read(...) > 0)
+    close(sd);
+    reply(session, "226 Transfer complete");
+} // end store(Session*)
+
+
+// sends a listing of LIST_ENTRIES made-up files
+void LoopbackServer::list(Session *session, bool names) {
+    string listing;
+    char   line[128];
+    int    sd;
+
+    if ((sd = dataConnection(session)) < 0) {
+        return;
+    } // end if ((sd = dataConnection(...)) < 0)
+
+    for (int i = 0; i < LIST_ENTRIES; ++i) {
+        if (names) {
+            snprintf(line, sizeof(line), "file%04d.dat\r\n", i);
+        } // end if (names)
+        else {
+            snprintf(line, sizeof(line), "-rw-r--r--    1 ftp      ftp "
+                     "%12d Dec 13  2012 file%04d.dat\r\n", i * 1024, i);
+        } // end else (!names)
+        listing.append(line);
+    } // end for (i < LIST_ENTRIES)
+
+    reply(session, "150 Here comes the directory listing");
+    write(sd, listing.c_str(), listing.length());
+    close(sd);
+    reply(session, "226 Directory send OK");
+} // end list(Session*, bool)
@@ -0,0 +1,67 @@
+/*
+ * @file   LoopbackServer.h
+ * @brief  A minimal FTP server stand-in for benchmarking the client. It
+ *          listens on an ephemeral loopback port, serves files from one
+ *          directory with sendfile(), throws uploads away as fast as they
+ *          arrive and makes up directory listings, so the numbers measured
+ *          against it are the client's own.
+ * @author Brendan Sweeney, ID #1161836
+ * @date   December 13, 2012
+ */
+
+#ifndef LOOPBACKSERVER_H
+#define	LOOPBACKSERVER_H
+
+#include <arpa/inet.h>      // htonl, htons, ntohs
+#include <netinet/in.h>
+#include <netinet/tcp.h>    // TCP_NODELAY
+#include <sys/sendfile.h>   // sendfile
+#include <sys/socket.h>     // socket, bind, listen, accept
+#include <sys/stat.h>       // stat
+#include <errno.h>
+#include <fcntl.h>          // open
+#include <pthread.h>
+#include <stdio.h>          // snprintf
+#include <stdlib.h>         // atoll
+#include <string.h>         // memset
+#include <unistd.h>         // read, write, close
+#include <string>
+#include <vector>
+
+using namespace std;
+
+
+class LoopbackServer {
+public:
+    static const int LIST_ENTRIES = 1000;   // lines in a made-up listing
+    LoopbackServer(string root);
+    ~LoopbackServer();
+    bool start(void);
+    int  port(void) const;
+private:
+    static const int BUFLEN = 262144;       // upload drain buffer
+    string    root;         // directory files are served from
+    int       listenSd;     // control listener
+    int       portNum;      // port the control listener is bound to
+    pthread_t acceptor;     // runs accepter()
+
+    struct Session {
+        LoopbackServer *owner;  // server the session belongs to
+        int       sd;           // control connection
+        int       pasvSd;       // data listener from the last PASV, or -1
+        long long rest;         // offset from the last REST
+        string    line;         // control input not yet handled
+    };
+
+    static void *accepter(void *arg);
+    static void *serve(void *arg);
+    static int  listenOn(int& port);
+    static void reply(Session *session, const string& text);
+    static int  dataConnection(Session *session);
+    bool handle(Session *session, const string& verb, const string& arg);
+    void retrieve(Session *session, const string& name);
+    void store(Session *session);
+    void list(Session *session, bool names);
+}; // end class LoopbackServer
+
+#endif	/* LOOPBACKSERVER_H */
@@ -0,0 +1,575 @@
+/*
+ * @file   ftpbench.cpp
+ * @brief  Benchmarks the FTP client's get, put, ls and control round trips
+ *          against a LoopbackServer across file sizes, transfer buffer sizes
+ *          and connection counts. Each case reports throughput, system calls
+ *          per megabyte, heap allocations per command and median and 99th
+ *          percentile command latency as CSV or JSON, for comparing one build
+ *          against the next. With -a, get, put and PWD are also run with
+ *          every session on one thread, as AsyncSession coroutines.
+ * @author Brendan Sweeney, ID #1161836
+ * @date   December 13, 2012
+ */
+
+#include <pthread.h>
+#include <stdio.h>          // perror, snprintf
+#include <stdlib.h>         // mkdtemp, strtoll
+#include <unistd.h>         // getopt, ftruncate, unlink, rmdir
+#include <algorithm>        // sort
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "../Allocations.h"
+#include "../AsyncSession.h"
+#include "../FtpBackend.h"
+#include "../Reactor.h"
+#include "../Timer.h"
+#include "LoopbackServer.h"
+
+using namespace std;
+
+
+// one row of the report
+struct BenchCase {
+    string    op;           // get, put, ls or pwd, or aget, aput or apwd
+                            // for the same on one reactor thread
+    long long size;         // file size in bytes, 0 for ls and pwd
+    size_t    buffer;       // pinned transfer buffer, 0 for tuned
+    int       connections;  // sessions working at once
+    int       runs;         // commands per session
+    long long bytes;        // payload bytes moved by every session
+    long      usec;         // wall time of the whole case
+    long      syscalls;     // data path system calls of every session
+    long long allocs;       // heap allocations the commands made
+    double    p50, p99;     // command latency percentiles, milliseconds
+};
+
+
+// one session of a case, run on its own thread
+struct BenchSession {
+    FtpBackend     *backend;    // logged-in control session
+    AsyncSession   *async;      // or one driven by a reactor
+    const BenchCase *spec;      // what to run
+    string          remote;     // file to get or put
+    string          local;      // where to store or read the file
+    long long       bytes;      // payload bytes this session moved
+    long            syscalls;   // data path system calls it made
+    long long       allocs;     // heap allocations its commands made
+    int             failed;     // commands that did not succeed
+    vector<double>  latency;    // milliseconds per command
+};
+
+
+static const long long MEGABYTE = 1048576;
+static const long long DEF_BYTES_PER_CASE = 1024 * MEGABYTE;
+
+
+// parses a size such as 64K, 16M or 10G
+static long long parseSize(const string& text) {
+    char     *end;
+    long long value = strtoll(text.c_str(), &end, 10);
+
+    switch (*end) {
+        case 'G': case 'g':
+            value *= 1024;
+            // fall through
+        case 'M': case 'm':
+            value *= 1024;
+            // fall through
+        case 'K': case 'k':
+            value *= 1024;
+        default:
+            break;
+    } // end switch (*end)
+
+    return value;
+} // end parseSize(const string&)
+
+
+// parses a comma-separated list of sizes
+static vector<long long> parseList(const string& text) {
+    vector<long long> values;
+    istringstream     items(text);
+    string            item;
+
+    while(getline(items, item, ',')) {
+        if (!item.empty()) {
+            values.push_back(parseSize(item));
+        } // end if (!item.empty())
+    } // end while(getline(...))
+
+    return values;
+} // end parseList(const string&)
+
+
+// nearest-rank percentile of sorted samples
+static double percentile(const vector<double>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0.0;
+    } // end if (sorted.empty())
+
+    size_t rank = (size_t)(p / 100.0 * sorted.size() + 0.999999);
+
+    return sorted[rank > 0 ? rank - 1 : 0];
+} // end percentile(const vector<double>&, double)
+
+
+// thread body: runs one session's share of a case
+static void *runSession(void *arg) {
+    BenchSession *self = (BenchSession *)arg;
+    Timer         tick;
+
+    for (int i = 0; i < self->spec->runs; ++i) {
+        bool      ok;
+        long long before = Allocations::thisThread();
+
+        tick.start();
+        if (self->spec->op.compare("get") == 0) {
+            self->backend->ftpGet(self->remote, self->local);
+        } // end if (op == "get")
+        else if (self->spec->op.compare("put") == 0) {
+            self->backend->ftpPut(self->local, self->remote);
+        } // end else if (op == "put")
+        else if (self->spec->op.compare("ls") == 0) {
+            self->backend->ftpLs();
+        } // end else if (op == "ls")
+        else {
+            self->backend->ftpPwd();
+        } // end else
+        self->latency.push_back(tick.lap() / 1000.0);
+        self->allocs += Allocations::thisThread() - before;
+
+        if (self->spec->op.compare("pwd") == 0) {
+            ok = self->backend->lastReply().code / 100
+                 == FtpBackend::POS_COMPL;
+        } // end if (op == "pwd")
+        else {
+            const TransferResult& result = self->backend->lastTransfer();
+
+            ok = result.code / 100 == FtpBackend::POS_COMPL;
+            self->bytes    += result.bytes;
+            self->syscalls += result.syscalls;
+        } // end else
+        if (!ok) {
+            ++self->failed;
+        } // end if (!ok)
+    } // end for (i < runs)
+
+    return NULL;
+} // end runSession(void*)
+
+
+// coroutine body: opens and logs in one session of an async case
+static Task<void> loginAsync(AsyncSession *session, string port,
+                             int *failed) {
+    CommandResult result = co_await session->open("127.0.0.1", port);
+
+    if (result.code / 100 == FtpBackend::POS_COMPL) {
+        result = co_await session->login("bench", "bench");
+    } // end if (result.code / 100 == POS_COMPL)
+    if (result.code / 100 != FtpBackend::POS_COMPL) {
+        ++*failed;
+    } // end if (result.code / 100 != POS_COMPL)
+} // end loginAsync(AsyncSession*, string, int*)
+
+
+// coroutine body: runs one session's share of an async case
+static Task<void> runAsync(BenchSession *self) {
+    Timer tick;
+
+    for (int i = 0; i < self->spec->runs; ++i) {
+        int code;
+
+        tick.start();
+        if (self->spec->op.compare("apwd") == 0) {
+            CommandResult result = co_await self->async->pwd();
+
+            code = result.code;
+        } // end if (op == "apwd")
+        else {
+            TransferResult result;
+
+            if (self->spec->op.compare("aget") == 0) {
+                result = co_await self->async->get(self->remote,
+                                                   self->local);
+            } // end if (op == "aget")
+            else {
+                result = co_await self->async->put(self->local,
+                                                   self->remote);
+            } // end else
+            code            = result.code;
+            self->bytes    += result.bytes;
+            self->syscalls += result.syscalls;
+        } // end else (op != "apwd")
+        self->latency.push_back(tick.lap() / 1000.0);
+
+        if (code / 100 != FtpBackend::POS_COMPL) {
+            ++self->failed;
+        } // end if (code / 100 != POS_COMPL)
+    } // end for (i < runs)
+} // end runAsync(BenchSession*)
+
+
+// coroutine body: ends one session of an async case
+static Task<void> quitAsync(AsyncSession *session) {
+    co_await session->quit();
+} // end quitAsync(AsyncSession*)
+
+
+// where a session of a case reads or stores its file
+static string localPath(const BenchCase& spec, const string& files,
+                        const string& sink, const string& remote, int i) {
+    ostringstream local;
+
+    if (spec.op.compare("put") == 0 || spec.op.compare("aput") == 0) {
+        local << files << "/" << remote;
+    } // end if (op == "put" || op == "aput")
+    else if (sink.compare("/dev/null") == 0) {
+        local << sink;
+    } // end else if (sink == "/dev/null")
+    else {
+        local << sink << "/" << i << "." << remote;
+    } // end else
+
+    return local.str();
+} // end localPath(const BenchCase&, const string&, const string&, ...)
+
+
+// as runCase(), with every session a coroutine on one reactor thread; the
+// allocations counted include the coroutine frames
+static bool runAsyncCase(BenchCase& spec, int port, const string& files,
+                         const string& sink) {
+    vector<BenchSession> sessions(spec.connections);
+    vector<double>       latency;
+    ostringstream        portText, remote;
+    Reactor              reactor;
+    Timer                tick;
+    int                  failed = 0;
+
+    portText << port;
+    remote << spec.size << ".bin";
+
+    for (int i = 0; i < spec.connections; ++i) {
+        sessions[i].backend  = NULL;
+        sessions[i].async    = new AsyncSession(reactor);
+        sessions[i].spec     = &spec;
+        sessions[i].remote   = remote.str();
+        sessions[i].local    = localPath(spec, files, sink, remote.str(), i);
+        sessions[i].bytes    = 0;
+        sessions[i].syscalls = 0;
+        sessions[i].allocs   = 0;
+        sessions[i].failed   = 0;
+        sessions[i].latency.reserve(spec.runs);
+        reactor.spawn(loginAsync(sessions[i].async, portText.str(),
+                                 &failed));
+    } // end for (i < connections)
+    reactor.run();
+
+    if (failed == 0) {
+        long long before = Allocations::thisThread();
+
+        tick.start();
+        for (int i = 0; i < spec.connections; ++i) {
+            reactor.spawn(runAsync(&sessions[i]));
+        } // end for (i < connections)
+        reactor.run();
+        spec.usec   = tick.lap();
+        spec.allocs = Allocations::thisThread() - before;
+    } // end if (failed == 0)
+
+    spec.bytes    = 0;
+    spec.syscalls = 0;
+    for (int i = 0; i < spec.connections; ++i) {
+        spec.bytes    += sessions[i].bytes;
+        spec.syscalls += sessions[i].syscalls;
+        failed        += sessions[i].failed;
+        latency.insert(latency.end(), sessions[i].latency.begin(),
+                       sessions[i].latency.end());
+        reactor.spawn(quitAsync(sessions[i].async));
+    } // end for (i < connections)
+    reactor.run();
+    for (int i = 0; i < spec.connections; ++i) {
+        delete sessions[i].async;
+    } // end for (i < connections)
+
+    sort(latency.begin(), latency.end());
+    spec.p50 = percentile(latency, 50.0);
+    spec.p99 = percentile(latency, 99.0);
+    return failed == 0;
+} // end runAsyncCase(BenchCase&, int, const string&, const string&)
+
+
+// logs sessions in, runs the case on all of them at once and fills in the
+// measured fields; false if a session could not log in or a command failed
+static bool runCase(BenchCase& spec, int port, const string& files,
+                    const string& sink) {
+    vector<BenchSession> sessions(spec.connections);
+    vector<pthread_t>    threads(spec.connections);
+    vector<double>       latency;
+    ostringstream        portText, remote;
+    Timer                tick;
+    bool                 ok = true;
+
+    portText << port;
+    remote << spec.size << ".bin";
+
+    for (int i = 0; i < spec.connections; ++i) {
+        sessions[i].backend  = new FtpBackend();
+        sessions[i].async    = NULL;
+        sessions[i].spec     = &spec;
+        sessions[i].remote   = remote.str();
+        sessions[i].bytes    = 0;
+        sessions[i].syscalls = 0;
+        sessions[i].allocs   = 0;
+        sessions[i].failed   = 0;
+        sessions[i].latency.reserve(spec.runs);
+        sessions[i].local    = localPath(spec, files, sink, remote.str(), i);
+
+        sessions[i].backend->setBufferSize(spec.buffer);
+        sessions[i].backend->ftpOpen("127.0.0.1", portText.str());
+        if (!sessions[i].backend->ftpLogin("bench", "bench", "")) {
+            ok = false;
+        } // end if (!ftpLogin(...))
+    } // end for (i < connections)
+
+    if (ok) {
+        tick.start();
+        for (int i = 0; i < spec.connections; ++i) {
+            pthread_create(&threads[i], NULL, runSession, &sessions[i]);
+        } // end for (i < connections)
+        for (int i = 0; i < spec.connections; ++i) {
+            pthread_join(threads[i], NULL);
+        } // end for (i < connections)
+        spec.usec = tick.lap();
+    } // end if (ok)
+
+    spec.bytes    = 0;
+    spec.syscalls = 0;
+    spec.allocs   = 0;
+    for (int i = 0; i < spec.connections; ++i) {
+        spec.bytes    += sessions[i].bytes;
+        spec.syscalls += sessions[i].syscalls;
+        spec.allocs   += sessions[i].allocs;
+        ok = ok && sessions[i].failed == 0;
+        latency.insert(latency.end(), sessions[i].latency.begin(),
+                       sessions[i].latency.end());
+        sessions[i].backend->ftpQuit();
+        delete sessions[i].backend;
+    } // end for (i < connections)
+
+    sort(latency.begin(), latency.end());
+    spec.p50 = percentile(latency, 50.0);
+    spec.p99 = percentile(latency, 99.0);
+    return ok;
+} // end runCase(BenchCase&, int, const string&, const string&)
+
+
+// writes the report as CSV or as a JSON array
+static void report(ostream& out, const vector<BenchCase>& cases, bool json) {
+    if (json) {
+        out << "[" << endl;
+    } // end if (json)
+    else {
+        out << "op,size,buffer,connections,runs,bytes,seconds,mbytes_per_sec,"
+            << "syscalls_per_mb,allocs_per_cmd,p50_ms,p99_ms" << endl;
+    } // end else (!json)
+
+    for (size_t i = 0; i < cases.size(); ++i) {
+        const BenchCase& c = cases[i];
+        double seconds = c.usec / 1000000.0;
+        double mbytes  = (double)c.bytes / MEGABYTE;
+        double rate    = seconds > 0 ? mbytes / seconds : 0.0;
+        double calls   = mbytes > 0 ? c.syscalls / mbytes : 0.0;
+        int    count   = c.runs * c.connections;
+        double allocs  = count > 0 ? (double)c.allocs / count : 0.0;
+
+        if (json) {
+            out << "  {\"op\": \"" << c.op << "\", \"size\": " << c.size
+                << ", \"buffer\": " << c.buffer
+                << ", \"connections\": " << c.connections
+                << ", \"runs\": " << c.runs << ", \"bytes\": " << c.bytes
+                << ", \"seconds\": " << seconds
+                << ", \"mbytes_per_sec\": " << rate
+                << ", \"syscalls_per_mb\": " << calls
+                << ", \"allocs_per_cmd\": " << allocs
+                << ", \"p50_ms\": " << c.p50 << ", \"p99_ms\": " << c.p99
+                << "}" << (i + 1 < cases.size() ? "," : "") << endl;
+        } // end if (json)
+        else {
+            out << c.op << "," << c.size << "," << c.buffer << ","
+                << c.connections << "," << c.runs << "," << c.bytes << ","
+                << seconds << "," << rate << "," << calls << ","
+                << allocs << "," << c.p50 << "," << c.p99 << endl;
+        } // end else (!json)
+    } // end for (i < cases.size())
+
+    if (json) {
+        out << "]" << endl;
+    } // end if (json)
+} // end report(ostream&, const vector<BenchCase>&, bool)
+
+
+// prints how to run the benchmark
+static void usage(const char *name) {
+    cerr << "usage: " << name << " [-s sizes] [-b buffers] [-c connections]"
+         << " [-r runs] [-d dir] [-a] [-j] [-o file]" << endl
+         << "  -s  file sizes, default 1K,64K,1M,16M,256M,1G (10G works too)"
+         << endl
+         << "  -b  transfer buffers, default 0,64K,1M (0 is tuned)" << endl
+         << "  -c  connection counts, default 1,4" << endl
+         << "  -r  commands per session, default about 1G per case" << endl
+         << "  -d  keep downloads in dir instead of /dev/null" << endl
+         << "  -a  also run get, put and pwd on one reactor thread" << endl
+         << "  -j  write JSON instead of CSV" << endl
+         << "  -o  write the report to file instead of stdout" << endl;
+} // end usage(const char*)
+
+
+int main(int argc, char** argv) {
+    vector<long long> sizes       = parseList("1K,64K,1M,16M,256M,1G");
+    vector<long long> buffers     = parseList("0,64K,1M");
+    vector<long long> connections = parseList("1,4");
+    vector<BenchCase> cases;
+    string            sink("/dev/null");
+    string            output;
+    bool              json   = false;
+    bool              async  = false;
+    int               runs   = 0;
+    int               failed = 0;
+    int               option;
+    char              files[] = "/tmp/ftpbench.XXXXXX";
+
+    while((option = getopt(argc, argv, "s:b:c:r:d:ajo:")) != -1) {
+        switch (option) {
+            case 's':
+                sizes = parseList(optarg);
+                break;
+            case 'b':
+                buffers = parseList(optarg);
+                break;
+            case 'c':
+                connections = parseList(optarg);
+                break;
+            case 'r':
+                runs = atoi(optarg);
+                break;
+            case 'd':
+                sink = optarg;
+                break;
+            case 'a':
+                async = true;
+                break;
+            case 'j':
+                json = true;
+                break;
+            case 'o':
+                output = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        } // end switch (option)
+    } // end while((option = getopt(...)) != -1)
+
+    // sparse files cost no disk, so even 10G cases can be served
+    if (mkdtemp(files) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    } // end if (mkdtemp(...) == NULL)
+    for (size_t i = 0; i < sizes.size(); ++i) {
+        ostringstream name;
+        int           file;
+
+        name << files << "/" << sizes[i] << ".bin";
+        file = open(name.str().c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (file < 0 || ftruncate(file, sizes[i]) < 0) {
+            perror(name.str().c_str());
+            return 1;
+        } // end if (file < 0 || ...)
+        close(file);
+    } // end for (i < sizes.size())
+
+    LoopbackServer server(files);
+
+    if (!server.start()) {
+        perror("LoopbackServer");
+        return 1;
+    } // end if (!server.start())
+
+    // the matrix: every transfer for every size, buffer and connection
+    // count, then listings and control round trips per connection count
+    for (size_t c = 0; c < connections.size(); ++c) {
+        BenchCase spec = {"", 0, 0, (int)connections[c], 0, 0, 0, 0, 0, 0, 0};
+
+        for (size_t s = 0; s < sizes.size(); ++s) {
+            for (size_t b = 0; b < buffers.size(); ++b) {
+                long long share = DEF_BYTES_PER_CASE
+                                  / (sizes[s] * spec.connections + 1);
+
+                spec.size   = sizes[s];
+                spec.buffer = buffers[b];
+                spec.runs   = runs > 0 ? runs
+                                       : (int)max(3LL, min(100LL, share));
+                spec.op     = "get";
+                cases.push_back(spec);
+                spec.op     = "put";
+                cases.push_back(spec);
+            } // end for (b < buffers.size())
+
+            // a reactor session has one fixed buffer size
+            if (async) {
+                spec.buffer = 0;
+                spec.op     = "aget";
+                cases.push_back(spec);
+                spec.op     = "aput";
+                cases.push_back(spec);
+            } // end if (async)
+        } // end for (s < sizes.size())
+
+        spec.size   = 0;
+        spec.buffer = 0;
+        spec.runs   = runs > 0 ? runs : 100;
+        spec.op     = "ls";
+        cases.push_back(spec);
+        spec.runs   = runs > 0 ? runs : 1000;
+        spec.op     = "pwd";
+        cases.push_back(spec);
+        if (async) {
+            spec.op = "apwd";
+            cases.push_back(spec);
+        } // end if (async)
+    } // end for (c < connections.size())
+
+    for (size_t i = 0; i < cases.size(); ++i) {
+        cerr << cases[i].op << " size " << cases[i].size << " buffer "
+             << cases[i].buffer << " x" << cases[i].connections << "..."
+             << endl;
+        if (!(cases[i].op.at(0) == 'a'
+              ? runAsyncCase(cases[i], server.port(), files, sink)
+              : runCase(cases[i], server.port(), files, sink))) {
+            cerr << "  some commands failed" << endl;
+            ++failed;
+        } // end if (!(... ? runAsyncCase(...) : runCase(...)))
+    } // end for (i < cases.size())
+
+    if (output.empty()) {
+        report(cout, cases, json);
+    } // end if (output.empty())
+    else {
+        ofstream out(output.c_str());
+
+        report(out, cases, json);
+    } // end else (!output.empty())
+
+    for (size_t i = 0; i < sizes.size(); ++i) {
+        ostringstream name;
+
+        name << files << "/" << sizes[i] << ".bin";
+        unlink(name.str().c_str());
+    } // end for (i < sizes.size())
+    rmdir(files);
+
+    return failed > 0 ? 1 : 0;
+} // end main(int, char**)
@@ -1,21 +1,87 @@
-/* 
+/*
  * @file   ftp.cpp
- * @brief  Simple driver to run the FTP client.
+ * @brief  Simple driver to run the FTP client. With -b, or a script named
+ *          by -f, commands are read without prompts and the exit status
+ *          tells how the run went.
  * @author Brendan Sweeney, ID #1161836
  * @date   December 13, 2012
  */
 
+#include <unistd.h>         // getopt
 #include <cstdlib>
+#include <fstream>
+#include <iostream>
 #include "FtpBackend.h"
 #include "FtpFrontend.h"
 
 using namespace std;
 
 
+// prints how to run the client
+static void usage(const char *name) {
+    cerr << "usage: " << name << " [-b] [-e] [-f script] [-N netrc] "
+         << "[host [port]]" << endl
+         << "  -b  batch mode: no prompts; login from FTP_USER and "
+         << "FTP_PASSWORD or netrc" << endl
+         << "  -e  stop a batch at the first failed command" << endl
+         << "  -f  read commands from script (- for stdin); implies -b"
+         << endl
+         << "  -N  netrc file to read instead of $NETRC or ~/.netrc" << endl;
+} // end usage(const char*)
+
+
 int main(int argc, char** argv) {
     FtpFrontend go;
-    
-    go.run();
-    
-    return 0;
+    ifstream    script;
+    string      netrc;
+    bool        batch       = false;
+    bool        stopOnError = false;
+    int         option;
+
+    while((option = getopt(argc, argv, "bef:N:")) != -1) {
+        switch (option) {
+            case 'b':
+                batch = true;
+                break;
+            case 'e':
+                stopOnError = true;
+                break;
+            case 'f':
+                batch = true;
+                if (string(optarg).compare("-") != 0) {
+                    script.open(optarg);
+                    if (!script) {
+                        perror(optarg);
+                        return FtpFrontend::EXIT_FAILED;
+                    } // end if (!script)
+                    cin.rdbuf(script.rdbuf());
+                } // end if (string(optarg).compare("-") != 0)
+                break;
+            case 'N':
+                netrc = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                return FtpFrontend::EXIT_FAILED;
+        } // end switch (option)
+    } // end while((option = getopt(...)) != -1)
+
+    if (argc - optind > 2) {
+        usage(argv[0]);
+        return FtpFrontend::EXIT_FAILED;
+    } // end if (argc - optind > 2)
+
+    if (batch) {
+        go.setBatch(netrc, stopOnError);
+    } // end if (batch)
+
+    // a host on the command line is opened before any command is read
+    if (optind < argc
+            && !go.open(argv[optind], optind + 1 < argc ? argv[optind + 1]
+                                                        : "21")
+            && batch) {
+        return FtpFrontend::EXIT_NO_LOGIN;
+    } // end if (optind < argc && ...)
+
+    return go.run();
 } // end main(int, char**)